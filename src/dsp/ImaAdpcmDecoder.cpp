@@ -0,0 +1,48 @@
+#include "ImaAdpcmDecoder.hpp"
+
+static const int16_t STEP_TABLE[89] = {
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17,
+    19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+    50, 55, 60, 66, 73, 80, 88, 97, 107, 118,
+    130, 143, 157, 173, 190, 209, 230, 253, 279, 307,
+    337, 371, 408, 449, 494, 544, 598, 658, 724, 796,
+    876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066,
+    2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358,
+    5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899,
+    15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+};
+
+static const int8_t INDEX_TABLE[16] = {
+    -1, -1, -1, -1, 2, 4, 6, 8,
+    -1, -1, -1, -1, 2, 4, 6, 8
+};
+
+inline int ImaAdpcmDecoder::decodeNibble(uint8_t code) {
+    int step = STEP_TABLE[index];
+    
+    // diff = (code + 0.5) * step / 4 using shifts, as in the reference decoder
+    int diff = step >> 3;
+    if (code & 1) diff += step >> 2;
+    if (code & 2) diff += step >> 1;
+    if (code & 4) diff += step;
+    if (code & 8) diff = -diff;
+    
+    predictor += diff;
+    if (predictor > 32767) predictor = 32767;
+    else if (predictor < -32768) predictor = -32768;
+    
+    index += INDEX_TABLE[code];
+    if (index < 0) index = 0;
+    else if (index > 88) index = 88;
+    
+    return predictor;
+}
+
+void ImaAdpcmDecoder::decode(const uint8_t* src, size_t bytes, float* dst) {
+    const float scale = 1.0f / 32768.0f;
+    for (size_t i = 0; i < bytes; i++) {
+        uint8_t b = src[i];
+        dst[2 * i] = decodeNibble(b & 0x0F) * scale;
+        dst[2 * i + 1] = decodeNibble(b >> 4) * scale;
+    }
+}
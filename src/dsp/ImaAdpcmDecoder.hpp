@@ -0,0 +1,25 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// IMA ADPCM decoder for KiwiSDR compressed audio (SET AUDIO_COMP=1).
+//
+// Each byte carries two 4-bit codes, low nibble first, so a packet is a
+// quarter of the size of 16-bit PCM. The predictor state runs on across
+// packets and has to be reset whenever the stream restarts.
+class ImaAdpcmDecoder {
+public:
+    void reset() {
+        predictor = 0;
+        index = 0;
+    }
+    
+    // Decode bytes into 2 * bytes float samples in [-1, 1).
+    void decode(const uint8_t* src, size_t bytes, float* dst);
+
+private:
+    int predictor = 0;
+    int index = 0;
+    
+    inline int decodeNibble(uint8_t code);
+};
@@ -0,0 +1,226 @@
+#include "IqDemodulator.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE__) || defined(_M_X64)
+    #include <xmmintrin.h>
+    #define IQDEMOD_SSE 1
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    #include <arm_neon.h>
+    #define IQDEMOD_NEON 1
+#endif
+
+constexpr int IqDemodulator::TAPS;
+constexpr float IqDemodulator::FADE_SECONDS;
+constexpr float IqDemodulator::SSB_LOW_CUT;
+constexpr float IqDemodulator::CW_PITCH;
+constexpr float IqDemodulator::CW_WIDTH;
+constexpr float IqDemodulator::NBFM_DEVIATION;
+constexpr float IqDemodulator::AM_CARRIER_SECONDS;
+
+static const double PI = 3.14159265358979323846;
+
+// Complex FIR over TAPS interleaved I/Q pairs. The taps are doubled, so the
+// even lanes sum I and the odd lanes sum Q.
+static inline void complexDot(const float* window, const float* taps, float& i, float& q) {
+#if defined(IQDEMOD_SSE)
+    __m128 acc0 = _mm_setzero_ps(), acc1 = acc0;
+    for (int k = 0; k < 2 * IqDemodulator::TAPS; k += 8) {
+        acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(window + k), _mm_loadu_ps(taps + k)));
+        acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(window + k + 4), _mm_loadu_ps(taps + k + 4)));
+    }
+    float sum[4];
+    _mm_storeu_ps(sum, _mm_add_ps(acc0, acc1));
+    i = sum[0] + sum[2];
+    q = sum[1] + sum[3];
+#elif defined(IQDEMOD_NEON)
+    float32x4_t acc0 = vdupq_n_f32(0.0f), acc1 = acc0;
+    for (int k = 0; k < 2 * IqDemodulator::TAPS; k += 8) {
+        acc0 = vmlaq_f32(acc0, vld1q_f32(window + k), vld1q_f32(taps + k));
+        acc1 = vmlaq_f32(acc1, vld1q_f32(window + k + 4), vld1q_f32(taps + k + 4));
+    }
+    float32x4_t acc = vaddq_f32(acc0, acc1);
+    i = vgetq_lane_f32(acc, 0) + vgetq_lane_f32(acc, 2);
+    q = vgetq_lane_f32(acc, 1) + vgetq_lane_f32(acc, 3);
+#else
+    float acc[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+    for (int k = 0; k < 2 * IqDemodulator::TAPS; k += 4) {
+        acc[0] += window[k] * taps[k];
+        acc[1] += window[k + 1] * taps[k + 1];
+        acc[2] += window[k + 2] * taps[k + 2];
+        acc[3] += window[k + 3] * taps[k + 3];
+    }
+    i = acc[0] + acc[2];
+    q = acc[1] + acc[3];
+#endif
+}
+
+void IqDemodulator::Path::design(Mode newMode, float bandwidth, double rate) {
+    mode = newMode;
+    
+    // Passband centre and half width of the lowpass, and where the output mixer sits
+    double centre = 0.0;
+    double half = 0.5 * bandwidth;
+    double outFreq = 0.0;
+    if (mode == USB || mode == LSB) {
+        double top = std::max(0.5 * bandwidth, (double)SSB_LOW_CUT + 200.0);
+        half = 0.5 * (top - SSB_LOW_CUT);
+        centre = (mode == USB ? 1.0 : -1.0) * 0.5 * (top + SSB_LOW_CUT);
+        outFreq = centre;
+    } else if (mode == CW) {
+        half = 0.5 * CW_WIDTH;
+        outFreq = CW_PITCH;
+    }
+    half = std::min(std::max(half, 50.0), 0.45 * rate);
+    
+    // Blackman-windowed sinc, unity gain at DC
+    double cutoff = half / rate;
+    double sum = 0.0;
+    for (int k = 0; k < TAPS; k++) {
+        double x = k - 0.5 * (TAPS - 1);
+        double sinc = (x == 0.0) ? 2.0 * cutoff : std::sin(2.0 * PI * cutoff * x) / (PI * x);
+        double w = 0.42 - 0.5 * std::cos(2.0 * PI * k / (TAPS - 1)) + 0.08 * std::cos(4.0 * PI * k / (TAPS - 1));
+        taps[2 * k] = (float)(sinc * w);
+        sum += sinc * w;
+    }
+    for (int k = 0; k < TAPS; k++) {
+        taps[2 * k] = (float)(taps[2 * k] / sum);
+        taps[2 * k + 1] = taps[2 * k];
+    }
+    
+    // the input mixer moves the centre down to 0 Hz, the output mixer back up
+    inStepRe = (float)std::cos(2.0 * PI * centre / rate);
+    inStepIm = (float)-std::sin(2.0 * PI * centre / rate);
+    outStepRe = (float)std::cos(2.0 * PI * outFreq / rate);
+    outStepIm = (float)std::sin(2.0 * PI * outFreq / rate);
+}
+
+void IqDemodulator::Path::clear() {
+    std::memset(history, 0, sizeof(history));
+    historyPos = 0;
+    inRe = 1.0f;
+    inIm = 0.0f;
+    outRe = 1.0f;
+    outIm = 0.0f;
+    prevI = 0.0f;
+    prevQ = 0.0f;
+    carrier = 0.0f;
+}
+
+void IqDemodulator::Path::normalize() {
+    // keeps rounding from slowly changing the mixer amplitude
+    float inScale = 1.0f / std::sqrt(inRe * inRe + inIm * inIm);
+    inRe *= inScale;
+    inIm *= inScale;
+    float outScale = 1.0f / std::sqrt(outRe * outRe + outIm * outIm);
+    outRe *= outScale;
+    outIm *= outScale;
+}
+
+inline float IqDemodulator::Path::process(float i, float q, float carrierAlpha, float fmScale) {
+    // mix down
+    float mixedI = i * inRe - q * inIm;
+    float mixedQ = i * inIm + q * inRe;
+    float re = inRe * inStepRe - inIm * inStepIm;
+    inIm = inRe * inStepIm + inIm * inStepRe;
+    inRe = re;
+    
+    float* slot = history + 2 * historyPos;
+    slot[0] = slot[2 * TAPS] = mixedI;
+    slot[1] = slot[2 * TAPS + 1] = mixedQ;
+    if (++historyPos == TAPS) historyPos = 0;
+    
+    float y, yi, yq;
+    complexDot(history + 2 * historyPos, taps, yi, yq);
+    
+    switch (mode) {
+        case AM: {
+            float envelope = std::sqrt(yi * yi + yq * yq);
+            carrier += (envelope - carrier) * carrierAlpha;
+            y = envelope - carrier;
+            break;
+        }
+        case NBFM: {
+            // arg(y[n] * conj(y[n-1])), the phase step per sample
+            float dotRe = yi * prevI + yq * prevQ;
+            float dotIm = yq * prevI - yi * prevQ;
+            prevI = yi;
+            prevQ = yq;
+            y = std::atan2(dotIm, dotRe) * fmScale;
+            break;
+        }
+        default: {
+            // mix back up and keep the real part: only one sideband survived the lowpass
+            y = yi * outRe - yq * outIm;
+            float outNext = outRe * outStepRe - outIm * outStepIm;
+            outIm = outRe * outStepIm + outIm * outStepRe;
+            outRe = outNext;
+            break;
+        }
+    }
+    return y;
+}
+
+IqDemodulator::IqDemodulator() {
+    fadeLength = std::max(1, (int)(FADE_SECONDS * sampleRate));
+    paths[0].design(AM, bandwidth, sampleRate);
+    paths[1].design(AM, bandwidth, sampleRate);
+    reset();
+}
+
+void IqDemodulator::setSampleRate(double rate) {
+    if (rate <= 0.0 || rate == sampleRate) return;
+    
+    sampleRate = rate;
+    fadeLength = std::max(1, (int)(FADE_SECONDS * rate));
+    fadePos = std::min(fadePos, fadeLength);
+    paths[0].design(paths[0].mode, bandwidth, sampleRate);
+    paths[1].design(paths[1].mode, bandwidth, sampleRate);
+}
+
+void IqDemodulator::setMode(Mode mode) {
+    if (mode == paths[active].mode || mode < 0 || mode >= NUM_MODES) return;
+    
+    // the current chain fades out where it is, the new one starts from empty
+    active = 1 - active;
+    paths[active].clear();
+    paths[active].design(mode, bandwidth, sampleRate);
+    fadePos = 0;
+}
+
+void IqDemodulator::setBandwidth(float hz) {
+    if (hz == bandwidth || hz <= 0.0f) return;
+    
+    bandwidth = hz;
+    paths[0].design(paths[0].mode, bandwidth, sampleRate);
+    paths[1].design(paths[1].mode, bandwidth, sampleRate);
+}
+
+void IqDemodulator::reset() {
+    paths[0].clear();
+    paths[1].clear();
+    fadePos = fadeLength;
+}
+
+void IqDemodulator::process(const float* iq, float* out, size_t frames) {
+    float carrierAlpha = (float)std::min(1.0, 1.0 / (AM_CARRIER_SECONDS * sampleRate));
+    float fmScale = (float)(sampleRate / (2.0 * PI * NBFM_DEVIATION));
+    Path& current = paths[active];
+    Path& previous = paths[1 - active];
+    
+    for (size_t n = 0; n < frames; n++) {
+        float i = iq[2 * n];
+        float q = iq[2 * n + 1];
+        float y = current.process(i, q, carrierAlpha, fmScale);
+        if (fadePos < fadeLength) {
+            float fade = (fadePos + 0.5f) / fadeLength;
+            y = y * fade + previous.process(i, q, carrierAlpha, fmScale) * (1.0f - fade);
+            fadePos++;
+        }
+        out[n] = y;
+    }
+    
+    current.normalize();
+    previous.normalize();
+}
@@ -0,0 +1,84 @@
+#pragma once
+#include <cstddef>
+
+// Local demodulator for the KiwiSDR IQ stream (SET mod=iq).
+//
+// Demodulating on our side makes mode and passband changes take effect on
+// the next sample instead of after a server round trip and a restarted
+// stream. Every mode is the same chain: mix the passband centre to 0 Hz,
+// one complex FIR lowpass, then a detector:
+//   AM       envelope, with the carrier level tracked and removed
+//   NBFM     phase difference between neighbouring samples
+//   USB/LSB  Weaver: lowpass to half the sideband, mix back, real part
+//   CW       narrow lowpass around the carrier, mixed up to the BFO pitch
+// The lowpass runs on interleaved I/Q with doubled taps, so one SIMD
+// multiply-add covers two complex samples. A mode change crossfades from
+// the old chain to the new one over FADE_SECONDS, so switching never clicks.
+//
+// Single-threaded: the client runs it on the I/O thread, one packet at a time.
+class IqDemodulator {
+public:
+    // Same order as the client's KiwiSDR mode names
+    enum Mode {
+        AM,
+        NBFM,
+        USB,
+        LSB,
+        CW,
+        NUM_MODES
+    };
+    
+    static constexpr int TAPS = 96;                   // lowpass length, multiple of 4 for the SIMD dot product
+    static constexpr float FADE_SECONDS = 0.01f;      // crossfade on a mode change
+    static constexpr float SSB_LOW_CUT = 300.0f;      // Hz, bottom of the SSB audio passband
+    static constexpr float CW_PITCH = 700.0f;         // Hz, BFO offset
+    static constexpr float CW_WIDTH = 500.0f;         // Hz, whole CW passband
+    static constexpr float NBFM_DEVIATION = 5000.0f;  // Hz for full-scale output
+    static constexpr float AM_CARRIER_SECONDS = 0.05f;  // carrier level averaging
+    
+    IqDemodulator();
+    
+    // These only redesign the filter when something actually changes, so
+    // they may be called for every packet.
+    void setSampleRate(double rate);
+    void setMode(Mode mode);
+    // Whole passband in Hz, the server's high_cut - low_cut. SSB uses the
+    // upper half of it as its audio bandwidth; CW ignores it.
+    void setBandwidth(float hz);
+    Mode getMode() const { return paths[active].mode; }
+    
+    // Clear filter history and any crossfade in progress
+    void reset();
+    
+    // frames complex samples (I, Q interleaved) in, frames audio samples out
+    void process(const float* iq, float* out, size_t frames);
+
+private:
+    struct Path {
+        Mode mode = AM;
+        float taps[2 * TAPS];     // each tap twice, to line up with the I/Q pairs
+        float history[4 * TAPS];  // I/Q pairs stored twice so the window is contiguous
+        int historyPos = 0;
+        
+        // mixers, unit phasors turned by a fixed step each sample
+        float inRe = 1.0f, inIm = 0.0f;
+        float inStepRe = 1.0f, inStepIm = 0.0f;
+        float outRe = 1.0f, outIm = 0.0f;
+        float outStepRe = 1.0f, outStepIm = 0.0f;
+        
+        float prevI = 0.0f, prevQ = 0.0f;  // NBFM
+        float carrier = 0.0f;              // AM
+        
+        void design(Mode newMode, float bandwidth, double rate);
+        void clear();
+        void normalize();
+        inline float process(float i, float q, float carrierAlpha, float fmScale);
+    };
+    
+    double sampleRate = 12000.0;
+    float bandwidth = 8000.0f;
+    Path paths[2];
+    int active = 0;      // the other path is the one fading out
+    int fadeLength = 1;  // in samples
+    int fadePos = 1;     // samples into the crossfade, fadeLength when there is none
+};
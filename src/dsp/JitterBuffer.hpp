@@ -0,0 +1,130 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include "SpscRingBuffer.hpp"
+
+// Jitter buffer between the network thread and the audio thread.
+//
+// Received audio is held until targetLatency seconds have built up, and the
+// fill level is then kept there: update() turns the difference into a tiny
+// rate trim for the resampler, so drift between the server's clock and the
+// sound card is absorbed without dropping or repeating samples. After an
+// underrun it rebuffers to the target before playing again. Samples are
+// only thrown away when a burst overfills it far past the target.
+//
+// The ring has a fixed capacity, so changing the target never reallocates.
+// One producer thread calls push(), one consumer thread calls update(),
+// pop(), standby() and clear(); the target and the stats may be used from any thread.
+class JitterBuffer {
+public:
+    static constexpr double MAX_TRIM = 0.005;          // +-0.5%, well below an audible pitch change
+    static constexpr double DRIFT_GAIN = 0.01;         // trim per 100% fill error
+    static constexpr double SMOOTHING_SECONDS = 1.0;   // fill level averaging
+    static constexpr double OVERFILL_SECONDS = 0.1;    // slack on top of 3x target before dropping
+    
+    struct Stats {
+        std::atomic<uint32_t> underruns{0};  // times it ran dry while playing
+        std::atomic<uint32_t> overruns{0};   // times samples had to be thrown away
+        std::atomic<float> fill{0.0f};       // seconds buffered, smoothed while playing
+        std::atomic<float> trim{1.0f};       // rate correction in use
+    };
+    
+    explicit JitterBuffer(size_t capacity) : ring(capacity) {}
+    
+    void setTargetLatency(float seconds) { targetLatency.store(seconds); }
+    float getTargetLatency() const { return targetLatency.load(); }
+    const Stats& getStats() const { return stats; }
+    bool isBuffering() const { return buffering; }
+    
+    // Producer: a full buffer drops the tail of the packet
+    void push(const float* samples, size_t count) {
+        if (ring.push(samples, count) < count) {
+            stats.overruns.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+    
+    // Consumer: call once per output block before reading. Returns the rate
+    // trim for the resampler; above 1 drains a buffer that's fuller than the target.
+    double update(double inputRate, double blockSeconds) {
+        double fill = (double)ring.size();
+        double target = targetSamples(inputRate);
+        
+        // Far too much queued (e.g. a burst after a network stall): skip back to the target
+        double limit = 3.0 * target + OVERFILL_SECONDS * inputRate;
+        if (fill > limit) {
+            ring.discard((size_t)(fill - target));
+            fill = target;
+            averageFill = target;
+            stats.overruns.fetch_add(1, std::memory_order_relaxed);
+        }
+        
+        double trim = 1.0;
+        if (buffering) {
+            if (fill >= target) {
+                buffering = false;
+                averageFill = fill;
+            }
+        } else {
+            double alpha = std::min(1.0, blockSeconds / SMOOTHING_SECONDS);
+            averageFill += (fill - averageFill) * alpha;
+            double error = (averageFill - target) / target;
+            double maxTrim = MAX_TRIM;  // a copy, std::min would odr-use the member
+            trim = 1.0 + std::max(-maxTrim, std::min(maxTrim, error * DRIFT_GAIN));
+        }
+        
+        stats.fill.store((float)((buffering ? fill : averageFill) / inputRate), std::memory_order_relaxed);
+        stats.trim.store((float)trim, std::memory_order_relaxed);
+        return trim;
+    }
+    
+    // Consumer: source for the resampler. Gives nothing while rebuffering,
+    // so the resampler plays silence until the target is reached again.
+    size_t pop(float* dst, size_t count) {
+        if (buffering) return 0;
+        size_t got = ring.pop(dst, count);
+        if (got < count) {
+            buffering = true;
+            stats.underruns.fetch_add(1, std::memory_order_relaxed);
+        }
+        return got;
+    }
+    
+    // Consumer, in place of update() and pop() while nothing plays from it:
+    // keeps only the newest target's worth, so once it goes on air it
+    // starts at once and with current audio rather than stale
+    void standby(double inputRate) {
+        size_t keep = (size_t)std::ceil(targetSamples(inputRate));
+        size_t fill = ring.size();
+        if (fill > keep) ring.discard(fill - keep);
+        buffering = true;  // the next update() starts playing from a full target
+    }
+    
+    // Consumer: a whole target is buffered, so playing from here won't rebuffer first
+    bool isPrimed(double inputRate) const {
+        return (double)ring.size() >= targetSamples(inputRate);
+    }
+    
+    // Consumer: drop everything and rebuffer
+    void clear() {
+        ring.clear();
+        buffering = true;
+        averageFill = 0.0;
+    }
+
+private:
+    SpscRingBuffer<float> ring;
+    std::atomic<float> targetLatency{0.25f};
+    Stats stats;
+    
+    // consumer only
+    bool buffering = true;
+    double averageFill = 0.0;
+    
+    // Never more than half the ring, so there's room on top for jitter
+    double targetSamples(double inputRate) const {
+        return std::max(1.0, std::min((double)targetLatency.load() * inputRate, 0.5 * ring.capacity()));
+    }
+};
@@ -0,0 +1,149 @@
+#include "MultiChannelResampler.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE__) || defined(_M_X64)
+    #include <xmmintrin.h>
+    #define RESAMPLER_SSE 1
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    #include <arm_neon.h>
+    #define RESAMPLER_NEON 1
+#endif
+
+constexpr int MultiChannelResampler::MAX_CHANNELS;
+constexpr int MultiChannelResampler::TAPS;
+constexpr int MultiChannelResampler::STAGE_SIZE;
+
+// out[c] = sum over taps of h[k] * window[k][c] for the first GROUPS * 4
+// channels. Taps run in the outer loop so each group of four channels has its
+// own accumulator; they are spelled out so they stay in registers.
+template <int GROUPS>
+static inline void filterRow(const float* window, const float* h, float* out) {
+    const int stride = MultiChannelResampler::MAX_CHANNELS;
+#if defined(RESAMPLER_SSE)
+    __m128 acc0 = _mm_setzero_ps(), acc1 = acc0, acc2 = acc0, acc3 = acc0;
+    for (int k = 0; k < MultiChannelResampler::TAPS; k++) {
+        const float* w = window + k * stride;
+        __m128 tap = _mm_set1_ps(h[k]);
+        acc0 = _mm_add_ps(acc0, _mm_mul_ps(tap, _mm_load_ps(w)));
+        if (GROUPS > 1) acc1 = _mm_add_ps(acc1, _mm_mul_ps(tap, _mm_load_ps(w + 4)));
+        if (GROUPS > 2) acc2 = _mm_add_ps(acc2, _mm_mul_ps(tap, _mm_load_ps(w + 8)));
+        if (GROUPS > 3) acc3 = _mm_add_ps(acc3, _mm_mul_ps(tap, _mm_load_ps(w + 12)));
+    }
+    _mm_storeu_ps(out, acc0);
+    if (GROUPS > 1) _mm_storeu_ps(out + 4, acc1);
+    if (GROUPS > 2) _mm_storeu_ps(out + 8, acc2);
+    if (GROUPS > 3) _mm_storeu_ps(out + 12, acc3);
+#elif defined(RESAMPLER_NEON)
+    float32x4_t acc0 = vdupq_n_f32(0.0f), acc1 = acc0, acc2 = acc0, acc3 = acc0;
+    for (int k = 0; k < MultiChannelResampler::TAPS; k++) {
+        const float* w = window + k * stride;
+        acc0 = vmlaq_n_f32(acc0, vld1q_f32(w), h[k]);
+        if (GROUPS > 1) acc1 = vmlaq_n_f32(acc1, vld1q_f32(w + 4), h[k]);
+        if (GROUPS > 2) acc2 = vmlaq_n_f32(acc2, vld1q_f32(w + 8), h[k]);
+        if (GROUPS > 3) acc3 = vmlaq_n_f32(acc3, vld1q_f32(w + 12), h[k]);
+    }
+    vst1q_f32(out, acc0);
+    if (GROUPS > 1) vst1q_f32(out + 4, acc1);
+    if (GROUPS > 2) vst1q_f32(out + 8, acc2);
+    if (GROUPS > 3) vst1q_f32(out + 12, acc3);
+#else
+    float acc[GROUPS * 4] = {};
+    for (int k = 0; k < MultiChannelResampler::TAPS; k++) {
+        for (int c = 0; c < GROUPS * 4; c++) {
+            acc[c] += h[k] * window[k * stride + c];
+        }
+    }
+    std::copy(acc, acc + GROUPS * 4, out);
+#endif
+}
+
+static void filterRow(const float* window, const float* h, int groups, float* out) {
+    switch (groups) {
+        case 1: filterRow<1>(window, h, out); break;
+        case 2: filterRow<2>(window, h, out); break;
+        case 3: filterRow<3>(window, h, out); break;
+        default: filterRow<4>(window, h, out); break;
+    }
+}
+
+MultiChannelResampler::MultiChannelResampler() {
+    PolyphaseResampler::prebuildBanks();
+    reset();
+    setRates(12000.0, 44100.0);
+}
+
+void MultiChannelResampler::setChannels(int newChannels) {
+    newChannels = std::max(1, std::min(MAX_CHANNELS, newChannels));
+    for (int c = newChannels; c < MAX_CHANNELS; c++) {
+        clearChannel(c);
+    }
+    channels = newChannels;
+}
+
+void MultiChannelResampler::clearChannel(int c) {
+    if (c < 0 || c >= MAX_CHANNELS) return;
+    for (int k = 0; k < 2 * TAPS; k++) history[k][c] = 0.0f;
+    stagePos[c] = 0;
+    stageCount[c] = 0;
+}
+
+void MultiChannelResampler::setRates(double newInRate, double newOutRate) {
+    bool same = newInRate == inRate && newOutRate == outRate;
+    if (same && !provisional) return;
+    if (newInRate <= 0.0 || newOutRate <= 0.0) return;
+    
+    // Same bank as PolyphaseResampler, so both sound identical
+    PolyphaseResampler::Bank bank = PolyphaseResampler::getBank(newInRate, newOutRate);
+    if (same && bank.provisional) return;
+    
+    inRate = newInRate;
+    outRate = newOutRate;
+    table = bank.table;
+    exact = bank.exact;
+    provisional = bank.provisional;
+    phase = phase / phases * bank.phases;
+    if (exact) phase = std::floor(phase);
+    phases = bank.phases;
+    baseStep = bank.step;
+    step = baseStep * ratioTrim;
+}
+
+void MultiChannelResampler::setRatioTrim(double trim) {
+    if (trim == ratioTrim || trim <= 0.0) return;
+    ratioTrim = trim;
+    step = baseStep * ratioTrim;
+    if (exact && ratioTrim == 1.0) phase = std::floor(phase);
+}
+
+void MultiChannelResampler::reset() {
+    std::memset(history, 0, sizeof(history));
+    historyPos = 0;
+    phase = 0.0;
+    for (int c = 0; c < MAX_CHANNELS; c++) {
+        stagePos[c] = 0;
+        stageCount[c] = 0;
+    }
+}
+
+void MultiChannelResampler::computeOutput(float* out) const {
+    const float* window = history[historyPos];
+    const float* rows = table->data();
+    int row = (int)phase;
+    int groups = (channels + 3) / 4;
+    
+    if (exact && ratioTrim == 1.0) {
+        filterRow(window, rows + row * TAPS, groups, out);
+    } else {
+        // between two rows, as in PolyphaseResampler
+        float frac = (float)(phase - row);
+        float next[MAX_CHANNELS];
+        filterRow(window, rows + row * TAPS, groups, out);
+        filterRow(window, rows + (row + 1) * TAPS, groups, next);
+        for (int c = 0; c < groups * 4; c++) {
+            out[c] += (next[c] - out[c]) * frac;
+        }
+    }
+    std::fill(out + groups * 4, out + MAX_CHANNELS, 0.0f);
+}
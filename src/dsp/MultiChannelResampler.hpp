@@ -0,0 +1,84 @@
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <vector>
+#include "PolyphaseResampler.hpp"
+
+// PolyphaseResampler for up to MAX_CHANNELS streams at the same rate pair.
+//
+// All channels share one phase and one trim, so every output step is the
+// same filter row for every channel. History is stored channel-interleaved,
+// which turns the filter into a SIMD multiply-add across four channels at a
+// time instead of one horizontal dot product per channel. Each channel still
+// has its own history and pulls from its own source.
+//
+// Shared steps suit channels that come from the same server: their clocks
+// drift together, so one drift trim fits all of them.
+class MultiChannelResampler {
+public:
+    static constexpr int MAX_CHANNELS = 16;
+    static constexpr int TAPS = PolyphaseResampler::TAPS;
+    static constexpr int STAGE_SIZE = PolyphaseResampler::STAGE_SIZE;
+    
+    MultiChannelResampler();
+    
+    // Channels above the new count are silenced, so they start clean when reused
+    void setChannels(int channels);
+    int getChannels() const { return channels; }
+    // Forget one channel's history, for a new stream in a slot in the middle
+    void clearChannel(int channel);
+    
+    void setRates(double inRate, double outRate);
+    void setRatioTrim(double trim);
+    double getRatioTrim() const { return ratioTrim; }
+    
+    void reset();
+    
+    // Produce frames output frames of MAX_CHANNELS floats each (channels past
+    // getChannels() are zero). sources[c] is anything with
+    // size_t pop(float* dst, size_t count); a dry source is fed silence.
+    template <typename Source>
+    void process(Source* const* sources, float* out, size_t frames) {
+        for (size_t i = 0; i < frames; i++) {
+            computeOutput(out + i * MAX_CHANNELS);
+            phase += step;
+            while (phase >= (double)phases) {
+                phase -= (double)phases;
+                float* slot = history[historyPos];
+                for (int c = 0; c < channels; c++) {
+                    if (stagePos[c] == stageCount[c]) {
+                        stagePos[c] = 0;
+                        stageCount[c] = sources[c]->pop(stage[c], STAGE_SIZE);
+                    }
+                    slot[c] = (stagePos[c] < stageCount[c]) ? stage[c][stagePos[c]++] : 0.0f;
+                }
+                // history stored twice so the TAPS-long window is always contiguous
+                std::copy(slot, slot + MAX_CHANNELS, history[historyPos + TAPS]);
+                if (++historyPos == TAPS) historyPos = 0;
+            }
+        }
+    }
+
+private:
+    int channels = 1;
+    
+    double inRate = 0.0;
+    double outRate = 0.0;
+    std::shared_ptr<const std::vector<float>> table;
+    int phases = 1;
+    double step = 1.0;
+    double baseStep = 1.0;
+    double ratioTrim = 1.0;
+    double phase = 0.0;
+    bool exact = false;
+    bool provisional = false;  // on the stand-in bank until the real one is prepared
+    
+    alignas(16) float history[2 * TAPS][MAX_CHANNELS];
+    int historyPos = 0;
+    
+    float stage[MAX_CHANNELS][STAGE_SIZE];
+    size_t stagePos[MAX_CHANNELS];
+    size_t stageCount[MAX_CHANNELS];
+    
+    void computeOutput(float* out) const;
+};
@@ -0,0 +1,92 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+// Stands in for packets the sequence numbers say were lost, so the stream
+// keeps its length and the jitter buffer its fill level.
+//
+// A lost packet is replaced by the last good one, fading towards silence
+// over FADE_PACKETS consecutive losses. Every join (into a repeat, and back
+// into real audio) is crossfaded with the time-reversed tail of whatever
+// came out last, which continues smoothly from the final sample, so there
+// is no step to click on. Works on interleaved frames of 1 (audio) or
+// 2 (I/Q) channels. Single-threaded; all storage is allocated up front.
+class PacketConcealer {
+public:
+    static constexpr size_t MAX_VALUES = 8192;  // longest packet remembered
+    static constexpr int FADE_FRAMES = 32;      // crossfade at each join
+    static constexpr int FADE_PACKETS = 4;      // losses in a row until silence
+    
+    PacketConcealer() : last(MAX_VALUES), tail(2 * FADE_FRAMES) {}
+    
+    // Format of the stream; a change forgets the last packet
+    void setChannels(int newChannels) {
+        if (newChannels == channels) return;
+        channels = std::max(1, std::min(2, newChannels));
+        reset();
+    }
+    int getChannels() const { return channels; }
+    
+    void reset() {
+        lastCount = 0;
+        tailFrames = 0;
+        losses = 0;
+    }
+    
+    // Values (frames * channels) a stand-in packet will have, 0 if there is nothing to repeat
+    size_t packetSize() const { return lastCount; }
+    
+    // Write one stand-in packet of packetSize() values to out
+    void conceal(float* out) {
+        size_t frames = lastCount / channels;
+        float startGain = std::max(0.0f, 1.0f - (float)losses / FADE_PACKETS);
+        float endGain = std::max(0.0f, 1.0f - (float)(losses + 1) / FADE_PACKETS);
+        for (size_t i = 0; i < frames; i++) {
+            float gain = startGain + (endGain - startGain) * (i + 0.5f) / frames;
+            for (int c = 0; c < channels; c++) {
+                out[i * channels + c] = last[i * channels + c] * gain;
+            }
+        }
+        blendIn(out, frames);
+        keepTail(out, frames);
+        losses++;
+    }
+    
+    // Pass every good packet through, in place, before it is delivered
+    void receive(float* samples, size_t count) {
+        size_t frames = count / channels;
+        if (losses > 0) {
+            blendIn(samples, frames);
+            losses = 0;
+        }
+        size_t maxValues = MAX_VALUES;  // a copy, std::min would odr-use the member
+        lastCount = std::min(count, maxValues) / channels * channels;
+        std::copy(samples, samples + lastCount, last.begin());
+        keepTail(samples, frames);
+    }
+
+private:
+    int channels = 1;
+    std::vector<float> last;  // last good packet
+    size_t lastCount = 0;
+    std::vector<float> tail;  // last frames that went out
+    int tailFrames = 0;
+    int losses = 0;           // consecutive stand-ins so far
+    
+    void blendIn(float* x, size_t frames) {
+        int n = (int)std::min(frames, (size_t)tailFrames);
+        for (int i = 0; i < n; i++) {
+            float w = (i + 0.5f) / n;
+            for (int c = 0; c < channels; c++) {
+                float mirrored = tail[(tailFrames - 1 - i) * channels + c];
+                x[i * channels + c] = x[i * channels + c] * w + mirrored * (1.0f - w);
+            }
+        }
+    }
+    
+    void keepTail(const float* x, size_t frames) {
+        tailFrames = (int)std::min(frames, (size_t)FADE_FRAMES);
+        std::copy(x + (frames - tailFrames) * channels, x + frames * channels, tail.begin());
+    }
+};
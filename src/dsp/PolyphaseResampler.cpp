@@ -0,0 +1,290 @@
+#include "PolyphaseResampler.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <iterator>
+#include <mutex>
+
+#if defined(__SSE__) || defined(_M_X64)
+    #include <xmmintrin.h>
+    #define RESAMPLER_SSE 1
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    #include <arm_neon.h>
+    #define RESAMPLER_NEON 1
+#endif
+
+constexpr int PolyphaseResampler::TAPS;
+constexpr int PolyphaseResampler::MAX_PHASES;
+constexpr int PolyphaseResampler::STAGE_SIZE;
+
+static const double PI = 3.14159265358979323846;
+
+// Stand-in bank while a pair's own one is being prepared; also the real bank
+// for any non-integer upsampling pair, such as 12001.135 -> 44100
+static const double FALLBACK_CUTOFF = 0.45;
+
+// Engine rates Rack offers, prepared against every server rate
+static const double COMMON_OUTPUT_RATES[] = {44100.0, 48000.0, 88200.0, 96000.0, 176400.0, 192000.0};
+
+// Append-only table cache. Writers serialise on buildMutex and publish an
+// entry by bumping tableCount; readers scan the published entries without
+// locking. Entries are never removed, so a published one stays valid.
+struct CachedTable {
+    int phases;
+    long long cutoffKey;
+    std::shared_ptr<const std::vector<float>> rows;
+};
+static const int MAX_TABLES = 64;
+static CachedTable tables[MAX_TABLES];
+static std::atomic<int> tableCount{0};
+static std::mutex buildMutex;
+
+// Rates the banks are prepared between, guarded by rateMutex
+static const size_t MAX_RATES = 32;
+static std::vector<double> inputRates;
+static std::vector<double> outputRates;
+static std::mutex rateMutex;
+
+static long long cutoffKey(double cutoff) {
+    return std::llround(cutoff * 1e9);
+}
+
+// TAPS-long dot product; TAPS is a multiple of 4
+static inline float dotProduct(const float* a, const float* b) {
+#if defined(RESAMPLER_SSE)
+    __m128 acc = _mm_setzero_ps();
+    for (int i = 0; i < PolyphaseResampler::TAPS; i += 4) {
+        acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+    }
+    acc = _mm_add_ps(acc, _mm_movehl_ps(acc, acc));
+    acc = _mm_add_ss(acc, _mm_shuffle_ps(acc, acc, 1));
+    return _mm_cvtss_f32(acc);
+#elif defined(RESAMPLER_NEON)
+    float32x4_t acc = vdupq_n_f32(0.0f);
+    for (int i = 0; i < PolyphaseResampler::TAPS; i += 4) {
+        acc = vmlaq_f32(acc, vld1q_f32(a + i), vld1q_f32(b + i));
+    }
+    float32x2_t sum = vadd_f32(vget_low_f32(acc), vget_high_f32(acc));
+    return vget_lane_f32(vpadd_f32(sum, sum), 0);
+#else
+    float acc[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+    for (int i = 0; i < PolyphaseResampler::TAPS; i += 4) {
+        acc[0] += a[i] * b[i];
+        acc[1] += a[i + 1] * b[i + 1];
+        acc[2] += a[i + 2] * b[i + 2];
+        acc[3] += a[i + 3] * b[i + 3];
+    }
+    return (acc[0] + acc[1]) + (acc[2] + acc[3]);
+#endif
+}
+
+static bool isInteger(double x) {
+    return x > 0.0 && std::fabs(x - std::round(x)) < 1e-6;
+}
+
+static long long gcd(long long a, long long b) {
+    while (b) {
+        long long t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+PolyphaseResampler::PolyphaseResampler() {
+    prebuildBanks();
+    reset();
+    setRates(12000.0, 44100.0);
+}
+
+void PolyphaseResampler::setRates(double newInRate, double newOutRate) {
+    bool same = newInRate == inRate && newOutRate == outRate;
+    if (same && !provisional) return;
+    if (newInRate <= 0.0 || newOutRate <= 0.0) return;
+
+    Bank bank = getBank(newInRate, newOutRate);
+    // still waiting for the prepared bank
+    if (same && bank.provisional) return;
+
+    inRate = newInRate;
+    outRate = newOutRate;
+    table = bank.table;
+    exact = bank.exact;
+    provisional = bank.provisional;
+    // keep the same relative position in the new bank
+    phase = phase / phases * bank.phases;
+    if (exact) phase = std::floor(phase);
+    phases = bank.phases;
+    baseStep = bank.step;
+    step = baseStep * ratioTrim;
+}
+
+// Phase count and step for a rate pair, and the passband edge its table needs
+static PolyphaseResampler::Bank bankLayout(double inRate, double outRate, double* cutoff) {
+    const int maxPhases = PolyphaseResampler::MAX_PHASES;
+    PolyphaseResampler::Bank bank;
+    bank.phases = maxPhases;
+    bank.step = maxPhases * inRate / outRate;
+    bank.exact = false;
+    bank.provisional = false;
+
+    if (isInteger(inRate) && isInteger(outRate)) {
+        long long in = std::llround(inRate);
+        long long out = std::llround(outRate);
+        long long g = gcd(in, out);
+        if (out / g <= maxPhases) {
+            bank.phases = (int)(out / g);
+            bank.step = (double)(in / g);
+            bank.exact = true;
+        }
+    }
+
+    // Passband edge relative to the input rate; scale down when decimating
+    *cutoff = FALLBACK_CUTOFF * std::min(1.0, outRate / inRate);
+    return bank;
+}
+
+PolyphaseResampler::Bank PolyphaseResampler::getBank(double inRate, double outRate) {
+    double cutoff;
+    Bank bank = bankLayout(inRate, outRate, &cutoff);
+    bank.table = findTable(bank.phases, cutoff);
+    if (bank.table) return bank;
+
+    // prebuildBanks has run in every constructor, so this one is always there
+    bank.phases = MAX_PHASES;
+    bank.step = MAX_PHASES * inRate / outRate;
+    bank.exact = false;
+    bank.provisional = true;
+    bank.table = findTable(MAX_PHASES, FALLBACK_CUTOFF);
+    return bank;
+}
+
+void PolyphaseResampler::prebuildBanks() {
+    static std::once_flag built;
+    std::call_once(built, []() {
+        buildTable(MAX_PHASES, FALLBACK_CUTOFF);
+        {
+            std::lock_guard<std::mutex> lock(rateMutex);
+            inputRates.push_back(12000.0);
+            outputRates.assign(std::begin(COMMON_OUTPUT_RATES), std::end(COMMON_OUTPUT_RATES));
+        }
+        for (double outRate : COMMON_OUTPUT_RATES) {
+            prepareBank(12000.0, outRate);
+        }
+    });
+}
+
+void PolyphaseResampler::prepareBank(double inRate, double outRate) {
+    if (inRate <= 0.0 || outRate <= 0.0) return;
+    double cutoff;
+    Bank bank = bankLayout(inRate, outRate, &cutoff);
+    buildTable(bank.phases, cutoff);
+}
+
+// Remembers rate and returns the rates on the other side to prepare it
+// against, or nothing if it was already known
+static std::vector<double> addRate(std::vector<double>& rates, const std::vector<double>& others, double rate) {
+    std::lock_guard<std::mutex> lock(rateMutex);
+    if (std::find(rates.begin(), rates.end(), rate) != rates.end()) return {};
+    if (rates.size() < MAX_RATES) rates.push_back(rate);
+    return others;
+}
+
+void PolyphaseResampler::prepareInputRate(double inRate) {
+    if (inRate <= 0.0) return;
+    prebuildBanks();
+    for (double outRate : addRate(inputRates, outputRates, inRate)) {
+        prepareBank(inRate, outRate);
+    }
+}
+
+void PolyphaseResampler::prepareOutputRate(double outRate) {
+    if (outRate <= 0.0) return;
+    prebuildBanks();
+    for (double inRate : addRate(outputRates, inputRates, outRate)) {
+        prepareBank(inRate, outRate);
+    }
+}
+
+void PolyphaseResampler::setRatioTrim(double trim) {
+    if (trim == ratioTrim || trim <= 0.0) return;
+    ratioTrim = trim;
+    step = baseStep * ratioTrim;
+    // back on the exact grid once the trim is released
+    if (exact && ratioTrim == 1.0) phase = std::floor(phase);
+}
+
+void PolyphaseResampler::reset() {
+    std::memset(history, 0, sizeof(history));
+    historyPos = 0;
+    phase = 0.0;
+    stagePos = 0;
+    stageCount = 0;
+}
+
+float PolyphaseResampler::computeOutput() const {
+    const float* window = &history[historyPos];
+    const float* rows = table->data();
+    int row = (int)phase;
+
+    // a trimmed step leaves the exact grid, so interpolate between rows then
+    if (exact && ratioTrim == 1.0) {
+        return dotProduct(window, rows + row * TAPS);
+    }
+
+    float frac = (float)(phase - row);
+    float y0 = dotProduct(window, rows + row * TAPS);
+    float y1 = dotProduct(window, rows + (row + 1) * TAPS);
+    return y0 + (y1 - y0) * frac;
+}
+
+std::shared_ptr<const std::vector<float>> PolyphaseResampler::findTable(int phases, double cutoff) {
+    long long key = cutoffKey(cutoff);
+    int count = tableCount.load(std::memory_order_acquire);
+    for (int i = 0; i < count; i++) {
+        if (tables[i].phases == phases && tables[i].cutoffKey == key) return tables[i].rows;
+    }
+    return nullptr;
+}
+
+void PolyphaseResampler::buildTable(int phases, double cutoff) {
+    std::lock_guard<std::mutex> lock(buildMutex);
+    if (findTable(phases, cutoff)) return;
+    int count = tableCount.load(std::memory_order_relaxed);
+    // a full cache leaves the pair on the stand-in bank
+    if (count == MAX_TABLES) return;
+
+    // Row p is the windowed sinc sampled at fractional delay p/phases. The
+    // output instant sits between window taps TAPS/2 - 1 and TAPS/2, so row
+    // `phases` (delay 1.0) is kept as well for interpolating past the last phase.
+    std::vector<float>* rows = new std::vector<float>((phases + 1) * TAPS);
+    const double center = TAPS / 2 - 1;
+
+    for (int p = 0; p <= phases; p++) {
+        double frac = (double)p / phases;
+        float* h = &(*rows)[p * TAPS];
+        double sum = 0.0;
+
+        for (int k = 0; k < TAPS; k++) {
+            double x = k - center - frac;
+            double arg = 2.0 * cutoff * x;
+            double sinc = (std::fabs(arg) < 1e-12) ? 1.0 : std::sin(PI * arg) / (PI * arg);
+            // Blackman window spanning the full TAPS taps around the output instant
+            double w = 0.42 + 0.5 * std::cos(2.0 * PI * x / TAPS) + 0.08 * std::cos(4.0 * PI * x / TAPS);
+            if (std::fabs(x) >= TAPS / 2) w = 0.0;
+            h[k] = (float)(2.0 * cutoff * sinc * w);
+            sum += h[k];
+        }
+
+        // unity DC gain for every phase
+        for (int k = 0; k < TAPS; k++) {
+            h[k] = (float)(h[k] / sum);
+        }
+    }
+
+    tables[count].phases = phases;
+    tables[count].cutoffKey = cutoffKey(cutoff);
+    tables[count].rows.reset(rows);
+    tableCount.store(count + 1, std::memory_order_release);
+}
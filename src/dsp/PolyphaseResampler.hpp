@@ -0,0 +1,121 @@
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+// Polyphase windowed-sinc resampler for the KiwiSDR rate -> engine rate path.
+//
+// When both rates are integers and the reduced output factor L fits in
+// MAX_PHASES (12k -> 44.1k/48k/96k/192k all do), the filter bank has exactly
+// L phases and every output lands on a precomputed phase. Anything else
+// (e.g. the 12001.135 Hz a Kiwi actually reports) uses a 256-phase bank with
+// linear interpolation between neighbouring phases.
+//
+// Filter tables are immutable and shared between all instances with the same
+// rate pair, so a dozen receivers only build them once. They are built off the
+// audio thread (prepareBank and friends) and published to a lock-free cache;
+// the 12k -> 44.1k/48k/88.2k/96k/176.4k/192k banks are ready from the first
+// constructor on.
+class PolyphaseResampler {
+public:
+    static constexpr int TAPS = 32;         // per phase, multiple of 4 for the SIMD dot product
+    static constexpr int MAX_PHASES = 256;
+    static constexpr int STAGE_SIZE = 64;   // input samples pulled from the source at a time
+
+    PolyphaseResampler();
+
+    // Rebuilds the phase table only when the rates actually change.
+    void setRates(double inRate, double outRate);
+    double getInputRate() const { return inRate; }
+    double getOutputRate() const { return outRate; }
+
+    // Nudge the conversion ratio by a factor close to 1 without touching the
+    // filter bank, e.g. for clock drift correction. Above 1 consumes input faster.
+    void setRatioTrim(double trim);
+    double getRatioTrim() const { return ratioTrim; }
+
+    // Clear filter history and phase.
+    void reset();
+
+    // The filter bank chosen for a rate pair, shared with MultiChannelResampler.
+    // step is in phases per output sample; exact means every output lands on a row.
+    // provisional means the pair's own bank isn't built yet and this is the
+    // 256-phase one standing in for it.
+    struct Bank {
+        std::shared_ptr<const std::vector<float>> table;  // (phases + 1) rows of TAPS
+        int phases;
+        double step;
+        bool exact;
+        bool provisional;
+    };
+    // Lock-free and allocation-free, so safe on the audio thread
+    static Bank getBank(double inRate, double outRate);
+
+    // These build tables, so they allocate and may block: call them from the
+    // I/O thread or onSampleRateChange, never from process().
+    static void prebuildBanks();  // the common 12k banks, once
+    static void prepareBank(double inRate, double outRate);
+    // A server rate against every engine rate seen so far, and vice versa,
+    // so the bank is ready whichever of the two is reported last.
+    static void prepareInputRate(double inRate);
+    static void prepareOutputRate(double outRate);
+
+    // Produce exactly frames output samples, pulling input from source as needed.
+    // Source is anything with size_t pop(float* dst, size_t count), e.g. SpscRingBuffer<float>.
+    // When the source runs dry the filter is fed silence. Returns the number of
+    // input samples that had to be substituted.
+    template <typename Source>
+    size_t process(Source& source, float* out, size_t frames) {
+        size_t starved = 0;
+        for (size_t i = 0; i < frames; i++) {
+            out[i] = computeOutput();
+            phase += step;
+            while (phase >= (double)phases) {
+                phase -= (double)phases;
+                if (stagePos == stageCount) {
+                    stagePos = 0;
+                    stageCount = source.pop(stage, STAGE_SIZE);
+                }
+                if (stagePos < stageCount) {
+                    pushInput(stage[stagePos++]);
+                } else {
+                    pushInput(0.0f);
+                    starved++;
+                }
+            }
+        }
+        return starved;
+    }
+
+private:
+    double inRate = 0.0;
+    double outRate = 0.0;
+
+    std::shared_ptr<const std::vector<float>> table;  // (phases + 1) rows of TAPS
+    int phases = 1;
+    double step = 1.0;   // in units of phases per output sample
+    double baseStep = 1.0;  // step before the trim
+    double ratioTrim = 1.0;
+    double phase = 0.0;  // [0, phases)
+    bool exact = false;  // every output lands on a table row (only while untrimmed)
+    bool provisional = false;  // looked up again on every setRates until prepared
+
+    // history stored twice so the TAPS-long window is always contiguous
+    float history[2 * TAPS];
+    int historyPos = 0;
+
+    float stage[STAGE_SIZE];
+    size_t stagePos = 0;
+    size_t stageCount = 0;
+
+    inline void pushInput(float x) {
+        history[historyPos] = x;
+        history[historyPos + TAPS] = x;
+        if (++historyPos == TAPS) historyPos = 0;
+    }
+
+    float computeOutput() const;
+
+    static std::shared_ptr<const std::vector<float>> findTable(int phases, double cutoff);
+    static void buildTable(int phases, double cutoff);
+};
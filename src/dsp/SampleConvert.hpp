@@ -0,0 +1,43 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__SSE2__) || defined(_M_X64)
+    #include <emmintrin.h>
+    #define SAMPLECONVERT_SSE2 1
+#elif (defined(__ARM_NEON) || defined(__ARM_NEON__)) && !defined(__ARM_BIG_ENDIAN)
+    #include <arm_neon.h>
+    #define SAMPLECONVERT_NEON 1
+#endif
+
+// Convert little-endian signed 16-bit PCM bytes to floats in [-1, 1).
+// src needs no particular alignment; count is the number of samples.
+inline void convertInt16LE(const uint8_t* src, float* dst, size_t count) {
+    const float scale = 1.0f / 32768.0f;
+    size_t i = 0;
+
+#if defined(SAMPLECONVERT_SSE2)
+    const __m128 vscale = _mm_set1_ps(scale);
+    for (; i + 8 <= count; i += 8) {
+        __m128i x = _mm_loadu_si128((const __m128i*)(src + 2 * i));
+        // interleave with itself, then shift right to sign-extend to 32 bits
+        __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16);
+        __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16);
+        _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(lo), vscale));
+        _mm_storeu_ps(dst + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), vscale));
+    }
+#elif defined(SAMPLECONVERT_NEON)
+    for (; i + 8 <= count; i += 8) {
+        int16x8_t x = vreinterpretq_s16_u8(vld1q_u8(src + 2 * i));
+        float32x4_t lo = vcvtq_f32_s32(vmovl_s16(vget_low_s16(x)));
+        float32x4_t hi = vcvtq_f32_s32(vmovl_s16(vget_high_s16(x)));
+        vst1q_f32(dst + i, vmulq_n_f32(lo, scale));
+        vst1q_f32(dst + i + 4, vmulq_n_f32(hi, scale));
+    }
+#endif
+    
+    for (; i < count; i++) {
+        int16_t sample = (int16_t)(src[2 * i] | (src[2 * i + 1] << 8));
+        dst[i] = sample * scale;
+    }
+}
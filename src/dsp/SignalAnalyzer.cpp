@@ -0,0 +1,211 @@
+#include "SignalAnalyzer.hpp"
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE__) || defined(_M_X64)
+    #include <xmmintrin.h>
+    #define ANALYZER_SSE 1
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    #include <arm_neon.h>
+    #define ANALYZER_NEON 1
+#endif
+
+constexpr int SignalAnalyzer::BINS;
+constexpr int SignalAnalyzer::FIRST_BIN;
+constexpr int SignalAnalyzer::WINDOW;
+constexpr float SignalAnalyzer::SMOOTHING_SECONDS;
+constexpr float SignalAnalyzer::CARRIER_THRESHOLD_DB;
+constexpr float SignalAnalyzer::CARRIER_HYSTERESIS_DB;
+
+static const double PI = 3.14159265358979323846;
+static const float MIN_LEVEL = 1e-6f;         // keeps the dB figures finite in silence
+static const float MIN_CARRIER_POWER = 1e-8f;  // amplitude 1e-4, below that nothing is a carrier
+
+// Sum of squares and largest magnitude of a block
+static inline void measureBlock(const float* x, size_t count, float& sumSquares, float& peak) {
+    size_t i = 0;
+    float sum = 0.0f;
+    float maxAbs = 0.0f;
+#if defined(ANALYZER_SSE)
+    __m128 acc = _mm_setzero_ps();
+    __m128 top = _mm_setzero_ps();
+    for (; i + 4 <= count; i += 4) {
+        __m128 v = _mm_loadu_ps(x + i);
+        acc = _mm_add_ps(acc, _mm_mul_ps(v, v));
+        top = _mm_max_ps(top, _mm_max_ps(v, _mm_sub_ps(_mm_setzero_ps(), v)));
+    }
+    float lanes[4];
+    _mm_storeu_ps(lanes, acc);
+    sum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+    _mm_storeu_ps(lanes, top);
+    maxAbs = std::max(std::max(lanes[0], lanes[1]), std::max(lanes[2], lanes[3]));
+#elif defined(ANALYZER_NEON)
+    float32x4_t acc = vdupq_n_f32(0.0f);
+    float32x4_t top = vdupq_n_f32(0.0f);
+    for (; i + 4 <= count; i += 4) {
+        float32x4_t v = vld1q_f32(x + i);
+        acc = vmlaq_f32(acc, v, v);
+        top = vmaxq_f32(top, vabsq_f32(v));
+    }
+    float lanes[4];
+    vst1q_f32(lanes, acc);
+    sum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+    vst1q_f32(lanes, top);
+    maxAbs = std::max(std::max(lanes[0], lanes[1]), std::max(lanes[2], lanes[3]));
+#endif
+    for (; i < count; i++) {
+        sum += x[i] * x[i];
+        maxAbs = std::max(maxAbs, std::fabs(x[i]));
+    }
+    sumSquares = sum;
+    peak = maxAbs;
+}
+
+SignalAnalyzer::SignalAnalyzer() {
+    // The bins sit on whole DFT bins of a frame, so only their frequencies
+    // in Hz depend on the sample rate
+    for (int n = 0; n < WINDOW; n++) {
+        window[n] = (float)(0.5 - 0.5 * std::cos(2.0 * PI * n / WINDOW));
+    }
+    for (int k = 0; k < BINS; k++) {
+        coeffs[k] = (float)(2.0 * std::cos(2.0 * PI * (FIRST_BIN + k) / WINDOW));
+    }
+    reset();
+}
+
+void SignalAnalyzer::setSampleRate(double rate) {
+    if (rate > 0.0) sampleRate = rate;
+}
+
+void SignalAnalyzer::reset() {
+    std::fill(s1, s1 + BINS, 0.0f);
+    std::fill(s2, s2 + BINS, 0.0f);
+    std::fill(binPower, binPower + BINS, 0.0f);
+    framePos = 0;
+    level = 0.0f;
+    noisePower = 0.0f;
+    carrier = false;
+    carrierFreq = 0.0f;
+    carrierLevel = 0.0f;
+}
+
+void SignalAnalyzer::process(const float* samples, size_t count) {
+    if (count == 0) return;
+    
+    float sumSquares, peak;
+    measureBlock(samples, count, sumSquares, peak);
+    float blockLevel = std::sqrt(sumSquares / count);
+    float blockSeconds = (float)(count / sampleRate);
+    float alpha = std::min(1.0f, blockSeconds / SMOOTHING_SECONDS);
+    level += (blockLevel - level) * alpha;
+    
+    goertzel(samples, count);
+    
+    float noise = std::max(noisePower, MIN_LEVEL * MIN_LEVEL);
+    Snapshot& snapshot = snapshots.write();
+    snapshot.level = level;
+    snapshot.peak = peak;
+    snapshot.noiseFloor = std::sqrt(noise);
+    snapshot.snrDb = std::max(0.0f, 10.0f * std::log10(std::max(level * level, MIN_LEVEL * MIN_LEVEL) / noise));
+    snapshot.carrier = carrier;
+    snapshot.carrierFreq = carrierFreq;
+    snapshot.carrierLevel = carrierLevel;
+    snapshots.publish();
+}
+
+void SignalAnalyzer::goertzel(const float* samples, size_t count) {
+    size_t pos = 0;
+    while (pos < count) {
+        // Up to the end of the current frame. Bins are the outer loop so
+        // each group's state stays in registers across the samples.
+        size_t chunk = std::min(count - pos, (size_t)(WINDOW - framePos));
+        const float* x = samples + pos;
+        const float* w = window + framePos;
+        
+        for (int k = 0; k < BINS; k += 4) {
+#if defined(ANALYZER_SSE)
+            __m128 c = _mm_load_ps(coeffs + k);
+            __m128 a = _mm_load_ps(s1 + k);
+            __m128 b = _mm_load_ps(s2 + k);
+            for (size_t n = 0; n < chunk; n++) {
+                __m128 s0 = _mm_sub_ps(_mm_add_ps(_mm_set1_ps(x[n] * w[n]), _mm_mul_ps(c, a)), b);
+                b = a;
+                a = s0;
+            }
+            _mm_store_ps(s1 + k, a);
+            _mm_store_ps(s2 + k, b);
+#elif defined(ANALYZER_NEON)
+            float32x4_t c = vld1q_f32(coeffs + k);
+            float32x4_t a = vld1q_f32(s1 + k);
+            float32x4_t b = vld1q_f32(s2 + k);
+            for (size_t n = 0; n < chunk; n++) {
+                float32x4_t s0 = vsubq_f32(vmlaq_f32(vdupq_n_f32(x[n] * w[n]), c, a), b);
+                b = a;
+                a = s0;
+            }
+            vst1q_f32(s1 + k, a);
+            vst1q_f32(s2 + k, b);
+#else
+            for (int j = k; j < k + 4; j++) {
+                float a = s1[j], b = s2[j];
+                for (size_t n = 0; n < chunk; n++) {
+                    float s0 = x[n] * w[n] + coeffs[j] * a - b;
+                    b = a;
+                    a = s0;
+                }
+                s1[j] = a;
+                s2[j] = b;
+            }
+#endif
+        }
+        
+        pos += chunk;
+        framePos += (int)chunk;
+        if (framePos == WINDOW) {
+            finishFrame();
+            framePos = 0;
+        }
+    }
+}
+
+void SignalAnalyzer::finishFrame() {
+    // |X|^2 per bin, scaled to a sine's amplitude squared (the Hann window halves it)
+    const float scale = 16.0f / ((float)WINDOW * WINDOW);
+    float alpha = std::min(1.0f, (float)(WINDOW / sampleRate) / SMOOTHING_SECONDS);
+    for (int k = 0; k < BINS; k++) {
+        float power = (s1[k] * s1[k] + s2[k] * s2[k] - coeffs[k] * s1[k] * s2[k]) * scale;
+        binPower[k] += (power - binPower[k]) * alpha;
+        s1[k] = 0.0f;
+        s2[k] = 0.0f;
+    }
+    
+    int strongest = (int)(std::max_element(binPower, binPower + BINS) - binPower);
+    float sorted[BINS];
+    std::copy(binPower, binPower + BINS, sorted);
+    std::nth_element(sorted, sorted + BINS / 2, sorted + BINS);
+    float median = std::max(sorted[BINS / 2], MIN_CARRIER_POWER * 1e-3f);
+    
+    // A Hann-windowed bin of white noise with variance v reads 6v / WINDOW.
+    // After smoothing the median bin is close to the mean, and the bank
+    // covers BINS of the WINDOW / 2 bins up to Nyquist.
+    noisePower = sorted[BINS / 2] * BINS / 3.0f;
+    
+    float ratioDb = 10.0f * std::log10(std::max(binPower[strongest], 1e-20f) / median);
+    float threshold = carrier ? CARRIER_THRESHOLD_DB - CARRIER_HYSTERESIS_DB : CARRIER_THRESHOLD_DB;
+    carrier = ratioDb > threshold && binPower[strongest] > MIN_CARRIER_POWER;
+    if (!carrier) return;
+    
+    // parabola through the neighbouring magnitudes
+    float offset = 0.0f;
+    if (strongest > 0 && strongest < BINS - 1) {
+        float left = std::sqrt(binPower[strongest - 1]);
+        float centre = std::sqrt(binPower[strongest]);
+        float right = std::sqrt(binPower[strongest + 1]);
+        float denominator = left - 2.0f * centre + right;
+        if (denominator < 0.0f) {
+            offset = std::max(-0.5f, std::min(0.5f, 0.5f * (left - right) / denominator));
+        }
+    }
+    carrierFreq = (float)((FIRST_BIN + strongest + offset) * sampleRate / WINDOW);
+    carrierLevel = std::sqrt(binPower[strongest]);
+}
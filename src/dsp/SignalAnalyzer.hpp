@@ -0,0 +1,67 @@
+#pragma once
+#include <cstddef>
+#include "TripleBuffer.hpp"
+
+// Signal level, SNR and carrier detection for one receiver's audio.
+//
+// Runs once per decoded packet on the thread that delivers audio, never per
+// sample. A bank of Goertzel filters covers the audio band, four bins per
+// SIMD instruction. The median bin is taken as the noise floor, which a few
+// carriers can't move, and gives the noise power across the bank. Level is
+// the smoothed RMS of the packets, so SNR is (signal + noise) / noise. A bin
+// that stands CARRIER_THRESHOLD_DB over the median is a carrier, and its
+// frequency is refined between bins.
+//
+// Results go out as one snapshot through a triple buffer, so a reader on
+// another thread always sees a consistent set and never waits on the writer.
+class SignalAnalyzer {
+public:
+    static constexpr int BINS = 32;                 // Goertzel bins, a multiple of 4
+    static constexpr int FIRST_BIN = 3;             // skips DC and hum, ~280 Hz at 12 kHz
+    static constexpr int WINDOW = 128;              // samples per Goertzel frame, ~94 Hz bins
+    static constexpr float SMOOTHING_SECONDS = 0.3f;
+    static constexpr float CARRIER_THRESHOLD_DB = 12.0f;
+    static constexpr float CARRIER_HYSTERESIS_DB = 3.0f;
+    
+    struct Snapshot {
+        float level = 0.0f;        // RMS, smoothed
+        float peak = 0.0f;         // largest sample of the last packet
+        float noiseFloor = 0.0f;   // RMS across the bank
+        float snrDb = 0.0f;
+        bool carrier = false;
+        float carrierFreq = 0.0f;  // Hz, only meaningful while carrier is set
+        float carrierLevel = 0.0f; // amplitude of the carrier
+    };
+    
+    SignalAnalyzer();
+    
+    // Writer side
+    void setSampleRate(double rate);
+    void process(const float* samples, size_t count);
+    void reset();
+    
+    // Reader side, as TripleBuffer: update() then read()
+    bool update() { return snapshots.update(); }
+    const Snapshot& read() const { return snapshots.read(); }
+
+private:
+    double sampleRate = 12000.0;
+    
+    float window[WINDOW];     // Hann
+    alignas(16) float coeffs[BINS];  // 2 cos(w) per bin
+    alignas(16) float s1[BINS];
+    alignas(16) float s2[BINS];
+    float binPower[BINS];     // smoothed, amplitude squared
+    int framePos = 0;
+    
+    float level = 0.0f;
+    float noisePower = 0.0f;
+    bool carrier = false;
+    float carrierFreq = 0.0f;
+    float carrierLevel = 0.0f;
+    
+    TripleBuffer<Snapshot> snapshots;
+    
+    void goertzel(const float* samples, size_t count);
+    void finishFrame();
+};
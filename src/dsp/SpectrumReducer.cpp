@@ -0,0 +1,96 @@
+#include "SpectrumReducer.hpp"
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE__) || defined(_M_X64)
+    #include <xmmintrin.h>
+    #define REDUCER_SSE 1
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    #include <arm_neon.h>
+    #define REDUCER_NEON 1
+#endif
+
+constexpr int SpectrumReducer::MAX_BANDS;
+constexpr float SpectrumReducer::PEAK_DECAY;
+
+// Sum and largest value of groups * 4 floats
+static inline void reduceBand(const float* x, int groups, float& sum, float& peak) {
+#if defined(REDUCER_SSE)
+    __m128 acc = _mm_loadu_ps(x);
+    __m128 top = acc;
+    for (int g = 1; g < groups; g++) {
+        __m128 v = _mm_loadu_ps(x + 4 * g);
+        acc = _mm_add_ps(acc, v);
+        top = _mm_max_ps(top, v);
+    }
+    float lanes[4];
+    _mm_storeu_ps(lanes, acc);
+    sum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+    _mm_storeu_ps(lanes, top);
+    peak = std::max(std::max(lanes[0], lanes[1]), std::max(lanes[2], lanes[3]));
+#elif defined(REDUCER_NEON)
+    float32x4_t acc = vld1q_f32(x);
+    float32x4_t top = acc;
+    for (int g = 1; g < groups; g++) {
+        float32x4_t v = vld1q_f32(x + 4 * g);
+        acc = vaddq_f32(acc, v);
+        top = vmaxq_f32(top, v);
+    }
+    float lanes[4];
+    vst1q_f32(lanes, acc);
+    sum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+    vst1q_f32(lanes, top);
+    peak = std::max(std::max(lanes[0], lanes[1]), std::max(lanes[2], lanes[3]));
+#else
+    float lanes[4] = {x[0], x[1], x[2], x[3]};
+    float tops[4] = {x[0], x[1], x[2], x[3]};
+    for (int g = 1; g < groups; g++) {
+        for (int j = 0; j < 4; j++) {
+            lanes[j] += x[4 * g + j];
+            tops[j] = std::max(tops[j], x[4 * g + j]);
+        }
+    }
+    sum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+    peak = std::max(std::max(tops[0], tops[1]), std::max(tops[2], tops[3]));
+#endif
+}
+
+void SpectrumReducer::configure(int bins, int bands, int mapping) {
+    this->bins = bins;
+    this->bands = std::max(1, std::min(bands, std::min(MAX_BANDS, bins / 4)));
+    this->mapping = mapping;
+    
+    const int groups = bins / 4;
+    edges[0] = 0;
+    for (int i = 1; i <= this->bands; i++) {
+        float position = (float)i / this->bands;
+        int group;
+        if (mapping == LOG) {
+            // first band is one group wide, the rest grow geometrically
+            group = (int)std::round(std::pow((float)groups, position));
+        } else {
+            group = (int)std::round(position * groups);
+        }
+        // at least one group per band, and leave room for the bands after
+        group = std::max(group, edges[i - 1] / 4 + 1);
+        group = std::min(group, groups - (this->bands - i));
+        edges[i] = group * 4;
+    }
+    
+    std::fill(bandLevels, bandLevels + MAX_BANDS, 0.0f);
+}
+
+void SpectrumReducer::process(const float* spectrum) {
+    for (int i = 0; i < bands; i++) {
+        int groups = (edges[i + 1] - edges[i]) / 4;
+        float sum, peak;
+        reduceBand(spectrum + edges[i], groups, sum, peak);
+        
+        if (mapping == PEAK_HOLD) {
+            // hold the peak, letting it fall back slowly between lines
+            bandLevels[i] = std::max(peak, bandLevels[i] * PEAK_DECAY);
+        } else {
+            bandLevels[i] = sum / (groups * 4);
+        }
+    }
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+// Reduces a server waterfall line to a few bands, one per output channel.
+//
+// Band edges fall on multiples of four bins so each band is whole SIMD
+// groups: averaging is a vector sum and peak hold a vector max, with one
+// horizontal step per band. LINEAR splits the line into equal bands, LOG
+// widens them geometrically from one group at the bottom, and PEAK_HOLD
+// uses equal bands but keeps each band's loudest bin, decaying by
+// PEAK_DECAY per line when nothing louder arrives.
+//
+// Edges are only worked out again when the band count or mapping changes.
+class SpectrumReducer {
+public:
+    enum Mapping {
+        LINEAR,
+        LOG,
+        PEAK_HOLD,
+        NUM_MAPPINGS
+    };
+    
+    static constexpr int MAX_BANDS = 16;
+    static constexpr float PEAK_DECAY = 0.9f;  // per line
+    
+    // bins is the length of each line, a multiple of 4 and at least 4 * bands
+    void configure(int bins, int bands, int mapping);
+    
+    int getBands() const { return bands; }
+    int getMapping() const { return mapping; }
+    int bandStart(int band) const { return edges[band]; }
+    int bandEnd(int band) const { return edges[band + 1]; }
+    
+    // One line of bins values, 0..1. Levels come out 0..1, one per band.
+    void process(const float* spectrum);
+    const float* levels() const { return bandLevels; }
+
+private:
+    int bins = 0;
+    int bands = 0;
+    int mapping = LINEAR;
+    int edges[MAX_BANDS + 1] = {};
+    float bandLevels[MAX_BANDS] = {};
+};
@@ -0,0 +1,129 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstring>
+#include <vector>
+
+// Wait-free single-producer/single-consumer ring buffer.
+// Exactly one thread may push and exactly one other thread may pop/peek/discard.
+// Neither side ever locks, allocates, or makes a syscall, so it is safe to use
+// between the network receive thread and Rack's audio thread.
+//
+// Capacity is rounded up to a power of two so indices wrap with a mask.
+// Indices are free-running counters; size is always write - read.
+template <typename T>
+class SpscRingBuffer {
+public:
+    explicit SpscRingBuffer(size_t minCapacity = 1024) {
+        allocate(minCapacity);
+    }
+
+    // (Re)allocate storage. Not thread-safe: only call while neither side is active.
+    void allocate(size_t minCapacity) {
+        size_t cap = 1;
+        while (cap < minCapacity) cap <<= 1;
+        buffer.assign(cap, T());
+        mask = cap - 1;
+        writeIndex.store(0, std::memory_order_relaxed);
+        readIndex.store(0, std::memory_order_relaxed);
+        cachedRead = 0;
+        cachedWrite = 0;
+    }
+
+    size_t capacity() const { return mask + 1; }
+
+    // Number of readable items. Exact from the consumer side, a lower bound from the producer side.
+    size_t size() const {
+        return writeIndex.load(std::memory_order_acquire) - readIndex.load(std::memory_order_acquire);
+    }
+
+    bool empty() const { return size() == 0; }
+
+    // Producer: copy up to count items in. Returns how many fit; the rest are dropped.
+    size_t push(const T* src, size_t count) {
+        size_t w = writeIndex.load(std::memory_order_relaxed);
+        size_t space = capacity() - (w - cachedRead);
+        if (space < count) {
+            cachedRead = readIndex.load(std::memory_order_acquire);
+            space = capacity() - (w - cachedRead);
+        }
+        if (count > space) count = space;
+        if (count == 0) return 0;
+
+        size_t start = w & mask;
+        size_t first = std::min(count, capacity() - start);
+        std::memcpy(&buffer[start], src, first * sizeof(T));
+        if (count > first) {
+            std::memcpy(&buffer[0], src + first, (count - first) * sizeof(T));
+        }
+        writeIndex.store(w + count, std::memory_order_release);
+        return count;
+    }
+
+    // Consumer: copy up to count items out. Returns how many were available.
+    size_t pop(T* dst, size_t count) {
+        size_t r = readIndex.load(std::memory_order_relaxed);
+        size_t avail = cachedWrite - r;
+        if (avail < count) {
+            cachedWrite = writeIndex.load(std::memory_order_acquire);
+            avail = cachedWrite - r;
+        }
+        if (count > avail) count = avail;
+        if (count == 0) return 0;
+
+        size_t start = r & mask;
+        size_t first = std::min(count, capacity() - start);
+        std::memcpy(dst, &buffer[start], first * sizeof(T));
+        if (count > first) {
+            std::memcpy(dst + first, &buffer[0], (count - first) * sizeof(T));
+        }
+        readIndex.store(r + count, std::memory_order_release);
+        return count;
+    }
+
+    // Consumer: read the oldest item without removing it.
+    bool peek(T& out) {
+        size_t r = readIndex.load(std::memory_order_relaxed);
+        if (cachedWrite == r) {
+            cachedWrite = writeIndex.load(std::memory_order_acquire);
+            if (cachedWrite == r) return false;
+        }
+        out = buffer[r & mask];
+        return true;
+    }
+
+    // Consumer: drop up to count of the oldest items. Returns how many were dropped.
+    size_t discard(size_t count) {
+        size_t r = readIndex.load(std::memory_order_relaxed);
+        cachedWrite = writeIndex.load(std::memory_order_acquire);
+        size_t avail = cachedWrite - r;
+        if (count > avail) count = avail;
+        readIndex.store(r + count, std::memory_order_release);
+        return count;
+    }
+
+    // Consumer: drop everything currently readable.
+    void clear() {
+        cachedWrite = writeIndex.load(std::memory_order_acquire);
+        readIndex.store(cachedWrite, std::memory_order_release);
+    }
+
+private:
+    static constexpr size_t CACHE_LINE = 64;
+
+    std::vector<T> buffer;
+    size_t mask = 0;
+
+    // Producer-owned fields, then consumer-owned ones, a full line of
+    // padding apart so each side's stores never land on the other's line.
+    // Padding rather than alignas: an over-aligned member would over-align
+    // every module holding a ring, which plain new ignores before C++17.
+    std::atomic<size_t> writeIndex{0};
+    size_t cachedRead = 0;  // producer's last view of readIndex
+    char producerPad[CACHE_LINE];
+
+    std::atomic<size_t> readIndex{0};
+    size_t cachedWrite = 0;  // consumer's last view of writeIndex
+    char consumerPad[CACHE_LINE];
+};
@@ -0,0 +1,45 @@
+#pragma once
+#include <atomic>
+
+// Lock-free triple buffer for handing the latest complete result from one
+// writer thread to one reader thread (e.g. a worker to the UI).
+//
+// The writer fills write() and calls publish(); the reader calls update()
+// and then reads read(). Each side owns one buffer outright and they swap
+// through the third, so the reader never sees a half-written result and
+// the writer never waits. Intermediate results the reader misses are dropped.
+template <typename T>
+class TripleBuffer {
+public:
+    // Writer side
+    T& write() {
+        return buffers[backIndex];
+    }
+    
+    void publish() {
+        int previous = middle.exchange(backIndex | DIRTY, std::memory_order_acq_rel);
+        backIndex = previous & INDEX_MASK;
+    }
+    
+    // Reader side: switch to the newest published buffer. Returns false if
+    // nothing new arrived since the last call.
+    bool update() {
+        if (!(middle.load(std::memory_order_relaxed) & DIRTY)) return false;
+        int previous = middle.exchange(frontIndex, std::memory_order_acq_rel);
+        frontIndex = previous & INDEX_MASK;
+        return true;
+    }
+    
+    const T& read() const {
+        return buffers[frontIndex];
+    }
+
+private:
+    static const int INDEX_MASK = 3;
+    static const int DIRTY = 4;
+    
+    T buffers[3] = {};
+    int backIndex = 0;
+    int frontIndex = 1;
+    std::atomic<int> middle{2};
+};
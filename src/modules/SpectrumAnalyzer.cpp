@@ -1,5 +1,13 @@
 #include "../plugin.hpp"
+#include "../dsp/SpscRingBuffer.hpp"
+#include "../dsp/TripleBuffer.hpp"
+#include <atomic>
+#include <chrono>
 #include <cmath>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
 
 struct SpectrumAnalyzerModule : Module {
     enum ParamId {
@@ -19,29 +27,322 @@ struct SpectrumAnalyzerModule : Module {
         NUM_LIGHTS
     };
     
-    static constexpr int FFT_SIZE = 128;
-    float spectrum[FFT_SIZE] = {};
+    enum WindowType {
+        WINDOW_HANN,
+        WINDOW_BLACKMAN,
+        NUM_WINDOWS
+    };
+    
+    // FFT sizes are powers of two from 256 to 8192
+    static constexpr int MIN_FFT_SIZE = 256;
+    static constexpr int MAX_FFT_SIZE = 8192;
+    static constexpr int NUM_FFT_SIZES = 6;
+    static constexpr int MAX_BINS = MAX_FFT_SIZE / 2;
+    static constexpr float MIN_DB = -100.0f;
+    
+    // Settings, changed from the context menu and picked up by the worker
+    std::atomic<int> fftSize{2048};
+    std::atomic<int> windowType{WINDOW_HANN};
+    std::atomic<int> overlap{2};  // frames per FFT length: 1 = none, 2 = 50%, 4 = 75%
+    
+    // Log-magnitude spectrum in dB, one value per FFT bin
+    struct Spectrum {
+        float db[MAX_BINS];
+        int numBins;
+    };
+    
+    // Worker publishes, the display reads; neither ever waits for the other
+    TripleBuffer<Spectrum> results;
     
     SpectrumAnalyzerModule() {
         config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS);
         configInput(AUDIO_INPUT, "Audio");
+        
+        // Build every plan up front so changing size only swaps pointers
+        for (int i = 0; i < NUM_FFT_SIZES; i++) {
+            ffts[i].reset(new dsp::RealFFT(MIN_FFT_SIZE << i));
+        }
+        
+        worker = std::thread(&SpectrumAnalyzerModule::workerLoop, this);
+    }
+    
+    ~SpectrumAnalyzerModule() {
+        {
+            std::lock_guard<std::mutex> lock(wakeMutex);
+            running = false;
+        }
+        wake.notify_one();
+        if (worker.joinable()) {
+            worker.join();
+        }
     }
     
     void process(const ProcessArgs& args) override {
         if (!inputs[AUDIO_INPUT].isConnected()) return;
         
+        // The audio thread only pays for a copy; a full ring drops samples
+        // rather than stalling if the worker falls behind
         float sample = inputs[AUDIO_INPUT].getVoltage() / 5.0f;
+        inputBlock[inputBlockPos++] = sample;
+        if (inputBlockPos == INPUT_BLOCK_SIZE) {
+            inputRing.push(inputBlock, INPUT_BLOCK_SIZE);
+            inputBlockPos = 0;
+        }
+    }
+    
+    // Not the audio thread: Rack adds and removes cables from the UI (or the
+    // patch loader), so this may take the lock that parks the worker
+    void onPortChange(const PortChangeEvent& e) override {
+        if (e.type != Port::INPUT || e.portId != AUDIO_INPUT) return;
+        {
+            std::lock_guard<std::mutex> lock(wakeMutex);
+            patched = e.connecting;
+        }
+        wake.notify_one();
+    }
+    
+    void onSampleRateChange(const SampleRateChangeEvent& e) override {
+        sampleRate = e.sampleRate;
+    }
+    
+    void onReset() override {
+        fftSize = 2048;
+        windowType = WINDOW_HANN;
+        overlap = 2;
+    }
+    
+    void appendContextMenu(Menu* menu) {
+        menu->addChild(new MenuSeparator);
+        
+        struct FFTSizeItem : MenuItem {
+            SpectrumAnalyzerModule* module;
+            int size;
+            void onAction(const event::Action& e) override {
+                module->fftSize = size;
+            }
+        };
+        
+        menu->addChild(createSubmenuItem("FFT size", string::f("%d", fftSize.load()), [=](Menu* menu) {
+            for (int i = 0; i < NUM_FFT_SIZES; i++) {
+                FFTSizeItem* item = new FFTSizeItem;
+                item->size = MIN_FFT_SIZE << i;
+                item->text = string::f("%d", item->size);
+                item->module = this;
+                item->rightText = (fftSize == item->size) ? "✓" : "";
+                menu->addChild(item);
+            }
+        }));
+        
+        struct WindowItem : MenuItem {
+            SpectrumAnalyzerModule* module;
+            int type;
+            void onAction(const event::Action& e) override {
+                module->windowType = type;
+            }
+        };
+        
+        static const char* windowNames[NUM_WINDOWS] = {"Hann", "Blackman"};
+        menu->addChild(createSubmenuItem("Window", windowNames[windowType], [=](Menu* menu) {
+            for (int type = 0; type < NUM_WINDOWS; type++) {
+                WindowItem* item = new WindowItem;
+                item->text = windowNames[type];
+                item->module = this;
+                item->type = type;
+                item->rightText = (windowType == type) ? "✓" : "";
+                menu->addChild(item);
+            }
+        }));
+        
+        struct OverlapItem : MenuItem {
+            SpectrumAnalyzerModule* module;
+            int frames;
+            void onAction(const event::Action& e) override {
+                module->overlap = frames;
+            }
+        };
         
-        // Simple peak detection for visualization (not real FFT)
-        static int idx = 0;
-        spectrum[idx] = fabsf(sample);
-        idx = (idx + 1) % FFT_SIZE;
+        menu->addChild(createSubmenuItem("Overlap", string::f("%d%%", 100 - 100 / overlap.load()), [=](Menu* menu) {
+            for (int frames : {1, 2, 4}) {
+                OverlapItem* item = new OverlapItem;
+                item->text = string::f("%d%%", 100 - 100 / frames);
+                item->module = this;
+                item->frames = frames;
+                item->rightText = (overlap == frames) ? "✓" : "";
+                menu->addChild(item);
+            }
+        }));
+    }
+    
+    json_t* dataToJson() override {
+        json_t* rootJ = json_object();
+        json_object_set_new(rootJ, "fftSize", json_integer(fftSize.load()));
+        json_object_set_new(rootJ, "window", json_integer(windowType.load()));
+        json_object_set_new(rootJ, "overlap", json_integer(overlap.load()));
+        return rootJ;
+    }
+    
+    void dataFromJson(json_t* rootJ) override {
+        json_t* fftSizeJ = json_object_get(rootJ, "fftSize");
+        if (fftSizeJ) {
+            int size = (int)json_integer_value(fftSizeJ);
+            // Only powers of two in range
+            if (size >= MIN_FFT_SIZE && size <= MAX_FFT_SIZE && (size & (size - 1)) == 0) {
+                fftSize = size;
+            }
+        }
+        
+        json_t* windowJ = json_object_get(rootJ, "window");
+        if (windowJ) windowType = clamp((int)json_integer_value(windowJ), 0, NUM_WINDOWS - 1);
+        
+        json_t* overlapJ = json_object_get(rootJ, "overlap");
+        if (overlapJ) {
+            int frames = (int)json_integer_value(overlapJ);
+            if (frames == 1 || frames == 2 || frames == 4) overlap = frames;
+        }
+    }
+
+private:
+    static constexpr int INPUT_BLOCK_SIZE = 32;
+    static constexpr int WORKER_CHUNK = 256;
+    
+    // audio thread -> worker
+    SpscRingBuffer<float> inputRing{4 * MAX_FFT_SIZE};
+    float inputBlock[INPUT_BLOCK_SIZE] = {};
+    int inputBlockPos = 0;
+    
+    std::thread worker;
+    std::atomic<bool> running{true};
+    
+    // The worker parks on wake while the input is unpatched, and otherwise
+    // sleeps until the next hop is due; process() never touches either
+    std::mutex wakeMutex;
+    std::condition_variable wake;
+    bool patched = false;  // guarded by wakeMutex
+    std::atomic<float> sampleRate{44100.0f};
+    
+    // Everything below belongs to the worker thread
+    std::unique_ptr<dsp::RealFFT> ffts[NUM_FFT_SIZES];
+    int activeSize = 0;
+    int activeWindow = -1;
+    dsp::RealFFT* fft = nullptr;
+    
+    float history[2 * MAX_FFT_SIZE] = {};
+    int historyPos = 0;
+    int hopCounter = 0;
+    
+    float window[MAX_FFT_SIZE];
+    float windowNorm = 1.0f;
+    alignas(16) float frame[MAX_FFT_SIZE];
+    alignas(16) float freqData[MAX_FFT_SIZE];
+    
+    void workerLoop() {
+        float chunk[WORKER_CHUNK];
+        
+        while (running) {
+            size_t count = inputRing.pop(chunk, WORKER_CHUNK);
+            if (count == 0) {
+                std::unique_lock<std::mutex> lock(wakeMutex);
+                if (!patched) {
+                    wake.wait(lock, [this]() { return !running || patched; });
+                } else {
+                    // Nothing to do before the rest of the hop has arrived
+                    int remaining = std::max(INPUT_BLOCK_SIZE, hopSize() - hopCounter);
+                    std::chrono::microseconds due((long long)(1e6 * remaining / sampleRate.load()));
+                    wake.wait_for(lock, due, [this]() { return !running || !patched; });
+                }
+                continue;
+            }
+            
+            if (fftSize != activeSize || windowType != activeWindow) {
+                configure();
+            }
+            
+            int hop = hopSize();
+            for (size_t i = 0; i < count; i++) {
+                // History is written twice so the last activeSize samples are always contiguous
+                history[historyPos] = chunk[i];
+                history[historyPos + MAX_FFT_SIZE] = chunk[i];
+                if (++historyPos == MAX_FFT_SIZE) historyPos = 0;
+                
+                // A new frame every hop
+                if (++hopCounter >= hop) {
+                    hopCounter = 0;
+                    computeSpectrum();
+                }
+            }
+        }
+    }
+    
+    int hopSize() const {
+        int size = activeSize ? activeSize : fftSize.load();  // before the first chunk
+        return std::max(1, size / std::max(1, overlap.load()));
+    }
+    
+    void configure() {
+        activeSize = fftSize;
+        activeWindow = windowType;
+        
+        int sizeIndex = 0;
+        while ((MIN_FFT_SIZE << sizeIndex) < activeSize && sizeIndex < NUM_FFT_SIZES - 1) sizeIndex++;
+        fft = ffts[sizeIndex].get();
+        
+        for (int i = 0; i < activeSize; i++) {
+            window[i] = 1.0f;
+        }
+        if (activeWindow == WINDOW_BLACKMAN) {
+            dsp::blackmanWindow(window, activeSize);
+        } else {
+            dsp::hannWindow(window, activeSize);
+        }
+        
+        // Scale so a full-scale sine reads 0 dB whatever the window
+        float sum = 0.0f;
+        for (int i = 0; i < activeSize; i++) {
+            sum += window[i];
+        }
+        windowNorm = 2.0f / sum;
+        
+        hopCounter = 0;
+    }
+    
+    void computeSpectrum() {
+        const float* input = history + historyPos + MAX_FFT_SIZE - activeSize;
+        for (int i = 0; i < activeSize; i++) {
+            frame[i] = input[i] * window[i];
+        }
+        
+        // Ordered output: [DC, Nyquist, re1, im1, re2, im2, ...]
+        fft->rfft(frame, freqData);
+        
+        Spectrum& spectrum = results.write();
+        spectrum.numBins = activeSize / 2;
+        
+        const float minPower = dsp::dbToAmplitude(MIN_DB) * dsp::dbToAmplitude(MIN_DB);
+        float norm2 = windowNorm * windowNorm;
+        spectrum.db[0] = 10.0f * std::log10(std::max(freqData[0] * freqData[0] * norm2 * 0.25f, minPower));
+        for (int k = 1; k < spectrum.numBins; k++) {
+            float re = freqData[2 * k];
+            float im = freqData[2 * k + 1];
+            float power = (re * re + im * im) * norm2;
+            spectrum.db[k] = 10.0f * std::log10(std::max(power, minPower));
+        }
+        results.publish();
     }
 };
 
+constexpr int SpectrumAnalyzerModule::MIN_FFT_SIZE;
+constexpr int SpectrumAnalyzerModule::MAX_FFT_SIZE;
+constexpr int SpectrumAnalyzerModule::NUM_FFT_SIZES;
+constexpr int SpectrumAnalyzerModule::MAX_BINS;
+constexpr float SpectrumAnalyzerModule::MIN_DB;
+constexpr int SpectrumAnalyzerModule::INPUT_BLOCK_SIZE;
+constexpr int SpectrumAnalyzerModule::WORKER_CHUNK;
+
 struct SpectrumDisplay : Widget {
     SpectrumAnalyzerModule* module;
     
+    static constexpr int NUM_BARS = 128;
+    
     void draw(const DrawArgs& args) override {
         if (!module) return;
         
@@ -50,10 +351,24 @@ struct SpectrumDisplay : Widget {
         nvgFillColor(args.vg, nvgRGB(10, 10, 10));
         nvgFill(args.vg);
         
-        // Draw spectrum bars
-        float barWidth = box.size.x / SpectrumAnalyzerModule::FFT_SIZE;
-        for (int i = 0; i < SpectrumAnalyzerModule::FFT_SIZE; i++) {
-            float height = module->spectrum[i] * box.size.y;
+        // Pick up the newest finished spectrum, if any
+        module->results.update();
+        const SpectrumAnalyzerModule::Spectrum& spectrum = module->results.read();
+        int numBins = spectrum.numBins;
+        if (numBins <= 0) return;
+        
+        // Draw spectrum bars, each showing the loudest FFT bin it covers
+        float barWidth = box.size.x / NUM_BARS;
+        for (int i = 0; i < NUM_BARS; i++) {
+            int first = i * numBins / NUM_BARS;
+            int last = std::max(first + 1, (i + 1) * numBins / NUM_BARS);
+            float db = SpectrumAnalyzerModule::MIN_DB;
+            for (int k = first; k < last; k++) {
+                db = std::max(db, spectrum.db[k]);
+            }
+            
+            float level = clamp(1.0f - db / SpectrumAnalyzerModule::MIN_DB, 0.0f, 1.0f);
+            float height = level * box.size.y;
             
             nvgBeginPath(args.vg);
             nvgRect(args.vg, i * barWidth, box.size.y - height, barWidth - 1, height);
@@ -83,6 +398,11 @@ struct SpectrumAnalyzerWidget : ModuleWidget {
         // Audio input
         addInput(createInputCentered<PJ301MPort>(Vec(90, 320), module, SpectrumAnalyzerModule::AUDIO_INPUT));
     }
+    
+    void appendContextMenu(Menu* menu) override {
+        SpectrumAnalyzerModule* module = dynamic_cast<SpectrumAnalyzerModule*>(this->module);
+        if (module) module->appendContextMenu(menu);
+    }
 };
 
-Model* modelSpectrumAnalyzer = createModel<SpectrumAnalyzerModule, SpectrumAnalyzerWidget>("SpectrumAnalyzer");
\ No newline at end of file
+Model* modelSpectrumAnalyzer = createModel<SpectrumAnalyzerModule, SpectrumAnalyzerWidget>("SpectrumAnalyzer");
@@ -0,0 +1,403 @@
+#include "StationDatabase.hpp"
+#include "../network/AsyncLog.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <sstream>
+#include <unordered_map>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+    #define WIN32_LEAN_AND_MEAN
+    #define NOMINMAX
+    #include <windows.h>
+#else
+    #include <sys/mman.h>
+    #include <fcntl.h>
+    #include <unistd.h>
+#endif
+
+// Binary cache layout. The file is a local cache written and read on the
+// same machine, so fields are in host byte order.
+//   header:  "WSDB", version, station count, string bytes   (4 x uint32)
+//   records: freq (Hz), name, time, mode offsets, categories (5 x uint32 each)
+//   strings: NUL-terminated, referenced by offset
+static const char BINARY_MAGIC[4] = {'W', 'S', 'D', 'B'};
+static const uint32_t BINARY_VERSION = 1;
+static const size_t HEADER_SIZE = 16;
+static const size_t RECORD_SIZE = 20;
+
+struct StationDatabase::MappedFile {
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = NULL;
+#endif
+    
+    bool open(const std::string& path) {
+#ifdef _WIN32
+        file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (file == INVALID_HANDLE_VALUE) return false;
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) return false;
+        mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (!mapping) return false;
+        data = (const uint8_t*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        size = (size_t)fileSize.QuadPart;
+        return data != nullptr;
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        struct stat info;
+        if (fstat(fd, &info) != 0 || info.st_size == 0) {
+            ::close(fd);
+            return false;
+        }
+        void* mapped = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);  // the mapping keeps the file open
+        if (mapped == MAP_FAILED) return false;
+        data = (const uint8_t*)mapped;
+        size = (size_t)info.st_size;
+        return true;
+#endif
+    }
+    
+    ~MappedFile() {
+#ifdef _WIN32
+        if (data) UnmapViewOfFile(data);
+        if (mapping) CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+#else
+        if (data) munmap((void*)data, size);
+#endif
+    }
+};
+
+constexpr int StationDatabase::SLOT_MINUTES;
+constexpr int StationDatabase::SLOTS_PER_DAY;
+
+StationDatabase::StationDatabase() {}
+
+StationDatabase::~StationDatabase() {}
+
+void StationDatabase::addBuiltInStations() {
+    int base = size();
+    for (int i = 0; i < NUM_STATIONS; i++) {
+        append(STATIONS[i], categorize(STATIONS[i].name));
+    }
+    for (size_t i = 0; i < sizeof(FAVORITES) / sizeof(FAVORITES[0]); i++) {
+        if (FAVORITES[i] < NUM_STATIONS) {
+            categories[base + FAVORITES[i]] |= CATEGORY_FAVORITE;
+        }
+    }
+    rebuildIndex();
+}
+
+void StationDatabase::add(const Station& station, uint32_t stationCategories) {
+    append(station, stationCategories);
+    rebuildIndex();
+}
+
+// Leaves byFrequency alone: every public way in appends, then rebuilds the
+// index once before returning
+void StationDatabase::append(const Station& station, uint32_t stationCategories) {
+    stations.push_back(station);
+    categories.push_back(stationCategories);
+    schedules.push_back(parseSchedule(station.time));
+}
+
+void StationDatabase::truncate(int count) {
+    stations.resize(count);
+    categories.resize(count);
+    schedules.resize(count);
+}
+
+void StationDatabase::rebuildIndex() {
+    byFrequency.resize(stations.size());
+    for (size_t i = 0; i < byFrequency.size(); i++) {
+        byFrequency[i] = (int)i;
+    }
+    std::stable_sort(byFrequency.begin(), byFrequency.end(), [this](int a, int b) {
+        return stations[a].freq < stations[b].freq;
+    });
+}
+
+const char* StationDatabase::intern(const std::string& text) {
+    // deque never moves its elements, so the pointer stays valid
+    strings.push_back(text);
+    return strings.back().c_str();
+}
+
+int StationDatabase::findNearest(float freq, float maxDiff) const {
+    if (byFrequency.empty()) return -1;
+    
+    // First station at or above freq; the nearest is it or the one below
+    auto it = std::lower_bound(byFrequency.begin(), byFrequency.end(), freq,
+        [this](int index, float f) { return stations[index].freq < f; });
+    
+    int nearest = -1;
+    float minDiff = maxDiff;
+    if (it != byFrequency.end()) {
+        float diff = stations[*it].freq - freq;
+        if (diff < minDiff) {
+            minDiff = diff;
+            nearest = *it;
+        }
+    }
+    if (it != byFrequency.begin()) {
+        float diff = freq - stations[*(it - 1)].freq;
+        if (diff < minDiff) {
+            nearest = *(it - 1);
+        }
+    }
+    return nearest;
+}
+
+void StationDatabase::filter(uint32_t mask, std::vector<int>& out) const {
+    out.clear();
+    for (int i = 0; i < size(); i++) {
+        if (mask == CATEGORY_ALL || (categories[i] & mask)) {
+            out.push_back(i);
+        }
+    }
+}
+
+uint32_t StationDatabase::categorize(const char* name) {
+    std::string lower(name);
+    std::transform(lower.begin(), lower.end(), lower.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+    auto has = [&](const char* word) { return lower.find(word) != std::string::npos; };
+    
+    uint32_t result = 0;
+    if (has("wwv") || has("chv")) result |= CATEGORY_TIME;
+    if (has("bbc") || has("voa") || has("rhc") || has("cri")) result |= CATEGORY_BROADCAST;
+    if (has("ssb") || has("ft8")) result |= CATEGORY_AMATEUR;
+    if (has("uvb") || has("hfgcs") || has("pirate")) result |= CATEGORY_MYSTERY;
+    if (has("aviation") || has("volmet") || has("weather fax")) result |= CATEGORY_UTILITY;
+    return result;
+}
+
+int StationDatabase::importEiBi(const std::string& path) {
+    std::ifstream file(path);
+    if (!file) return 0;
+    
+    // kHz;Time(UTC);Days;ITU;Station;Lng;Target;Remarks;P;Start;Stop;
+    int added = 0;
+    std::string line;
+    while (std::getline(file, line)) {
+        std::vector<std::string> fields;
+        std::stringstream ss(line);
+        std::string field;
+        while (std::getline(ss, field, ';')) {
+            fields.push_back(field);
+        }
+        if (fields.size() < 5) continue;
+        
+        // skips the header line too
+        char* end = nullptr;
+        double khz = strtod(fields[0].c_str(), &end);
+        if (end == fields[0].c_str() || khz <= 0.0) continue;
+        
+        std::string name = fields[4];
+        name.erase(name.find_last_not_of(" \t\r") + 1);
+        if (name.empty()) continue;
+        
+        Station station;
+        station.freq = (float)(khz * 1000.0);
+        station.name = intern(name);
+        station.time = intern(fields[1]);
+        station.mode = "am";
+        
+        // it's a broadcast schedule, so anything unrecognised is a broadcaster
+        uint32_t stationCategories = categorize(station.name);
+        append(station, stationCategories ? stationCategories : (uint32_t)CATEGORY_BROADCAST);
+        added++;
+    }
+    
+    rebuildIndex();
+    return added;
+}
+
+bool StationDatabase::saveBinary(const std::string& path, int first) const {
+    std::string stringData;
+    std::vector<uint32_t> records;
+    
+    // identical strings (mode names, common times, repeated names) are stored once
+    std::unordered_map<std::string, uint32_t> offsets;
+    auto addString = [&](const char* text) -> uint32_t {
+        auto found = offsets.find(text);
+        if (found != offsets.end()) return found->second;
+        uint32_t offset = (uint32_t)stringData.size();
+        stringData.append(text);
+        stringData.push_back('\0');
+        offsets[text] = offset;
+        return offset;
+    };
+    
+    for (int i = std::max(first, 0); i < size(); i++) {
+        const Station& station = stations[i];
+        records.push_back((uint32_t)std::lround(station.freq));
+        records.push_back(addString(station.name));
+        records.push_back(addString(station.time));
+        records.push_back(addString(station.mode));
+        records.push_back(categories[i]);
+    }
+    
+    FILE* file = fopen(path.c_str(), "wb");
+    if (!file) return false;
+    
+    uint32_t header[3] = {BINARY_VERSION, (uint32_t)(records.size() / 5), (uint32_t)stringData.size()};
+    bool ok = fwrite(BINARY_MAGIC, 1, 4, file) == 4
+        && fwrite(header, sizeof(header), 1, file) == 1
+        && (records.empty() || fwrite(records.data(), sizeof(uint32_t), records.size(), file) == records.size())
+        && (stringData.empty() || fwrite(stringData.data(), 1, stringData.size(), file) == stringData.size());
+    ok = (fclose(file) == 0) && ok;
+    return ok;
+}
+
+bool StationDatabase::mapBinary(const std::string& path) {
+    std::unique_ptr<MappedFile> mapped(new MappedFile);
+    if (!mapped->open(path) || mapped->size < HEADER_SIZE) return false;
+    if (memcmp(mapped->data, BINARY_MAGIC, 4) != 0) return false;
+    
+    uint32_t header[3];
+    memcpy(header, mapped->data + 4, sizeof(header));
+    uint32_t count = header[1];
+    uint32_t stringBytes = header[2];
+    if (header[0] != BINARY_VERSION) return false;
+    if (mapped->size != HEADER_SIZE + (size_t)count * RECORD_SIZE + stringBytes) return false;
+    
+    const uint8_t* recordData = mapped->data + HEADER_SIZE;
+    const char* stringData = (const char*)(recordData + (size_t)count * RECORD_SIZE);
+    // every offset must land inside the block, and the block must end in a terminator
+    if (count > 0 && (stringBytes == 0 || stringData[stringBytes - 1] != '\0')) return false;
+    
+    size_t base = stations.size();
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t record[5];
+        memcpy(record, recordData + i * RECORD_SIZE, sizeof(record));
+        if (record[1] >= stringBytes || record[2] >= stringBytes || record[3] >= stringBytes) {
+            truncate((int)base);
+            return false;
+        }
+        
+        Station station;
+        station.freq = (float)record[0];
+        station.name = stringData + record[1];
+        station.time = stringData + record[2];
+        station.mode = stringData + record[3];
+        append(station, record[4]);
+    }
+    
+    mappings.push_back(std::move(mapped));
+    rebuildIndex();
+    return true;
+}
+
+// Slots [first, last) of the day, wrapping past midnight
+static uint64_t slotRange(int first, int last) {
+    uint64_t slots = 0;
+    int i = first;
+    do {
+        slots |= 1ull << i;
+        i = (i + 1) % StationDatabase::SLOTS_PER_DAY;
+    } while (i != last);
+    return slots;
+}
+
+StationDatabase::Schedule StationDatabase::parseSchedule(const char* time) {
+    Schedule schedule;
+    
+    // EiBi style UTC range, e.g. "2230-0100"
+    int start = 0;
+    int end = 0;
+    if (time && sscanf(time, "%4d-%4d", &start, &end) == 2) {
+        int startMinute = (start / 100) * 60 + start % 100;
+        int endMinute = (end / 100) * 60 + end % 100;
+        if (startMinute >= 0 && startMinute < 1440 && endMinute >= 0 && endMinute <= 1440) {
+            // every slot the broadcast overlaps; start == end means all day
+            int first = startMinute / SLOT_MINUTES;
+            int last = (endMinute + SLOT_MINUTES - 1) / SLOT_MINUTES % SLOTS_PER_DAY;
+            schedule.utcSlots = slotRange(first, last);
+            return schedule;
+        }
+    }
+    
+    // Propagation words describe the listener's day, so they use local time
+    if (time && strcmp(time, "day") == 0) {
+        schedule.localSlots = slotRange(6 * 2, 18 * 2);
+    } else if (time && strcmp(time, "night") == 0) {
+        schedule.localSlots = slotRange(18 * 2, 6 * 2);
+    } else if (time && strcmp(time, "evening") == 0) {
+        schedule.localSlots = slotRange(17 * 2, 23 * 2);
+    } else {
+        // "24h", or nothing we understand: never filter it out
+        schedule.utcSlots = slotRange(0, 0);
+    }
+    return schedule;
+}
+
+bool StationDatabase::isOnAir(int index, int utcSlot, int localSlot) const {
+    const Schedule& schedule = schedules[index];
+    return ((schedule.utcSlots >> utcSlot) & 1) || ((schedule.localSlots >> localSlot) & 1);
+}
+
+void StationDatabase::currentSlots(int& utcSlot, int& localSlot) {
+    time_t now = std::time(nullptr);
+    struct tm utc;
+    struct tm local;
+#ifdef _WIN32
+    gmtime_s(&utc, &now);
+    localtime_s(&local, &now);
+#else
+    gmtime_r(&now, &utc);
+    localtime_r(&now, &local);
+#endif
+    utcSlot = (utc.tm_hour * 60 + utc.tm_min) / SLOT_MINUTES;
+    localSlot = (local.tm_hour * 60 + local.tm_min) / SLOT_MINUTES;
+}
+
+static bool fileTime(const std::string& path, time_t& mtime) {
+    struct stat info;
+    if (stat(path.c_str(), &info) != 0) return false;
+    mtime = info.st_mtime;
+    return true;
+}
+
+void StationDatabase::loadExternal(const std::string& schedulePath, const std::string& cachePath) {
+    time_t scheduleTime = 0;
+    time_t cacheTime = 0;
+    bool haveSchedule = fileTime(schedulePath, scheduleTime);
+    bool haveCache = fileTime(cachePath, cacheTime);
+    
+    if (haveCache && (!haveSchedule || cacheTime >= scheduleTime)) {
+        int before = size();
+        if (mapBinary(cachePath)) {
+            WEBSDR_INFO("Loaded %d stations from %s", size() - before, cachePath.c_str());
+            return;
+        }
+        WEBSDR_WARN("Ignoring unreadable station cache %s", cachePath.c_str());
+    }
+    
+    if (!haveSchedule) return;
+    
+    int first = size();
+    int added = importEiBi(schedulePath);
+    WEBSDR_INFO("Imported %d stations from %s", added, schedulePath.c_str());
+    if (added > 0 && !saveBinary(cachePath, first)) {
+        WEBSDR_WARN("Could not write station cache %s", cachePath.c_str());
+    }
+}
+
+StationDatabase& stationDatabase() {
+    struct BuiltInDatabase : StationDatabase {
+        BuiltInDatabase() { addBuiltInStations(); }
+    };
+    static BuiltInDatabase database;
+    return database;
+}
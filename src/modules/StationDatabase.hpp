@@ -0,0 +1,101 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include "stations.hpp"
+
+// All known stations: the built-in table plus any external schedule list.
+//
+// Alongside the stations it keeps an index sorted by frequency for
+// binary-search lookup and one category bitmask per station, worked out
+// once at load time, so filtering by category never touches the names.
+// The database is filled during plugin init and read-only afterwards, so
+// any thread may read it without locking.
+class StationDatabase {
+public:
+    enum Category : uint32_t {
+        CATEGORY_TIME = 1 << 0,       // time signals
+        CATEGORY_BROADCAST = 1 << 1,  // international broadcasters
+        CATEGORY_AMATEUR = 1 << 2,
+        CATEGORY_MYSTERY = 1 << 3,    // numbers stations, military, pirates
+        CATEGORY_UTILITY = 1 << 4,    // aviation, weather fax
+        CATEGORY_FAVORITE = 1 << 5,
+        CATEGORY_ALL = 0xffffffff
+    };
+    
+    // When a station is on the air, in half-hour slots of the day. EiBi
+    // ranges are UTC; "day"/"night"/"evening" follow the listener's clock.
+    static constexpr int SLOT_MINUTES = 30;
+    static constexpr int SLOTS_PER_DAY = 24 * 60 / SLOT_MINUTES;
+    struct Schedule {
+        uint64_t utcSlots = 0;
+        uint64_t localSlots = 0;
+    };
+    
+    StationDatabase();
+    ~StationDatabase();
+    
+    void addBuiltInStations();
+    void add(const Station& station, uint32_t categories);
+    
+    // Import an EiBi schedule (semicolon-separated, as published at eibispace.de).
+    // Returns the number of stations added.
+    int importEiBi(const std::string& path);
+    
+    // Compact binary cache. Mapped rather than read, so names point straight
+    // into the file and thousands of entries cost almost nothing to load.
+    bool saveBinary(const std::string& path, int first = 0) const;
+    bool mapBinary(const std::string& path);
+    
+    // Load an external list from the user folder: the binary cache if it is
+    // newer than the schedule, otherwise import the schedule and rewrite the cache
+    void loadExternal(const std::string& schedulePath, const std::string& cachePath);
+    
+    int size() const { return (int)stations.size(); }
+    const Station& get(int index) const { return stations[index]; }
+    uint32_t getCategories(int index) const { return categories[index]; }
+    
+    // Index of the station nearest to freq, or -1 if none is within maxDiff Hz
+    int findNearest(float freq, float maxDiff = 1000000.0f) const;
+    
+    // Indices of stations in any of the given categories, in table order.
+    // CATEGORY_ALL also includes stations with no category.
+    void filter(uint32_t mask, std::vector<int>& out) const;
+    
+    // Guess categories from a station's name
+    static uint32_t categorize(const char* name);
+    
+    // Parsed from Station::time once, when the station is added
+    static Schedule parseSchedule(const char* time);
+    bool isOnAir(int index, int utcSlot, int localSlot) const;
+    // Slots for the current wall-clock time
+    static void currentSlots(int& utcSlot, int& localSlot);
+
+private:
+    struct MappedFile;
+    
+    std::vector<Station> stations;
+    std::vector<uint32_t> categories;
+    std::vector<Schedule> schedules;
+    std::vector<int> byFrequency;  // station indices, ascending frequency, see rebuildIndex()
+    
+    // storage for names of imported stations and mapped caches
+    std::deque<std::string> strings;
+    std::vector<std::unique_ptr<MappedFile>> mappings;
+    
+    const char* intern(const std::string& text);
+    void append(const Station& station, uint32_t stationCategories);
+    void truncate(int count);
+    void rebuildIndex();
+};
+
+// The plugin-wide database, built-in stations included
+StationDatabase& stationDatabase();
+
+// find nearest station to frequency
+inline const Station* findNearestStation(float freq) {
+    int index = stationDatabase().findNearest(freq);
+    return (index >= 0) ? &stationDatabase().get(index) : nullptr;
+}
@@ -1,8 +1,18 @@
 // automatic station scanner module
 #include "../plugin.hpp"
-#include "stations.hpp"
+#include "StationDatabase.hpp"
+#include "../network/WebSDRClient.hpp"
+#include "../network/ServerProber.hpp"
+#include "../network/AsyncLog.hpp"
+#include "../dsp/TripleBuffer.hpp"
 #include <vector>
 #include <algorithm>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <cmath>
 
 struct StationScanner : Module {
     enum ParamId {
@@ -23,6 +33,7 @@ struct StationScanner : Module {
         FREQ_OUTPUT,
         GATE_OUTPUT,
         EOC_OUTPUT,  // end of cycle
+        BEST_OUTPUT,  // polyphonic, strongest stations of the last sweep
         NUM_OUTPUTS
     };
     
@@ -50,6 +61,75 @@ struct StationScanner : Module {
     };
     
     std::vector<int> stationList;
+    int lastMode = -1;
+    
+    // Schedule filter: the worker works out which stations are on the air
+    // and hands the result over, so process() only has to intersect it
+    struct OnAirSet {
+        std::vector<uint8_t> onAir;  // per database index
+    };
+    std::atomic<bool> scheduleFilter{true};  // set from the menu
+    bool activeScheduleFilter = true;  // audio thread's copy
+    TripleBuffer<OnAirSet> onAirSets;
+    const OnAirSet* onAir = nullptr;  // audio thread, newest set received
+    
+    // Parallel sweep: several receivers measure stations at once and the
+    // strongest ones are ranked, instead of dwelling on one at a time
+    static constexpr int MAX_RECEIVERS = 8;
+    static constexpr int MAX_BEST = 16;
+    static constexpr int MAX_SWEEP_STATIONS = 512;  // a sweep covers this much of the list at most
+    static constexpr float SETTLE_SECONDS = 0.4f;   // audio ignored after each retune
+    static constexpr float MEASURE_SECONDS = 0.5f;  // audio averaged per station
+    static constexpr float STATION_TIMEOUT = 5.0f;  // give up on a silent receiver
+    
+    // Settings, changed from the context menu and picked up by the worker
+    std::atomic<bool> parallel{false};  // set through setParallel()
+    std::atomic<int> receivers{4};
+    std::atomic<int> bestCount{8};
+    
+    struct SweepRequest {
+        int stations[MAX_SWEEP_STATIONS];
+        int count = 0;
+        float threshold = 0.0f;  // volts, see levelToVoltage()
+    };
+    
+    struct SweepResult {
+        int stations[MAX_BEST];  // station database indices, strongest first
+        float levels[MAX_BEST];
+        int count = 0;
+    };
+    
+    // audio thread <-> worker
+    TripleBuffer<SweepRequest> requests;
+    TripleBuffer<SweepResult> results;
+    std::atomic<int> sweepProgress{-1};  // stations measured so far, -1 when idle
+    
+    // audio thread's copy of the last sweep
+    int ranked[MAX_BEST] = {};
+    int rankedCount = 0;
+    int currentRank = 0;
+    bool sweepPending = false;
+    float sweepTimer = 0.0f;
+    bool swept = false;  // since parallel scan or the scan switch came on; the first sweep skips the dwell
+    
+    // What the display shows, handed over like the on-air sets: the list
+    // and the ranking are rebuilt in place on the audio thread, so the UI
+    // only ever reads this copy
+    struct DisplayState {
+        int station = -1;       // database index on FREQ_OUTPUT, -1 for none
+        int listPosition = 0;   // 1-based, in stationList
+        int listSize = 0;
+        int rank = 0;           // 1-based, in the last sweep's ranking
+        int rankedCount = 0;
+        bool parallel = false;
+        
+        bool operator!=(const DisplayState& other) const {
+            return station != other.station || listPosition != other.listPosition || listSize != other.listSize ||
+                   rank != other.rank || rankedCount != other.rankedCount || parallel != other.parallel;
+        }
+    };
+    TripleBuffer<DisplayState> displayStates;
+    DisplayState shown;  // audio thread, last one published
     
     StationScanner() {
         config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS);
@@ -59,7 +139,8 @@ struct StationScanner : Module {
         configSwitch(MODE_PARAM, 0.0f, 5.0f, 0.0f, "Scan mode", {
             "All", "Time signals", "International", "Amateur", "Mystery", "Favorites"
         });
-        configParam(THRESHOLD_PARAM, 0.0f, 10.0f, 0.0f, "Signal threshold", " V");
+        configParam(THRESHOLD_PARAM, 0.0f, 10.0f, 0.0f, "Signal threshold", " V")
+            ->description = "Parallel scan: stations weaker than this are left out (0V = -60 dBFS, 10V = 0 dBFS)";
         
         configInput(CLOCK_INPUT, "Clock/trigger");
         configInput(RESET_INPUT, "Reset to first station");
@@ -67,62 +148,50 @@ struct StationScanner : Module {
         configOutput(FREQ_OUTPUT, "Frequency CV (1V/MHz)");
         configOutput(GATE_OUTPUT, "Station change trigger");
         configOutput(EOC_OUTPUT, "End of cycle trigger");
+        configOutput(BEST_OUTPUT, "Strongest stations (1V/MHz)")
+            ->description = "Polyphonic, one channel per station above the threshold, strongest first (parallel scan)";
         
         configLight(SCAN_LIGHT, "Scanning");
         
+        // filled in place on the audio thread when the mode changes
+        stationList.reserve(stationDatabase().size());
         buildStationList();
+        
+        worker = std::thread(&StationScanner::workerLoop, this);
+    }
+    
+    ~StationScanner() {
+        {
+            std::lock_guard<std::mutex> lock(wakeMutex);
+            running = false;
+        }
+        wake.notify_one();
+        if (worker.joinable()) {
+            worker.join();
+        }
     }
     
     void buildStationList() {
-        stationList.clear();
-        int mode = (int)params[MODE_PARAM].getValue();
+        // categories for each scan mode, in ScanMode order
+        static const uint32_t MODE_CATEGORIES[] = {
+            StationDatabase::CATEGORY_ALL,
+            StationDatabase::CATEGORY_TIME,
+            StationDatabase::CATEGORY_BROADCAST,
+            StationDatabase::CATEGORY_AMATEUR,
+            StationDatabase::CATEGORY_MYSTERY,
+            StationDatabase::CATEGORY_FAVORITE
+        };
         
-        switch (mode) {
-            case TIME_SIGNALS:
-                for (int i = 0; i < NUM_STATIONS; i++) {
-                    if (strstr(STATIONS[i].name, "wwv") || strstr(STATIONS[i].name, "chv")) {
-                        stationList.push_back(i);
-                    }
-                }
-                break;
-                
-            case INTERNATIONAL:
-                for (int i = 0; i < NUM_STATIONS; i++) {
-                    if (strstr(STATIONS[i].name, "bbc") || strstr(STATIONS[i].name, "voa") || 
-                        strstr(STATIONS[i].name, "rhc") || strstr(STATIONS[i].name, "cri")) {
-                        stationList.push_back(i);
-                    }
-                }
-                break;
-                
-            case AMATEUR:
-                for (int i = 0; i < NUM_STATIONS; i++) {
-                    if (strstr(STATIONS[i].name, "ssb") || strstr(STATIONS[i].name, "ft8")) {
-                        stationList.push_back(i);
-                    }
-                }
-                break;
-                
-            case MYSTERY:
-                for (int i = 0; i < NUM_STATIONS; i++) {
-                    if (strstr(STATIONS[i].name, "uvb") || strstr(STATIONS[i].name, "hfgcs") || 
-                        strstr(STATIONS[i].name, "pirate")) {
-                        stationList.push_back(i);
-                    }
-                }
-                break;
-                
-            case FAVORITES:
-                for (int i = 0; i < sizeof(FAVORITES)/sizeof(int); i++) {
-                    stationList.push_back(FAVORITES[i]);
-                }
-                break;
-                
-            default:  // ALL_STATIONS
-                for (int i = 0; i < NUM_STATIONS; i++) {
-                    stationList.push_back(i);
-                }
-                break;
+        int mode = clamp((int)params[MODE_PARAM].getValue(), 0, (int)FAVORITES);
+        stationDatabase().filter(MODE_CATEGORIES[mode], stationList);
+        
+        // Leave out stations that are off the air right now, unless that's all of them
+        if (activeScheduleFilter && onAir) {
+            const std::vector<uint8_t>& active = onAir->onAir;
+            auto offAir = [&](int index) { return index >= (int)active.size() || !active[index]; };
+            if (!std::all_of(stationList.begin(), stationList.end(), offAir)) {
+                stationList.erase(std::remove_if(stationList.begin(), stationList.end(), offAir), stationList.end());
+            }
         }
         
         if (stationList.empty()) {
@@ -132,7 +201,6 @@ struct StationScanner : Module {
     
     void process(const ProcessArgs& args) override {
         // rebuild list if mode changed
-        static int lastMode = -1;
         int mode = (int)params[MODE_PARAM].getValue();
         if (mode != lastMode) {
             buildStationList();
@@ -140,6 +208,63 @@ struct StationScanner : Module {
             currentStation = 0;
         }
         
+        // or when stations came on or went off the air, staying on the current one if possible
+        bool scheduleChanged = onAirSets.update();
+        bool filter = scheduleFilter.load(std::memory_order_relaxed);
+        if (scheduleChanged || filter != activeScheduleFilter) {
+            activeScheduleFilter = filter;
+            onAir = &onAirSets.read();
+            
+            int station = getCurrentStation();
+            buildStationList();
+            auto found = std::find(stationList.begin(), stationList.end(), station);
+            if (found != stationList.end()) {
+                currentStation = (int)(found - stationList.begin());
+            } else if (currentStation >= (int)stationList.size()) {
+                currentStation = 0;
+            }
+        }
+        
+        // manual scan or auto scan
+        bool shouldScan = params[SCAN_PARAM].getValue() > 0.5f;
+        
+        if (parallel) {
+            processParallel(args, shouldScan);
+        } else {
+            processStepped(args, shouldScan);
+            // the last sweep's ranking isn't current any more
+            outputs[BEST_OUTPUT].setChannels(0);
+            swept = false;
+        }
+        
+        // gates
+        outputs[GATE_OUTPUT].setVoltage(gatePulse.process(args.sampleTime) ? 10.0f : 0.0f);
+        outputs[EOC_OUTPUT].setVoltage(eocPulse.process(args.sampleTime) ? 10.0f : 0.0f);
+        
+        // light
+        bool sweeping = sweepPending || sweepProgress.load(std::memory_order_relaxed) >= 0;
+        lights[SCAN_LIGHT].setBrightness((shouldScan || sweeping) ? 1.0f : 0.0f);
+        
+        publishDisplay();
+    }
+    
+    // Only when something changed, so the UI isn't handed a copy every sample
+    void publishDisplay() {
+        DisplayState state;
+        state.station = getCurrentStation();
+        state.listPosition = currentStation + 1;
+        state.listSize = (int)stationList.size();
+        state.rank = std::min(currentRank + 1, rankedCount);
+        state.rankedCount = rankedCount;
+        state.parallel = parallel.load(std::memory_order_relaxed);
+        if (state != shown) {
+            shown = state;
+            displayStates.write() = state;
+            displayStates.publish();
+        }
+    }
+    
+    void processStepped(const ProcessArgs& args, bool shouldScan) {
         // reset
         if (resetTrigger.process(inputs[RESET_INPUT].getVoltage())) {
             currentStation = 0;
@@ -147,9 +272,6 @@ struct StationScanner : Module {
             gatePulse.trigger(0.01f);
         }
         
-        // manual scan or auto scan
-        bool shouldScan = params[SCAN_PARAM].getValue() > 0.5f;
-        
         if (inputs[CLOCK_INPUT].isConnected()) {
             // clock mode - advance on trigger
             if (clockTrigger.process(inputs[CLOCK_INPUT].getVoltage())) {
@@ -179,28 +301,380 @@ struct StationScanner : Module {
         // output current station frequency
         if (currentStation < stationList.size()) {
             int stationIdx = stationList[currentStation];
-            if (stationIdx < NUM_STATIONS) {
-                float freq = STATIONS[stationIdx].freq;
+            if (stationIdx < stationDatabase().size()) {
+                float freq = stationDatabase().get(stationIdx).freq;
                 outputs[FREQ_OUTPUT].setVoltage(freq / 1000000.0f);  // 1V/MHz
             }
         }
+    }
+    
+    void processParallel(const ProcessArgs& args, bool shouldScan) {
+        // Reset starts a fresh sweep right away
+        bool startSweep = resetTrigger.process(inputs[RESET_INPUT].getVoltage());
         
-        // gates
-        outputs[GATE_OUTPUT].setVoltage(gatePulse.process(args.sampleTime) ? 10.0f : 0.0f);
-        outputs[EOC_OUTPUT].setVoltage(eocPulse.process(args.sampleTime) ? 10.0f : 0.0f);
+        // With the scan switch on, sweeps repeat with the dwell time between them
+        // Even when a sweep ranked nothing: an empty one returns at once, and
+        // repeating it back to back would hammer the servers
+        bool idle = !sweepPending && sweepProgress.load(std::memory_order_relaxed) < 0;
+        if (!shouldScan) {
+            swept = false;
+        } else if (idle) {
+            sweepTimer += args.sampleTime;
+            if (sweepTimer >= params[SPEED_PARAM].getValue() || !swept) {
+                startSweep = true;
+            }
+        }
         
-        // light
-        lights[SCAN_LIGHT].setBrightness(shouldScan ? 1.0f : 0.0f);
+        if (startSweep && !sweepPending && !stationList.empty()) {
+            SweepRequest& request = requests.write();
+            request.count = std::min((int)stationList.size(), MAX_SWEEP_STATIONS);
+            std::copy(stationList.begin(), stationList.begin() + request.count, request.stations);
+            request.threshold = params[THRESHOLD_PARAM].getValue();
+            requests.publish();
+            sweepPending = true;
+            sweepTimer = 0.0f;
+            swept = true;
+        }
+        
+        // A finished sweep replaces the ranking and jumps to the strongest station
+        if (results.update()) {
+            const SweepResult& result = results.read();
+            rankedCount = result.count;
+            std::copy(result.stations, result.stations + result.count, ranked);
+            currentRank = 0;
+            sweepPending = false;
+            if (rankedCount > 0) {
+                gatePulse.trigger(0.01f);
+                eocPulse.trigger(0.01f);
+            }
+            
+            outputs[BEST_OUTPUT].setChannels(rankedCount);
+            for (int i = 0; i < rankedCount; i++) {
+                outputs[BEST_OUTPUT].setVoltage(stationDatabase().get(ranked[i]).freq / 1000000.0f, i);
+            }
+        }
+        
+        // The clock steps through the ranking, strongest first
+        if (inputs[CLOCK_INPUT].isConnected() && clockTrigger.process(inputs[CLOCK_INPUT].getVoltage())) {
+            if (rankedCount > 0) {
+                currentRank = (currentRank + 1) % rankedCount;
+                gatePulse.trigger(0.01f);
+                if (currentRank == 0) {
+                    eocPulse.trigger(0.01f);
+                }
+            }
+        }
+        
+        if (currentRank < rankedCount) {
+            outputs[FREQ_OUTPUT].setVoltage(stationDatabase().get(ranked[currentRank]).freq / 1000000.0f);
+        }
+    }
+    
+    // Audio thread: database index of the station currently on FREQ_OUTPUT, or -1
+    int getCurrentStation() {
+        if (parallel) {
+            return (currentRank < rankedCount) ? ranked[currentRank] : -1;
+        }
+        if (currentStation < (int)stationList.size()) {
+            return stationList[currentStation];
+        }
+        return -1;
+    }
+    
+    // 0V at -60 dBFS up to 10V at full scale, the range of THRESHOLD_PARAM
+    static float levelToVoltage(float meanSquare) {
+        float db = 10.0f * std::log10(meanSquare + 1e-12f);
+        return clamp((db + 60.0f) / 6.0f, 0.0f, 10.0f);
+    }
+    
+    // One short-lived receiver used by a sweep. Its audio arrives on the
+    // client manager's I/O thread and is reduced to a mean square there.
+    struct Probe {
+        WebSDRClient client;
+        std::atomic<uint32_t> generation{0};  // bumped by the worker on every retune
+        std::atomic<uint64_t> progress{0};    // generation << 32 | samples measured
+        std::atomic<float> meanSquare{0.0f};
+        
+        // I/O thread only
+        uint32_t seenGeneration = 0;
+        int settleSamples = 0;
+        double sum = 0.0;
+        uint32_t count = 0;
+        
+        Probe() {
+            client.setCompression(true);  // levels survive ADPCM and it's a quarter of the bandwidth
+            client.setAudioCallback([this](const float* samples, size_t n) {
+                onAudio(samples, n);
+            });
+        }
+        
+        ~Probe() {
+            // no more callbacks once this returns
+            client.disconnect();
+        }
+        
+        void onAudio(const float* samples, size_t n) {
+            uint32_t gen = generation.load(std::memory_order_acquire);
+            if (gen != seenGeneration) {
+                seenGeneration = gen;
+                settleSamples = (int)(client.getSampleRate() * SETTLE_SECONDS);
+                sum = 0.0;
+                count = 0;
+            }
+            
+            size_t i = 0;
+            if (settleSamples > 0) {
+                i = std::min(n, (size_t)settleSamples);
+                settleSamples -= (int)i;
+            }
+            for (; i < n; i++) {
+                sum += samples[i] * samples[i];
+                count++;
+            }
+            
+            if (count > 0) {
+                meanSquare.store((float)(sum / count), std::memory_order_relaxed);
+                progress.store(((uint64_t)gen << 32) | count, std::memory_order_release);
+            }
+        }
+    };
+    
+    std::thread worker;
+    std::atomic<bool> running{true};
+    
+    // The worker only looks for sweeps while parallel scan is on; otherwise
+    // it sleeps until the next schedule check or until it's turned on
+    std::mutex wakeMutex;
+    std::condition_variable wake;
+    
+    // worker only
+    std::chrono::steady_clock::time_point lastScheduleCheck;
+    int lastUtcSlot = -1;
+    int lastLocalSlot = -1;
+    
+    // Checked once a minute; the on-air set only changes when a half-hour slot rolls over
+    void refreshSchedule() {
+        auto now = std::chrono::steady_clock::now();
+        if (lastUtcSlot >= 0 && now - lastScheduleCheck < std::chrono::minutes(1)) return;
+        lastScheduleCheck = now;
+        
+        int utcSlot, localSlot;
+        StationDatabase::currentSlots(utcSlot, localSlot);
+        if (utcSlot == lastUtcSlot && localSlot == lastLocalSlot) return;
+        lastUtcSlot = utcSlot;
+        lastLocalSlot = localSlot;
+        
+        const StationDatabase& database = stationDatabase();
+        OnAirSet& set = onAirSets.write();
+        set.onAir.resize(database.size());
+        int count = 0;
+        for (int i = 0; i < database.size(); i++) {
+            set.onAir[i] = database.isOnAir(i, utcSlot, localSlot);
+            count += set.onAir[i];
+        }
+        onAirSets.publish();
+        
+        WEBSDR_DEBUG("%d of %d stations on the air", count, database.size());
+    }
+    
+    void workerLoop() {
+        while (running) {
+            refreshSchedule();
+            
+            if (requests.update()) {
+                SweepResult& result = results.write();
+                runSweep(requests.read(), result);
+                results.publish();
+                continue;
+            }
+            
+            std::unique_lock<std::mutex> lock(wakeMutex);
+            if (parallel) {
+                // Requests come from the audio thread, which mustn't wake anyone
+                wake.wait_for(lock, std::chrono::milliseconds(20), [this]() { return !running.load(); });
+            } else {
+                wake.wait_until(lock, lastScheduleCheck + std::chrono::minutes(1),
+                    [this]() { return !running || parallel; });
+            }
+        }
+    }
+    
+    // UI thread: wakes the worker so it starts looking for sweeps
+    void setParallel(bool on) {
+        {
+            std::lock_guard<std::mutex> lock(wakeMutex);
+            parallel = on;
+        }
+        wake.notify_one();
+    }
+    
+    void runSweep(const SweepRequest& request, SweepResult& result) {
+        int count = clamp(receivers.load(), 1, MAX_RECEIVERS);
+        count = std::min(count, request.count);
+        
+        std::vector<std::unique_ptr<Probe>> probes;
+        for (int i = 0; i < count; i++) {
+            probes.emplace_back(new Probe);
+        }
+        
+        // Same servers as the receiver module
+        const std::vector<std::string> servers = serverProber().rankedServers();
+        
+        std::vector<float> levels(request.count, 0.0f);
+        sweepProgress = 0;
+        
+        for (int next = 0; next < request.count && running; next += count) {
+            int batch = std::min(count, request.count - next);
+            
+            // Retune every receiver to its station; the first batch also connects
+            for (int i = 0; i < batch; i++) {
+                Probe& probe = *probes[i];
+                const Station& station = stationDatabase().get(request.stations[next + i]);
+                bool ssb = strcmp(station.mode, "am") != 0;
+                probe.client.setMode(station.mode);
+                probe.client.setBandwidth(ssb ? 3000.0f : 8000.0f);
+                probe.client.setFrequency(station.freq);
+                probe.generation++;
+                if (next == 0) {
+                    probe.client.connect(servers);
+                }
+            }
+            
+            // Wait until every receiver has measured enough audio, or gave up
+            auto start = std::chrono::steady_clock::now();
+            while (running) {
+                bool done = true;
+                for (int i = 0; i < batch; i++) {
+                    Probe& probe = *probes[i];
+                    uint64_t progress = probe.progress.load(std::memory_order_acquire);
+                    uint32_t measured = ((progress >> 32) == probe.generation.load()) ? (uint32_t)progress : 0;
+                    bool failed = probe.client.getState() == WebSDRClient::State::FAILED;
+                    if (!failed && measured < probe.client.getSampleRate() * MEASURE_SECONDS) {
+                        done = false;
+                    }
+                }
+                
+                float elapsed = std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+                if (done || elapsed > STATION_TIMEOUT) break;
+                refreshSchedule();
+                std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            }
+            
+            for (int i = 0; i < batch; i++) {
+                Probe& probe = *probes[i];
+                uint64_t progress = probe.progress.load(std::memory_order_acquire);
+                bool measured = (progress >> 32) == probe.generation.load() && (uint32_t)progress > 0;
+                levels[next + i] = measured ? levelToVoltage(probe.meanSquare.load(std::memory_order_relaxed)) : 0.0f;
+            }
+            sweepProgress = next + batch;
+        }
+        
+        // The receivers are only needed for the sweep itself
+        probes.clear();
+        
+        // Rank stations above the threshold, strongest first
+        std::vector<int> order;
+        for (int i = 0; i < request.count; i++) {
+            if (levels[i] > 0.0f && levels[i] >= request.threshold) {
+                order.push_back(i);
+            }
+        }
+        std::stable_sort(order.begin(), order.end(), [&](int a, int b) {
+            return levels[a] > levels[b];
+        });
+        
+        result.count = std::min((int)order.size(), clamp(bestCount.load(), 1, MAX_BEST));
+        for (int i = 0; i < result.count; i++) {
+            result.stations[i] = request.stations[order[i]];
+            result.levels[i] = levels[order[i]];
+        }
+        
+        sweepProgress = -1;
+        WEBSDR_INFO("Scan found %d of %d stations above %.2f V",
+                   (int)order.size(), (int)request.count, request.threshold);
+    }
+    
+    void appendContextMenu(Menu* menu) {
+        menu->addChild(new MenuSeparator);
+        
+        struct ParallelItem : MenuItem {
+            StationScanner* module;
+            void onAction(const event::Action& e) override {
+                module->setParallel(!module->parallel);
+            }
+        };
+        
+        struct ScheduleItem : MenuItem {
+            StationScanner* module;
+            void onAction(const event::Action& e) override {
+                module->scheduleFilter.store(!module->scheduleFilter.load());
+            }
+        };
+        
+        ScheduleItem* scheduleItem = new ScheduleItem;
+        scheduleItem->text = "Skip stations off the air";
+        scheduleItem->module = this;
+        scheduleItem->rightText = scheduleFilter.load() ? "✓" : "";
+        menu->addChild(scheduleItem);
+        
+        ParallelItem* parallelItem = new ParallelItem;
+        parallelItem->text = "Parallel scan";
+        parallelItem->module = this;
+        parallelItem->rightText = parallel ? "✓" : "";
+        menu->addChild(parallelItem);
+        
+        struct ReceiversItem : MenuItem {
+            StationScanner* module;
+            int count;
+            void onAction(const event::Action& e) override {
+                module->receivers = count;
+            }
+        };
+        
+        menu->addChild(createSubmenuItem("Parallel receivers", string::f("%d", receivers.load()), [=](Menu* menu) {
+            for (int count : {2, 4, 8}) {
+                ReceiversItem* item = new ReceiversItem;
+                item->text = string::f("%d", count);
+                item->module = this;
+                item->count = count;
+                item->rightText = (receivers == count) ? "✓" : "";
+                menu->addChild(item);
+            }
+        }));
+        
+        struct BestCountItem : MenuItem {
+            StationScanner* module;
+            int count;
+            void onAction(const event::Action& e) override {
+                module->bestCount = count;
+            }
+        };
+        
+        menu->addChild(createSubmenuItem("Ranked stations", string::f("%d", bestCount.load()), [=](Menu* menu) {
+            for (int count : {1, 4, 8, 16}) {
+                BestCountItem* item = new BestCountItem;
+                item->text = string::f("%d", count);
+                item->module = this;
+                item->count = count;
+                item->rightText = (bestCount == count) ? "✓" : "";
+                menu->addChild(item);
+            }
+        }));
     }
     
     void onReset() override {
         currentStation = 0;
         scanTimer = 0.0f;
+        swept = false;
     }
     
     json_t* dataToJson() override {
         json_t* rootJ = json_object();
         json_object_set_new(rootJ, "currentStation", json_integer(currentStation));
+        json_object_set_new(rootJ, "scheduleFilter", json_boolean(scheduleFilter.load()));
+        json_object_set_new(rootJ, "parallel", json_boolean(parallel.load()));
+        json_object_set_new(rootJ, "receivers", json_integer(receivers));
+        json_object_set_new(rootJ, "bestCount", json_integer(bestCount));
         return rootJ;
     }
     
@@ -208,9 +682,28 @@ struct StationScanner : Module {
         json_t* currentStationJ = json_object_get(rootJ, "currentStation");
         if (currentStationJ)
             currentStation = json_integer_value(currentStationJ);
+        
+        json_t* scheduleFilterJ = json_object_get(rootJ, "scheduleFilter");
+        if (scheduleFilterJ) scheduleFilter.store(json_boolean_value(scheduleFilterJ));
+        
+        json_t* parallelJ = json_object_get(rootJ, "parallel");
+        if (parallelJ) setParallel(json_boolean_value(parallelJ));
+        
+        json_t* receiversJ = json_object_get(rootJ, "receivers");
+        if (receiversJ) receivers = clamp((int)json_integer_value(receiversJ), 1, MAX_RECEIVERS);
+        
+        json_t* bestCountJ = json_object_get(rootJ, "bestCount");
+        if (bestCountJ) bestCount = clamp((int)json_integer_value(bestCountJ), 1, MAX_BEST);
     }
 };
 
+constexpr int StationScanner::MAX_RECEIVERS;
+constexpr int StationScanner::MAX_BEST;
+constexpr int StationScanner::MAX_SWEEP_STATIONS;
+constexpr float StationScanner::SETTLE_SECONDS;
+constexpr float StationScanner::MEASURE_SECONDS;
+constexpr float StationScanner::STATION_TIMEOUT;
+
 struct StationDisplay : Widget {
     StationScanner* module;
     
@@ -223,34 +716,43 @@ struct StationDisplay : Widget {
         nvgFillColor(args.vg, nvgRGB(10, 10, 10));
         nvgFill(args.vg);
         
+        module->displayStates.update();
+        const StationScanner::DisplayState& state = module->displayStates.read();
+        
         // current station
-        if (module->currentStation < module->stationList.size()) {
-            int idx = module->stationList[module->currentStation];
-            if (idx < NUM_STATIONS) {
-                const Station* station = &STATIONS[idx];
-                
-                nvgFontSize(args.vg, 10);
-                nvgFillColor(args.vg, nvgRGB(0, 255, 100));
-                nvgTextAlign(args.vg, NVG_ALIGN_CENTER | NVG_ALIGN_MIDDLE);
-                
-                // station name
-                nvgText(args.vg, box.size.x/2, box.size.y/2 - 8, station->name, NULL);
-                
-                // frequency
-                char freqStr[32];
-                snprintf(freqStr, sizeof(freqStr), "%.3f MHz", station->freq / 1000000.0f);
-                nvgFontSize(args.vg, 9);
-                nvgFillColor(args.vg, nvgRGB(0, 200, 80));
-                nvgText(args.vg, box.size.x/2, box.size.y/2 + 8, freqStr, NULL);
-                
-                // station number
-                char numStr[32];
-                snprintf(numStr, sizeof(numStr), "%d/%d", module->currentStation + 1, (int)module->stationList.size());
-                nvgFontSize(args.vg, 8);
-                nvgFillColor(args.vg, nvgRGB(100, 100, 100));
-                nvgText(args.vg, box.size.x/2, box.size.y - 5, numStr, NULL);
-            }
+        int idx = state.station;
+        if (idx >= 0) {
+            const Station* station = &stationDatabase().get(idx);
+            
+            nvgFontSize(args.vg, 10);
+            nvgFillColor(args.vg, nvgRGB(0, 255, 100));
+            nvgTextAlign(args.vg, NVG_ALIGN_CENTER | NVG_ALIGN_MIDDLE);
+            
+            // station name
+            nvgText(args.vg, box.size.x/2, box.size.y/2 - 8, station->name, NULL);
+            
+            // frequency
+            char freqStr[32];
+            snprintf(freqStr, sizeof(freqStr), "%.3f MHz", station->freq / 1000000.0f);
+            nvgFontSize(args.vg, 9);
+            nvgFillColor(args.vg, nvgRGB(0, 200, 80));
+            nvgText(args.vg, box.size.x/2, box.size.y/2 + 8, freqStr, NULL);
         }
+        
+        // station number, or sweep progress while a parallel scan runs
+        char numStr[32];
+        int sweepProgress = module->sweepProgress.load(std::memory_order_relaxed);
+        if (sweepProgress >= 0) {
+            snprintf(numStr, sizeof(numStr), "scan %d/%d", sweepProgress, state.listSize);
+        } else if (state.parallel) {
+            snprintf(numStr, sizeof(numStr), "#%d/%d", state.rank, state.rankedCount);
+        } else {
+            snprintf(numStr, sizeof(numStr), "%d/%d", state.listPosition, state.listSize);
+        }
+        nvgFontSize(args.vg, 8);
+        nvgFillColor(args.vg, nvgRGB(100, 100, 100));
+        nvgTextAlign(args.vg, NVG_ALIGN_CENTER | NVG_ALIGN_MIDDLE);
+        nvgText(args.vg, box.size.x/2, box.size.y - 5, numStr, NULL);
     }
 };
 
@@ -288,7 +790,16 @@ struct StationScannerWidget : ModuleWidget {
         // outputs
         addOutput(createOutputCentered<PJ301MPort>(Vec(25, 280), module, StationScanner::FREQ_OUTPUT));
         addOutput(createOutputCentered<PJ301MPort>(Vec(65, 280), module, StationScanner::GATE_OUTPUT));
-        addOutput(createOutputCentered<PJ301MPort>(Vec(45, 320), module, StationScanner::EOC_OUTPUT));
+        addOutput(createOutputCentered<PJ301MPort>(Vec(25, 320), module, StationScanner::EOC_OUTPUT));
+        addOutput(createOutputCentered<PJ301MPort>(Vec(65, 320), module, StationScanner::BEST_OUTPUT));
+        
+        // threshold for the parallel scan
+        addParam(createParamCentered<Trimpot>(Vec(72, 117), module, StationScanner::THRESHOLD_PARAM));
+    }
+    
+    void appendContextMenu(Menu* menu) override {
+        StationScanner* module = dynamic_cast<StationScanner*>(this->module);
+        if (module) module->appendContextMenu(menu);
     }
 };
 
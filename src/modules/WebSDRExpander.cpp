@@ -1,12 +1,7 @@
 // expander module for websdr - adds spectrum analyzer and extra controls
 #include "../plugin.hpp"
-
-struct WebSDRExpanderMessage {
-    float spectrum[256] = {};
-    float signalStrength = 0.0f;
-    float frequency = 0.0f;
-    bool connected = false;
-};
+#include "WebSDRExpanderMessage.hpp"
+#include "../dsp/SpectrumReducer.hpp"
 
 struct WebSDRExpander : Module {
     enum ParamId {
@@ -32,10 +27,21 @@ struct WebSDRExpander : Module {
         NUM_LIGHTS
     };
     
+    static constexpr int BINS = WebSDRExpanderMessage::SPECTRUM_BINS;
+    
     WebSDRExpanderMessage leftMessages[2][1];
     bool scanning = false;
     float scanPhase = 0.0f;
     
+    // spectrum output settings
+    int spectrumChannels = 16;
+    int mapping = SpectrumReducer::LINEAR;
+    
+    // bands are recomputed when settings change; voltages only on new lines
+    SpectrumReducer reducer;
+    uint32_t lastSequence = 0;
+    bool outputStale = true;
+    
     WebSDRExpander() {
         config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS);
         
@@ -45,7 +51,7 @@ struct WebSDRExpander : Module {
         configInput(SCAN_CV_INPUT, "Scan CV trigger");
         
         configOutput(SPECTRUM_OUTPUT, "Spectrum data")
-            ->description = "Polyphonic output of spectrum analyzer (16 channels)";
+            ->description = "Polyphonic server spectrum, 4/8/16 channels (0-10V)";
         configOutput(FREQ_OUTPUT, "Frequency CV")
             ->description = "Current frequency as CV (1V = 1MHz)";
         configOutput(SCAN_OUTPUT, "Scan CV")
@@ -62,18 +68,21 @@ struct WebSDRExpander : Module {
         if (leftExpander.module && leftExpander.module->model == modelWebSDRReceiver) {
             WebSDRExpanderMessage* msg = (WebSDRExpanderMessage*) leftExpander.consumerMessage;
             
-            // output spectrum as polyphonic cable (16 channels)
-            outputs[SPECTRUM_OUTPUT].setChannels(16);
-            for (int i = 0; i < 16; i++) {
-                float val = 0.0f;
-                if (i < 256/16) {
-                    // average 16 bins per channel
-                    for (int j = 0; j < 16; j++) {
-                        val += msg->spectrum[i * 16 + j];
-                    }
-                    val /= 16.0f;
+            // spectrum as a polyphonic cable, only reduced when a new line arrives
+            if (spectrumChannels != reducer.getBands() || mapping != reducer.getMapping()) {
+                reducer.configure(BINS, spectrumChannels, mapping);
+                outputStale = true;
+            }
+            if (msg->spectrumSequence != lastSequence || outputStale) {
+                lastSequence = msg->spectrumSequence;
+                reducer.process(msg->spectrum);
+                
+                const float* levels = reducer.levels();
+                outputs[SPECTRUM_OUTPUT].setChannels(reducer.getBands());
+                for (int i = 0; i < reducer.getBands(); i++) {
+                    outputs[SPECTRUM_OUTPUT].setVoltage(levels[i] * 10.0f, i);
                 }
-                outputs[SPECTRUM_OUTPUT].setVoltage(val * 10.0f, i);
+                outputStale = false;
             }
             
             // frequency cv output
@@ -94,16 +103,80 @@ struct WebSDRExpander : Module {
                 outputs[SCAN_OUTPUT].setVoltage(0.0f);
                 lights[SCAN_LIGHT].setBrightness(0.0f);
             }
-            
+        
         } else {
             // not connected
             outputs[SPECTRUM_OUTPUT].setChannels(0);
             outputs[FREQ_OUTPUT].setVoltage(0.0f);
             outputs[SCAN_OUTPUT].setVoltage(0.0f);
+            outputStale = true;
         }
     }
+    
+    void appendContextMenu(Menu* menu) {
+        menu->addChild(new MenuSeparator);
+        
+        struct ChannelsItem : MenuItem {
+            WebSDRExpander* module;
+            int channels;
+            void onAction(const event::Action& e) override {
+                module->spectrumChannels = channels;
+            }
+        };
+        
+        menu->addChild(createSubmenuItem("Spectrum channels", string::f("%d", spectrumChannels), [=](Menu* menu) {
+            for (int channels : {4, 8, 16}) {
+                ChannelsItem* item = new ChannelsItem;
+                item->text = string::f("%d", channels);
+                item->module = this;
+                item->channels = channels;
+                item->rightText = (spectrumChannels == channels) ? "✓" : "";
+                menu->addChild(item);
+            }
+        }));
+        
+        struct MappingItem : MenuItem {
+            WebSDRExpander* module;
+            int mapping;
+            void onAction(const event::Action& e) override {
+                module->mapping = mapping;
+            }
+        };
+        
+        static const char* mappingNames[SpectrumReducer::NUM_MAPPINGS] = {"Linear", "Log-spaced", "Peak hold"};
+        menu->addChild(createSubmenuItem("Spectrum mapping", mappingNames[mapping], [=](Menu* menu) {
+            for (int m = 0; m < SpectrumReducer::NUM_MAPPINGS; m++) {
+                MappingItem* item = new MappingItem;
+                item->text = mappingNames[m];
+                item->module = this;
+                item->mapping = m;
+                item->rightText = (mapping == m) ? "✓" : "";
+                menu->addChild(item);
+            }
+        }));
+    }
+    
+    json_t* dataToJson() override {
+        json_t* rootJ = json_object();
+        json_object_set_new(rootJ, "spectrumChannels", json_integer(spectrumChannels));
+        json_object_set_new(rootJ, "mapping", json_integer(mapping));
+        return rootJ;
+    }
+    
+    void dataFromJson(json_t* rootJ) override {
+        json_t* channelsJ = json_object_get(rootJ, "spectrumChannels");
+        if (channelsJ) {
+            int channels = (int)json_integer_value(channelsJ);
+            if (channels == 4 || channels == 8 || channels == 16) spectrumChannels = channels;
+        }
+        
+        json_t* mappingJ = json_object_get(rootJ, "mapping");
+        if (mappingJ) mapping = clamp((int)json_integer_value(mappingJ), 0, SpectrumReducer::NUM_MAPPINGS - 1);
+    }
 };
 
+constexpr int WebSDRExpander::BINS;
+
 struct WebSDRExpanderWidget : ModuleWidget {
     WebSDRExpanderWidget(WebSDRExpander* module) {
         setModule(module);
@@ -113,17 +186,20 @@ struct WebSDRExpanderWidget : ModuleWidget {
         addChild(createWidget<ScrewSilver>(Vec(15, 365)));
         
         // scan controls
-        addParam(createParamCentered<CKSS>(Vec(30, 100), module, WebSDRExpander::SCAN_PARAM));
+        addParam(createParamCentered<CKSS>(Vec(30, 80), module, WebSDRExpander::SCAN_PARAM));
+        addChild(createLightCentered<SmallLight<YellowLight>>(Vec(30, 100), module, WebSDRExpander::SCAN_LIGHT));
         addParam(createParamCentered<RoundBlackKnob>(Vec(30, 140), module, WebSDRExpander::SCAN_SPEED_PARAM));
-        addInput(createInputCentered<PJ301MPort>(Vec(30, 180), module, WebSDRExpander::SCAN_CV_INPUT));
+        addInput(createInputCentered<PJ301MPort>(Vec(30, 185), module, WebSDRExpander::SCAN_CV_INPUT));
         
         // outputs
-        addOutput(createOutputCentered<PJ301MPort>(Vec(30, 240), module, WebSDRExpander::SPECTRUM_OUTPUT));
-        addOutput(createOutputCentered<PJ301MPort>(Vec(30, 280), module, WebSDRExpander::FREQ_OUTPUT));
-        addOutput(createOutputCentered<PJ301MPort>(Vec(30, 320), module, WebSDRExpander::SCAN_OUTPUT));
-        
-        // scan light
-        addChild(createLightCentered<SmallLight<YellowLight>>(Vec(30, 120), module, WebSDRExpander::SCAN_LIGHT));
+        addOutput(createOutputCentered<PJ301MPort>(Vec(30, 250), module, WebSDRExpander::SPECTRUM_OUTPUT));
+        addOutput(createOutputCentered<PJ301MPort>(Vec(30, 295), module, WebSDRExpander::FREQ_OUTPUT));
+        addOutput(createOutputCentered<PJ301MPort>(Vec(30, 340), module, WebSDRExpander::SCAN_OUTPUT));
+    }
+    
+    void appendContextMenu(Menu* menu) override {
+        WebSDRExpander* module = dynamic_cast<WebSDRExpander*>(this->module);
+        if (module) module->appendContextMenu(menu);
     }
 };
 
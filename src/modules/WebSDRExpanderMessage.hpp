@@ -0,0 +1,13 @@
+#pragma once
+#include <cstdint>
+
+// Message the receiver sends to a WebSDRExpander on its right
+struct WebSDRExpanderMessage {
+    static constexpr int SPECTRUM_BINS = 256;
+    
+    float spectrum[SPECTRUM_BINS] = {};  // server waterfall, 0-30 MHz, 0..1 per bin
+    uint32_t spectrumSequence = 0;       // bumped whenever spectrum holds a new line
+    float signalStrength = 0.0f;
+    float frequency = 0.0f;
+    bool connected = false;
+};
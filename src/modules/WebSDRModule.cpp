@@ -1,11 +1,20 @@
 #include "../plugin.hpp"
 #include "../network/WebSDRClient.hpp"
-#include "stations.hpp"
+#include "../network/ServerProber.hpp"
+#include "../dsp/JitterBuffer.hpp"
+#include "../dsp/PolyphaseResampler.hpp"
+#include "../dsp/MultiChannelResampler.hpp"
+#include "../dsp/SignalAnalyzer.hpp"
+#include "StationDatabase.hpp"
+#include "WebSDRExpanderMessage.hpp"
 #include <cmath>
 #include <cstring>
 #include <algorithm>
 #include <sstream>
 #include <iomanip>
+#include <chrono>
+#include <memory>
+#include <ctime>
 
 struct WebSDRModule : Module {
     enum ParamId {
@@ -20,11 +29,15 @@ struct WebSDRModule : Module {
     enum InputId {
         PRESET_GATE_INPUT,
         PRESET_GATE_INPUT_LAST = PRESET_GATE_INPUT + 7,
+        FREQ_CV_INPUT,
         NUM_INPUTS
     };
     
     enum OutputId {
         AUDIO_OUTPUT,
+        DIAG_OUTPUT,
+        SIGNAL_STRENGTH_OUTPUT,
+        CARRIER_OUTPUT,  // gate while a steady tone stands out of the noise
         NUM_OUTPUTS
     };
     
@@ -36,14 +49,137 @@ struct WebSDRModule : Module {
     };
     
     WebSDRClient client;
-    std::vector<float> audioBuffer;
-    std::mutex bufferMutex;
-    size_t readPos = 0;
-    size_t writePos = 0;
     
-    // Resampling from 12kHz to engine sample rate
-    float lastSample = 0.0f;
-    float resamplePhase = 0.0f;
+    // Target latency range, for the menu and for saved patches alike
+    static constexpr float MIN_LATENCY = 0.05f;
+    static constexpr float MAX_LATENCY = 2.0f;
+    
+    // A jitter buffer targets at most half its ring, so every ring holds
+    // twice the longest target at the fastest server rate, a KiwiSDR's
+    // 20.25 kHz wideband mode
+    static constexpr double MAX_SERVER_RATE = 20250.0;
+    static constexpr size_t RING_CAPACITY = (size_t)(MAX_SERVER_RATE * MAX_LATENCY * 2.0);
+    
+    // Network thread pushes decoded packets, process() pops - no locks either side
+    JitterBuffer jitterBuffer{RING_CAPACITY};
+    
+    // Resampling from the server rate (nominally 12kHz) to engine sample rate,
+    // a block at a time. A lane resamples one buffer: the playing lane is on
+    // air, and after a switch the other one keeps the previous buffer going
+    // for the crossfade.
+    static constexpr int AUDIO_BLOCK_SIZE = 64;
+    static constexpr float CROSSFADE_SECONDS = 0.02f;
+    struct Lane {
+        JitterBuffer* buffer = nullptr;
+        const WebSDRClient* client = nullptr;  // whose sample rate the buffer is at
+        PolyphaseResampler resampler;
+    };
+    Lane lanes[2];
+    int playingLane = 0;
+    float fadeTime = CROSSFADE_SECONDS;  // since the last switch, the fade is over once it's reached
+    float audioBlock[AUDIO_BLOCK_SIZE] = {};
+    float fadeBlock[AUDIO_BLOCK_SIZE] = {};
+    int audioBlockPos = AUDIO_BLOCK_SIZE;
+    
+    // Polyphonic mode: one receiver per channel of the FREQ CV cable. The
+    // first channel is the receiver above, with its standbys and crossfade;
+    // the others are plain streams, resampled a block at a time.
+    // They are connected paused, like the standbys; the audio thread
+    // resumes the ones in use.
+    static constexpr int MAX_CHANNELS = MultiChannelResampler::MAX_CHANNELS;
+    struct ExtraChannel {
+        WebSDRClient client;
+        JitterBuffer buffer{RING_CAPACITY};
+        float freq = 0.0f;     // tuning last handed to the client
+        float mode = -1.0f;
+        bool connected = false;  // resumed by the audio thread
+        int group = -1;        // RateGroup resampling it, -1 for none
+        int slot = 0;          // its channel in that group's resampler
+    };
+    
+    // Each extra channel races the servers on its own, so they can land on
+    // different servers with different rates and clocks. Channels at the
+    // same source rate (in practice, on the same server) share a resampler
+    // and one drift trim. Members keep their slot while they stay, so one
+    // joining or leaving doesn't disturb the others.
+    struct RateGroup {
+        MultiChannelResampler resampler;
+        double rate = 0.0;
+        int members = 0;  // unused while 0
+        JitterBuffer* sources[MAX_CHANNELS];  // by slot, idleSource where free
+    };
+    
+    // The extra channels and their groups, built the first time a cable
+    // reaches the FREQ CV input, so a mono receiver never holds fifteen
+    // clients and rings. Kept until the module goes, so the audio thread
+    // never sees them freed.
+    struct PolyChannels {
+        ExtraChannel channels[MAX_CHANNELS - 1];
+        RateGroup groups[MAX_CHANNELS - 1];
+    };
+    std::unique_ptr<PolyChannels> poly;
+    JitterBuffer idleSource{64};  // never filled, so it reads as silence
+    alignas(16) float groupBlock[AUDIO_BLOCK_SIZE][MAX_CHANNELS] = {};
+    float extraBlock[AUDIO_BLOCK_SIZE][MAX_CHANNELS - 1] = {};
+    int polyChannels = 1;  // follows the FREQ CV cable
+    
+    // Signal analysis of the first channel, run by the network thread once
+    // per packet; the outputs read the latest snapshot at control rate
+    SignalAnalyzer signalAnalyzer;
+    SignalAnalyzer::Snapshot signal;
+    std::atomic<float> snrDb{0.0f};        // copies for the menu
+    std::atomic<float> carrierFreq{0.0f};  // Hz, 0 when there's no carrier
+    
+    // Presets, lights and tuning run once every controlDivision samples
+    dsp::ClockDivider controlDivider;
+    int controlDivision = 32;
+    
+    // Every receiver here, main, standby or extra, retunes once its target
+    // moves by more than this. Fine enough that an SSB voice or a CW note
+    // lands where it's tuned; a CV sweep still costs at most one retune per
+    // 1/retuneRate, since the clients coalesce them.
+    static constexpr float RETUNE_HZ = 1.0f;
+    
+    // Last tuning handed to the client
+    float lastFreq = 0.0f;
+    float lastMode = -1.0f;
+    bool added = false;  // onAdd has connected
+    
+    // ADPCM from the server instead of 16-bit PCM, about 4x less bandwidth
+    bool compression = false;
+    
+    // Stream IQ and demodulate here, so a mode change is instant
+    bool localDemodulation = false;
+    
+    // Server picked from the menu, empty for the fastest available
+    std::string serverUrl;
+    
+    // A capture played back in place of the live servers, empty when live
+    std::string playbackPath;
+    std::atomic<bool> live{true};  // playbackPath is empty, for the audio thread
+    
+    // Server waterfall, forwarded to an expander on the right. Off until
+    // asked for, the W/F stream takes a server slot of its own.
+    bool waterfall = false;
+    float waterfallBins[WebSDRClient::WATERFALL_BINS] = {};
+    uint32_t waterfallSequence = 0;
+    
+    // Diagnostics. The client and jitter buffer keep their own counters; these
+    // two are the module's share, written only by the audio thread.
+    enum DiagChannel {
+        DIAG_FILL,      // 1V per 100 ms buffered
+        DIAG_DRIFT,     // 1V per 0.1% resampler trim
+        DIAG_PACKETS,   // 1V per 10 packets/s
+        DIAG_DECODE,    // 1V per 10 us decoding a packet
+        DIAG_BLOCK,     // 1V per 10 us producing an audio block
+        DIAG_RECONNECTS,
+        DIAG_LOST,      // 1V per 10 packets lost
+        NUM_DIAG_CHANNELS
+    };
+    std::atomic<float> blockMicros{0.0f};       // resampling one AUDIO_BLOCK_SIZE block, smoothed
+    std::atomic<float> packetsPerSecond{0.0f};
+    uint64_t lastPacketCount = 0;
+    float packetRateTime = 0.0f;
     
     // Preset system
     static constexpr int NUM_PRESETS = 8;
@@ -53,6 +189,26 @@ struct WebSDRModule : Module {
     dsp::SchmittTrigger presetGateTriggers[NUM_PRESETS];
     float presetLightBrightness[NUM_PRESETS] = {};
     
+    // Hot standby: the first MAX_STANDBYS saved presets stream in the
+    // background into a ring each, so recalling one switches to audio
+    // that's already there instead of waiting out a retune. Every standby
+    // takes a user slot on the server, except where it shares a stream with
+    // the main receiver or another standby on the same frequency.
+    //
+    // connect() locks and allocates, so every standby is connected paused
+    // alongside the receiver, and the audio thread only resumes the ones it
+    // wants; the manager's I/O thread does the rest, with or without a UI.
+    static constexpr int MAX_STANDBYS = 3;
+    struct Standby {
+        WebSDRClient client;
+        JitterBuffer buffer{RING_CAPACITY};  // becomes the one on air after a recall
+        float freq = 0.0f;     // tuning last handed to the client
+        float mode = -1.0f;
+        bool connected = false;  // resumed by the audio thread
+    };
+    Standby standbys[MAX_STANDBYS];
+    std::atomic<bool> hotStandby{false};  // set from the menu, acted on at control rate
+    
     WebSDRModule() {
         config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS);
         
@@ -94,45 +250,164 @@ struct WebSDRModule : Module {
             }
         }
         
-        configOutput(AUDIO_OUTPUT, "Audio");
+        configInput(FREQ_CV_INPUT, "Frequency CV")
+            ->description = "1V per MHz added to the knob. Polyphonic: one receiver per channel, up to 16";
+        
+        configOutput(AUDIO_OUTPUT, "Audio")
+            ->description = "One channel per frequency CV channel";
+        configOutput(DIAG_OUTPUT, "Diagnostics (poly: buffer fill, drift, packets/s, decode time, block time, reconnects, packets lost)");
+        configOutput(SIGNAL_STRENGTH_OUTPUT, "Signal strength")
+            ->description = "0-10V signal strength of the first channel: S-meter at 1V per 10 dB over -127 dBm, or the audio level";
+        configOutput(CARRIER_OUTPUT, "Carrier detect")
+            ->description = "Gate high while a carrier stands 12 dB over the noise";
         configLight(CONNECTION_LIGHT, "Connection");
         
-        // Pre-allocate circular buffer (1 second at 48kHz)
-        audioBuffer.resize(48000);
+        controlDivider.setDivision(controlDivision);
         
-        // Set up audio callback
+        // Set up audio callback (runs on the network thread)
         client.setAudioCallback([this](const float* samples, size_t count) {
-            std::lock_guard<std::mutex> lock(bufferMutex);
+            // Bulk push the whole packet; if the ring is full the tail is dropped
+            jitterBuffer.push(samples, count);
             
-            // Simple circular buffer write
-            for (size_t i = 0; i < count; i++) {
-                audioBuffer[writePos] = samples[i];
-                writePos = (writePos + 1) % audioBuffer.size();
-                
-                // Prevent overflow - skip old samples if buffer is full
-                if (writePos == readPos) {
-                    readPos = (readPos + 1) % audioBuffer.size();
-                }
-            }
+            signalAnalyzer.setSampleRate(client.getSampleRate());
+            signalAnalyzer.process(samples, count);
         });
         
-        // Connect to real KiwiSDR server!
-        // Known working servers:
-        // - "kiwisdr.ve6slp.ca:8073" (Canada)
-        // - "sdr.ve3sun.com:8073" (Canada backup)
-        // - "kiwisdr.n3lga.com:8073" (USA)
+        client.setWaterfallEnabled(waterfall);
+        // A dropped stream comes back on its own, backing off while the server is down
+        client.setAutoReconnect(true);
+        
+        for (Standby& standby : standbys) {
+            standby.client.setAudioCallback([&standby](const float* samples, size_t count) {
+                standby.buffer.push(samples, count);
+            });
+            standby.client.setAutoReconnect(true);
+            standby.client.setPaused(true);
+        }
         
-        if (!client.connect("kiwisdr.ve6slp.ca:8073")) {
-            // Try backup server
-            client.connect("sdr.ve3sun.com:8073");
+        lanes[playingLane].buffer = &jitterBuffer;
+        lanes[playingLane].client = &client;
+    }
+    
+    // Not in the constructor: Rack builds modules it never runs, and on
+    // patch load dataFromJson comes later. By now the saved state is in,
+    // so the first handshake already carries the saved tuning and server.
+    // Returns immediately; every receiver in the patch races its servers
+    // on the I/O thread at once.
+    void onAdd() override {
+        updateTuning();
+        connectAll();
+        added = true;
+    }
+    
+    // Not the audio thread: Rack adds cables from the UI or the patch
+    // loader, with the engine held, so process() isn't running
+    void onPortChange(const PortChangeEvent& e) override {
+        if (e.type != Port::INPUT || e.portId != FREQ_CV_INPUT || !e.connecting || poly) return;
+        poly.reset(new PolyChannels);
+        std::vector<std::string> urls = liveServerUrls();
+        for (ExtraChannel& channel : poly->channels) {
+            channel.client.setAudioCallback([&channel](const float* samples, size_t count) {
+                channel.buffer.push(samples, count);
+            });
+            channel.client.setAutoReconnect(true);
+            channel.client.setPaused(true);
+            channel.client.setCompression(compression);
+            channel.client.setLocalDemodulation(localDemodulation);
+            channel.buffer.setTargetLatency(jitterBuffer.getTargetLatency());
+            if (added) channel.client.connect(urls);
+        }
+        resetExtraGroups();
+    }
+    
+    // Rack sends this after onAdd too. Resampler banks for the new rate get
+    // built here, off the audio thread; server rates are covered as they arrive.
+    void onSampleRateChange(const SampleRateChangeEvent& e) override {
+        PolyphaseResampler::prepareOutputRate(e.sampleRate);
+    }
+    
+    // The capture when one plays, else the live servers
+    std::vector<std::string> serverUrls() const {
+        if (!playbackPath.empty()) return {CAPTURE_URL_PREFIX + playbackPath};
+        return liveServerUrls();
+    }
+    
+    // The picked server on its own, or every known server fastest first
+    // (WebSDR/servers.txt, or the built-in list). Sessions are keyed by the
+    // set, not the order, so a picked server can't be a mere first choice.
+    std::vector<std::string> liveServerUrls() const {
+        if (!serverUrl.empty()) return {serverUrl};
+        return serverProber().rankedServers();
+    }
+    
+    // Not the audio thread: (re)connects the receiver, and the standbys and
+    // extra channels as they are, paused or not, on the same servers so
+    // they keep sharing sessions with it
+    void connectAll() {
+        client.connect(serverUrls());
+        std::vector<std::string> urls = liveServerUrls();
+        for (Standby& standby : standbys) {
+            standby.client.connect(urls);
         }
+        if (!poly) return;
+        for (ExtraChannel& channel : poly->channels) {
+            channel.client.connect(urls);
+        }
+    }
+    
+    // UI thread: moves every stream of this module over
+    void setServer(const std::string& url) {
+        serverUrl = url;
+        connectAll();
+    }
+    
+    // Recordings go here, named by when they started and where we were tuned
+    static std::string captureDirectory() {
+        return asset::user("WebSDR/captures");
+    }
+    
+    bool startRecording() {
+        std::string dir = captureDirectory();
+        system::createDirectories(dir);
+        char stamp[32];
+        std::time_t now = std::time(nullptr);
+        std::strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", std::localtime(&now));
+        std::string name = string::f("%s-%.0fkHz.wsdrcap", stamp, params[FREQ_PARAM].getValue() / 1000.0f);
+        return client.startRecording(system::join(dir, name));
     }
     
     ~WebSDRModule() {
         client.disconnect();
+        for (Standby& standby : standbys) {
+            standby.client.disconnect();
+        }
+        if (poly) {
+            for (ExtraChannel& channel : poly->channels) {
+                channel.client.disconnect();
+            }
+        }
     }
     
     void process(const ProcessArgs& args) override {
+        if (controlDivider.process()) {
+            processControl(args.sampleTime * controlDivider.getDivision());
+        }
+        
+        // Get audio sample, resampled from the server rate to engine rate
+        float sample = getResampledAudio(args.sampleRate);
+        const float* extra = extraBlock[audioBlockPos - 1];  // the same frame of the other channels
+        
+        // Apply gain and output
+        float gain = params[GAIN_PARAM].getValue() * 5.0f;
+        outputs[AUDIO_OUTPUT].setChannels(polyChannels);
+        outputs[AUDIO_OUTPUT].setVoltage(sample * gain);
+        for (int c = 1; c < polyChannels; c++) {
+            outputs[AUDIO_OUTPUT].setVoltage(extra[c - 1] * gain, c);
+        }
+    }
+    
+    // Control-rate work: presets, lights, tuning. deltaTime covers the whole division.
+    void processControl(float deltaTime) {
         // Handle preset buttons and gates
         float currentFreq = params[FREQ_PARAM].getValue();
         
@@ -156,41 +431,276 @@ struct WebSDRModule : Module {
             // Update preset lights
             if (presetSaved[i]) {
                 // Saved presets glow dimly
-                presetLightBrightness[i] = std::max(0.2f, presetLightBrightness[i] - args.sampleTime * 2.0f);
+                presetLightBrightness[i] = std::max(0.2f, presetLightBrightness[i] - deltaTime * 2.0f);
             } else {
                 // Unsaved presets fade out
-                presetLightBrightness[i] = std::max(0.0f, presetLightBrightness[i] - args.sampleTime * 2.0f);
+                presetLightBrightness[i] = std::max(0.0f, presetLightBrightness[i] - deltaTime * 2.0f);
             }
             lights[PRESET_LIGHT + i].setBrightness(presetLightBrightness[i]);
         }
         
-        // Update frequency if changed
-        static float lastFreq = 0.0f;
-        float freq = params[FREQ_PARAM].getValue();
-        if (fabs(freq - lastFreq) > 100.0f) {  // Only update if changed significantly
+        updateChannels();
+        float freq = updateTuning();
+        updateStandbys(freq);
+        
+        // Update connection light
+        lights[CONNECTION_LIGHT].setBrightness(client.isConnected() ? 1.0f : 0.0f);
+        
+        updateSignalOutputs();
+        updateDiagnostics(deltaTime);
+        publishToExpander(freq);
+    }
+    
+    // Hand frequency and mode changes to the clients, returns the first
+    // channel's frequency
+    float updateTuning() {
+        float freq = channelFrequency(0);
+        if (fabs(freq - lastFreq) > RETUNE_HZ) {
             client.setFrequency(freq);
             lastFreq = freq;
         }
         
-        // Update mode if changed
-        static float lastMode = -1.0f;
         float mode = params[MODE_PARAM].getValue();
         if (mode != lastMode) {
-            const char* modes[] = {"am", "fm", "usb", "lsb", "cw"};
-            int modeIdx = std::min(4, std::max(0, (int)mode));
-            client.setMode(modes[modeIdx]);
+            client.setMode(modeName(mode));
             lastMode = mode;
         }
+        if (!poly) return freq;
         
-        // Get audio sample with basic resampling
-        // WebSDR typically sends 12kHz, we need to resample to engine rate
-        float sample = getResampledAudio(args.sampleRate);
+        // The client coalesces a CV sweep into at most one retune per 1/retuneRate
+        for (int c = 1; c < polyChannels; c++) {
+            ExtraChannel& channel = poly->channels[c - 1];
+            float channelFreq = channelFrequency(c);
+            if (fabs(channelFreq - channel.freq) > RETUNE_HZ) {
+                channel.client.setFrequency(channelFreq);
+                channel.freq = channelFreq;
+            }
+            if (mode != channel.mode) {
+                channel.client.setMode(modeName(mode));
+                channel.mode = mode;
+            }
+        }
         
-        // Apply gain and output
-        outputs[AUDIO_OUTPUT].setVoltage(sample * params[GAIN_PARAM].getValue() * 5.0f);
+        // tuned first, so a resumed stream starts on its channel's frequency
+        for (ExtraChannel& channel : poly->channels) {
+            channel.client.setPaused(!channel.connected);
+        }
+        return freq;
+    }
+    
+    // Knob plus FREQ CV, 1V per MHz
+    float channelFrequency(int c) {
+        float freq = params[FREQ_PARAM].getValue() + inputs[FREQ_CV_INPUT].getPolyVoltage(c) * 1000000.0f;
+        return clamp(freq, 0.0f, 30000000.0f);
+    }
+    
+    // Follows the FREQ CV channel count
+    void updateChannels() {
+        if (!poly) return;
+        int count = clamp(inputs[FREQ_CV_INPUT].getChannels(), 1, MAX_CHANNELS);
+        polyChannels = count;
+        int wanted = live.load(std::memory_order_relaxed) ? count : 1;
         
-        // Update connection light
-        lights[CONNECTION_LIGHT].setBrightness(client.isConnected() ? 1.0f : 0.0f);
+        for (int c = 0; c < MAX_CHANNELS - 1; c++) {
+            ExtraChannel& channel = poly->channels[c];
+            bool streaming = c + 1 < wanted;
+            if (streaming && !channel.connected) {
+                // A fresh stream: whatever arrived while it was paused is from before
+                channel.buffer.clear();
+            } else if (!streaming && channel.connected) {
+                // Nothing it streamed may play once it's back: the ring and
+                // its slot's history in the resampler go now
+                channel.buffer.clear();
+                if (channel.group >= 0) leaveGroup(channel);
+            }
+            channel.connected = streaming;
+        }
+    }
+    
+    // Client mode for a MODE_PARAM value
+    static const char* modeName(float mode) {
+        const char* modes[] = {"am", "fm", "usb", "lsb", "cw"};
+        return modes[std::min(4, std::max(0, (int)mode))];
+    }
+    
+    // Asks for a standby on each of the first MAX_STANDBYS saved presets
+    // while hot standby is on, and puts whichever buffer holds the current
+    // frequency on air. The ones off air are trimmed to their target so they
+    // stay ready. Nothing here locks: the clients are tuned, resumed and
+    // paused lock-free.
+    void updateStandbys(float freq) {
+        Lane& playing = lanes[playingLane];
+        Lane& fading = lanes[1 - playingLane];
+        if (fadeTime >= CROSSFADE_SECONDS) fading.buffer = nullptr;
+        JitterBuffer* wanted = &jitterBuffer;
+        const WebSDRClient* wantedClient = &client;
+        
+        // A capture has no other stations to stand by on
+        int presets[MAX_STANDBYS];
+        int count = 0;
+        if (hotStandby.load(std::memory_order_relaxed) && live.load(std::memory_order_relaxed)) {
+            for (int i = 0; i < NUM_PRESETS && count < MAX_STANDBYS; i++) {
+                if (presetSaved[i]) presets[count++] = i;
+            }
+        }
+        
+        for (int s = 0; s < MAX_STANDBYS; s++) {
+            Standby& standby = standbys[s];
+            bool streaming = s < count;
+            if (streaming && !standby.connected) {
+                // A fresh stream: whatever the buffer held is from before
+                standby.buffer.clear();
+                standby.freq = 0.0f;
+                standby.mode = -1.0f;
+            }
+            standby.connected = streaming;
+            if (!standby.connected) {
+                standby.client.setPaused(true);
+                continue;
+            }
+            
+            // Tuned like the main receiver, so the two share a stream once it
+            // gets there. Saving a preset further up hands this standby over.
+            float presetFreq = presetFrequencies[presets[s]];
+            if (fabs(presetFreq - standby.freq) > RETUNE_HZ) {
+                standby.client.setFrequency(presetFreq);
+                standby.freq = presetFreq;
+                standby.buffer.clear();  // audio from the frequency before
+            }
+            float mode = params[MODE_PARAM].getValue();
+            if (mode != standby.mode) {
+                standby.client.setMode(modeName(mode));
+                standby.mode = mode;
+            }
+            // tuned first, so the stream starts on the preset
+            standby.client.setPaused(false);
+            
+            bool onAir = playing.buffer == &standby.buffer || fading.buffer == &standby.buffer;
+            if (wanted == &jitterBuffer && fabs(freq - standby.freq) <= RETUNE_HZ &&
+                (onAir || (standby.client.isConnected() && standby.buffer.isPrimed(standby.client.getSampleRate())))) {
+                wanted = &standby.buffer;
+                wantedClient = &standby.client;
+            }
+        }
+        
+        // One switch at a time; a recall during a fade waits for the next tick
+        if (wanted != playing.buffer && fadeTime >= CROSSFADE_SECONDS) {
+            switchTo(wanted, wantedClient);
+        }
+        
+        if (lanes[0].buffer != &jitterBuffer && lanes[1].buffer != &jitterBuffer) {
+            jitterBuffer.standby(client.getSampleRate());
+        }
+        for (Standby& standby : standbys) {
+            if (standby.connected && lanes[0].buffer != &standby.buffer && lanes[1].buffer != &standby.buffer) {
+                standby.buffer.standby(standby.client.getSampleRate());
+            }
+        }
+    }
+    
+    // Audio thread: puts buffer on air, fading over from the one playing now.
+    // A pointer swap, nothing is copied or reconnected.
+    void switchTo(JitterBuffer* buffer, const WebSDRClient* source) {
+        playingLane = 1 - playingLane;
+        Lane& lane = lanes[playingLane];
+        lane.buffer = buffer;
+        lane.client = source;
+        lane.resampler.reset();
+        fadeTime = 0.0f;
+    }
+    
+    // Settings the standbys and extra channels share with the main
+    // receiver, so that they can share its streams
+    void setCompression(bool enabled) {
+        compression = enabled;
+        client.setCompression(enabled);
+        for (Standby& standby : standbys) {
+            standby.client.setCompression(enabled);
+        }
+        if (!poly) return;
+        for (ExtraChannel& channel : poly->channels) {
+            channel.client.setCompression(enabled);
+        }
+    }
+    
+    void setLocalDemodulation(bool enabled) {
+        localDemodulation = enabled;
+        client.setLocalDemodulation(enabled);
+        for (Standby& standby : standbys) {
+            standby.client.setLocalDemodulation(enabled);
+        }
+        if (!poly) return;
+        for (ExtraChannel& channel : poly->channels) {
+            channel.client.setLocalDemodulation(enabled);
+        }
+    }
+    
+    void setTargetLatency(float seconds) {
+        jitterBuffer.setTargetLatency(seconds);
+        for (Standby& standby : standbys) {
+            standby.buffer.setTargetLatency(seconds);
+        }
+        if (!poly) return;
+        for (ExtraChannel& channel : poly->channels) {
+            channel.buffer.setTargetLatency(seconds);
+        }
+    }
+    
+    void updateSignalOutputs() {
+        if (signalAnalyzer.update()) {
+            signal = signalAnalyzer.read();
+        }
+        // The server's S-meter when its packets carry one, else the audio level
+        float rssi = client.getRssi();
+        float strength = (rssi > WebSDRClient::NO_RSSI) ? (rssi + 127.0f) / 10.0f : signal.level * 10.0f;
+        outputs[SIGNAL_STRENGTH_OUTPUT].setVoltage(clamp(strength, 0.0f, 10.0f));
+        outputs[CARRIER_OUTPUT].setVoltage(signal.carrier ? 10.0f : 0.0f);
+        snrDb.store(signal.snrDb, std::memory_order_relaxed);
+        carrierFreq.store(signal.carrier ? signal.carrierFreq : 0.0f, std::memory_order_relaxed);
+    }
+    
+    void updateDiagnostics(float deltaTime) {
+        const WebSDRClient::Stats& stats = client.getStats();
+        packetRateTime += deltaTime;
+        if (packetRateTime >= 1.0f) {
+            uint64_t packets = stats.audioPackets.load(std::memory_order_relaxed);
+            packetsPerSecond.store((float)(packets - lastPacketCount) / packetRateTime, std::memory_order_relaxed);
+            lastPacketCount = packets;
+            packetRateTime = 0.0f;
+        }
+        
+        if (!outputs[DIAG_OUTPUT].isConnected()) return;
+        
+        const JitterBuffer::Stats& buffer = jitterBuffer.getStats();
+        Output& out = outputs[DIAG_OUTPUT];
+        out.setChannels(NUM_DIAG_CHANNELS);
+        out.setVoltage(buffer.fill.load(std::memory_order_relaxed) * 10.0f, DIAG_FILL);
+        out.setVoltage((buffer.trim.load(std::memory_order_relaxed) - 1.0f) * 1000.0f, DIAG_DRIFT);
+        out.setVoltage(packetsPerSecond.load(std::memory_order_relaxed) * 0.1f, DIAG_PACKETS);
+        out.setVoltage(stats.decodeMicros.load(std::memory_order_relaxed) * 0.1f, DIAG_DECODE);
+        out.setVoltage(blockMicros.load(std::memory_order_relaxed) * 0.1f, DIAG_BLOCK);
+        out.setVoltage(std::min(10.0f, (float)stats.reconnects.load(std::memory_order_relaxed)), DIAG_RECONNECTS);
+        out.setVoltage(std::min(10.0f, stats.packetsLost.load(std::memory_order_relaxed) * 0.1f), DIAG_LOST);
+    }
+    
+    // Send the latest waterfall line and status to a WebSDRExpander on the right
+    void publishToExpander(float freq) {
+        if (client.pollWaterfall(waterfallBins)) {
+            waterfallSequence++;
+        }
+        
+        Module* expander = rightExpander.module;
+        if (!expander || expander->model != modelWebSDRExpander) return;
+        
+        WebSDRExpanderMessage* msg = (WebSDRExpanderMessage*) expander->leftExpander.producerMessage;
+        if (!msg) return;
+        
+        // Messages are double-buffered, so every flip carries the full line
+        std::copy(waterfallBins, waterfallBins + WebSDRExpanderMessage::SPECTRUM_BINS, msg->spectrum);
+        msg->spectrumSequence = waterfallSequence;
+        msg->frequency = freq;
+        msg->connected = client.isConnected();
+        expander->leftExpander.requestMessageFlip();
     }
     
     void handlePresetPress(int preset, float currentFreq) {
@@ -211,51 +721,372 @@ struct WebSDRModule : Module {
     }
     
     float getResampledAudio(float engineRate) {
-        const float sourceRate = 12000.0f;  // KiwiSDR sample rate
-        const float resampleRatio = sourceRate / engineRate;
-        
-        std::lock_guard<std::mutex> lock(bufferMutex);
-        
-        // Simple linear interpolation resampling
-        resamplePhase += resampleRatio;
-        
-        if (resamplePhase >= 1.0f) {
-            // Advance read position
-            int advance = (int)resamplePhase;
-            resamplePhase -= advance;
+        if (audioBlockPos >= AUDIO_BLOCK_SIZE) {
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
             
-            for (int i = 0; i < advance; i++) {
-                if (readPos != writePos) {
-                    lastSample = audioBuffer[readPos];
-                    readPos = (readPos + 1) % audioBuffer.size();
+            resampleBlock(lanes[playingLane], engineRate, audioBlock);
+            if (fadeTime < CROSSFADE_SECONDS) {
+                // Linear crossfade from the buffer that was on air, a sample at a time
+                resampleBlock(lanes[1 - playingLane], engineRate, fadeBlock);
+                for (int i = 0; i < AUDIO_BLOCK_SIZE; i++) {
+                    float mix = std::min(1.0f, (fadeTime + i / engineRate) / CROSSFADE_SECONDS);
+                    audioBlock[i] = audioBlock[i] * mix + fadeBlock[i] * (1.0f - mix);
                 }
+                fadeTime += AUDIO_BLOCK_SIZE / engineRate;
             }
+            if (polyChannels > 1) resampleExtraChannels(engineRate);
+            audioBlockPos = 0;
+            
+            float micros = std::chrono::duration<float, std::micro>(std::chrono::steady_clock::now() - start).count();
+            float average = blockMicros.load(std::memory_order_relaxed);
+            blockMicros.store(average + (micros - average) * 0.01f, std::memory_order_relaxed);
+        }
+        return audioBlock[audioBlockPos++];
+    }
+    
+    // One pass per rate group: its members share a phase, and being on one
+    // server clock, their trims are averaged into one
+    void resampleExtraChannels(float engineRate) {
+        int count = polyChannels - 1;
+        for (int c = 0; c < MAX_CHANNELS - 1; c++) {
+            ExtraChannel& channel = poly->channels[c];
+            double rate = (c < count) ? channel.client.getSampleRate() : 0.0;
+            if (channel.group >= 0 && poly->groups[channel.group].rate != rate) leaveGroup(channel);
+            if (channel.group < 0 && c < count) joinGroup(channel, rate);
         }
         
-        // Get next sample for interpolation
-        float nextSample = lastSample;
-        if (readPos != writePos) {
-            size_t peekPos = readPos;
-            nextSample = audioBuffer[peekPos];
+        for (int g = 0; g < MAX_CHANNELS - 1; g++) {
+            RateGroup& group = poly->groups[g];
+            if (group.members == 0) continue;
+            
+            double trim = 0.0;
+            for (int c = 0; c < count; c++) {
+                if (poly->channels[c].group == g) {
+                    trim += poly->channels[c].buffer.update(group.rate, AUDIO_BLOCK_SIZE / engineRate);
+                }
+            }
+            group.resampler.setRates(group.rate, engineRate);
+            group.resampler.setRatioTrim(trim / group.members);
+            group.resampler.process(group.sources, &groupBlock[0][0], AUDIO_BLOCK_SIZE);
+            
+            for (int c = 0; c < count; c++) {
+                if (poly->channels[c].group != g) continue;
+                int slot = poly->channels[c].slot;
+                for (int i = 0; i < AUDIO_BLOCK_SIZE; i++) {
+                    extraBlock[i][c] = groupBlock[i][slot];
+                }
+            }
         }
+    }
+    
+    // Into the group at rate, or a free one, in the lowest free slot. Free
+    // slots and empty groups are left clear by leaveGroup(), so the channel
+    // starts from silence.
+    void joinGroup(ExtraChannel& channel, double rate) {
+        int free = -1;
+        for (int g = 0; g < MAX_CHANNELS - 1; g++) {
+            if (poly->groups[g].members > 0 && poly->groups[g].rate == rate) {
+                free = g;
+                break;
+            }
+            if (free < 0 && poly->groups[g].members == 0) free = g;
+        }
+        RateGroup& group = poly->groups[free];  // one per channel at most, so there's always one
+        if (group.members == 0) group.rate = rate;
         
-        // Linear interpolation
-        return lastSample + (nextSample - lastSample) * resamplePhase;
+        int slot = 0;
+        while (group.sources[slot] != &idleSource) slot++;
+        group.sources[slot] = &channel.buffer;
+        group.resampler.setChannels(std::max(group.resampler.getChannels(), slot + 1));
+        group.members++;
+        channel.group = free;
+        channel.slot = slot;
+    }
+    
+    void leaveGroup(ExtraChannel& channel) {
+        RateGroup& group = poly->groups[channel.group];
+        group.sources[channel.slot] = &idleSource;
+        group.resampler.clearChannel(channel.slot);
+        group.members--;
+        if (group.members == 0) group.resampler.reset();
+        
+        // Trailing free slots aren't filtered at all
+        int used = group.resampler.getChannels();
+        while (used > 1 && group.sources[used - 1] == &idleSource) used--;
+        group.resampler.setChannels(used);
+        channel.group = -1;
+    }
+    
+    void resetExtraGroups() {
+        for (RateGroup& group : poly->groups) {
+            group.rate = 0.0;
+            group.members = 0;
+            std::fill(group.sources, group.sources + MAX_CHANNELS, &idleSource);
+            group.resampler.setChannels(1);
+            group.resampler.reset();
+        }
+        for (ExtraChannel& channel : poly->channels) {
+            channel.group = -1;
+        }
+    }
+    
+    void resampleBlock(Lane& lane, float engineRate, float* out) {
+        // Only rebuilds the filter bank when the server or engine rate changes
+        double serverRate = lane.client->getSampleRate();
+        lane.resampler.setRates(serverRate, engineRate);
+        // Drift between the two clocks is taken up by the ratio, not by dropping samples
+        lane.resampler.setRatioTrim(lane.buffer->update(serverRate, AUDIO_BLOCK_SIZE / engineRate));
+        lane.resampler.process(*lane.buffer, out, AUDIO_BLOCK_SIZE);
     }
     
     void onReset() override {
-        std::lock_guard<std::mutex> lock(bufferMutex);
-        std::fill(audioBuffer.begin(), audioBuffer.end(), 0.0f);
-        readPos = 0;
-        writePos = 0;
-        lastSample = 0.0f;
-        resamplePhase = 0.0f;
+        // Engine isn't running process() here, so we can act as the consumer
+        jitterBuffer.clear();
+        for (Standby& standby : standbys) {
+            standby.buffer.clear();
+        }
+        if (poly) {
+            for (ExtraChannel& channel : poly->channels) {
+                channel.buffer.clear();
+            }
+            resetExtraGroups();
+        }
+        for (Lane& lane : lanes) {
+            lane.buffer = nullptr;
+            lane.resampler.reset();
+        }
+        lanes[playingLane].buffer = &jitterBuffer;
+        lanes[playingLane].client = &client;
+        fadeTime = CROSSFADE_SECONDS;
+        audioBlockPos = AUDIO_BLOCK_SIZE;
         
         // Don't clear presets on reset - keep the station presets
     }
     
-    // Context menu for station browser
-    void appendContextMenu(Menu* menu) override {
+    // Context menu for station browser, called from WebSDRModuleWidget
+    void appendContextMenu(Menu* menu) {
+        menu->addChild(new MenuSeparator);
+        
+        float rssi = client.getRssi();
+        if (rssi > WebSDRClient::NO_RSSI) {
+            menu->addChild(createMenuLabel(string::f("S-meter %.0f dBm", rssi)));
+        }
+        float carrier = carrierFreq.load(std::memory_order_relaxed);
+        if (carrier > 0.0f) {
+            menu->addChild(createMenuLabel(string::f("SNR %.0f dB, carrier at %.0f Hz", snrDb.load(), carrier)));
+        } else {
+            menu->addChild(createMenuLabel(string::f("SNR %.0f dB, no carrier", snrDb.load())));
+        }
+        
+        // Server selection, with what the last probe found
+        struct ServerItem : MenuItem {
+            WebSDRModule* module;
+            std::string url;
+            void onAction(const event::Action& e) override {
+                module->setServer(url);
+            }
+        };
+        
+        menu->addChild(createSubmenuItem("Server", serverUrl.empty() ? "Fastest" : serverUrl, [=](Menu* menu) {
+            ServerItem* fastest = new ServerItem;
+            fastest->text = "Fastest available";
+            fastest->module = this;
+            fastest->rightText = serverUrl.empty() ? "✓" : "";
+            menu->addChild(fastest);
+            menu->addChild(new MenuSeparator);
+            
+            for (const ServerStatus& status : serverProber().getStatuses()) {
+                std::string found;
+                if (status.probed && !status.reachable) {
+                    found = "unreachable";
+                } else if (status.probed && status.maxUsers > 0) {
+                    found = string::f("%.0f ms, %d/%d users", status.latencyMs(), status.users, status.maxUsers);
+                } else if (status.probed) {
+                    found = string::f("%.0f ms", status.latencyMs());
+                }
+                
+                ServerItem* item = new ServerItem;
+                item->text = status.url;
+                item->module = this;
+                item->url = status.url;
+                item->rightText = found + ((serverUrl == status.url) ? " ✓" : "");
+                menu->addChild(item);
+            }
+        }));
+        
+        // Control rate divider
+        struct ControlRateItem : MenuItem {
+            WebSDRModule* module;
+            int division;
+            void onAction(const event::Action& e) override {
+                module->controlDivision = division;
+                module->controlDivider.setDivision(division);
+            }
+        };
+        
+        menu->addChild(createSubmenuItem("Control rate", string::f("1/%d", controlDivision), [=](Menu* menu) {
+            for (int division : {1, 8, 32, 128}) {
+                ControlRateItem* item = new ControlRateItem;
+                item->text = (division == 1) ? "Every sample" : string::f("Every %d samples", division);
+                item->module = this;
+                item->division = division;
+                item->rightText = (controlDivision == division) ? "✓" : "";
+                menu->addChild(item);
+            }
+        }));
+        
+        // Jitter buffer latency and how it's coping
+        struct LatencyItem : MenuItem {
+            WebSDRModule* module;
+            float latency;
+            void onAction(const event::Action& e) override {
+                // the rings keep their size, only the target moves
+                module->setTargetLatency(latency);
+            }
+        };
+        
+        float latency = jitterBuffer.getTargetLatency();
+        menu->addChild(createSubmenuItem("Target latency", string::f("%.0f ms", latency * 1000.0f), [=](Menu* menu) {
+            const JitterBuffer::Stats& stats = jitterBuffer.getStats();
+            menu->addChild(createMenuLabel(string::f("Buffered %.0f ms, %u underruns, %u overruns",
+                stats.fill.load() * 1000.0f, (unsigned)stats.underruns.load(), (unsigned)stats.overruns.load())));
+            
+            for (float option : {MIN_LATENCY, 0.1f, 0.25f, 0.5f, 1.0f, MAX_LATENCY}) {
+                LatencyItem* item = new LatencyItem;
+                item->text = string::f("%.0f ms", option * 1000.0f);
+                item->module = this;
+                item->latency = option;
+                item->rightText = (latency == option) ? "✓" : "";
+                menu->addChild(item);
+            }
+        }));
+        
+        // Live counters, read without stopping the audio or network threads
+        menu->addChild(createSubmenuItem("Diagnostics", "", [=](Menu* menu) {
+            const WebSDRClient::Stats& stats = client.getStats();
+            const JitterBuffer::Stats& buffer = jitterBuffer.getStats();
+            menu->addChild(createMenuLabel(string::f("Received %.1f MB in %llu frames",
+                stats.bytesReceived.load() / 1e6, (unsigned long long)stats.framesReceived.load())));
+            menu->addChild(createMenuLabel(string::f("Packets %.1f/s, decode %.1f us",
+                packetsPerSecond.load(), stats.decodeMicros.load())));
+            menu->addChild(createMenuLabel(string::f("Buffer %.0f ms, drift %+.0f ppm",
+                buffer.fill.load() * 1000.0f, (buffer.trim.load() - 1.0f) * 1e6f)));
+            menu->addChild(createMenuLabel(string::f("Block %.1f us per %d samples",
+                blockMicros.load(), AUDIO_BLOCK_SIZE)));
+            menu->addChild(createMenuLabel(string::f("Reconnects %u, packets lost %u",
+                (unsigned)stats.reconnects.load(), (unsigned)stats.packetsLost.load())));
+        }));
+        
+        // Audio compression
+        struct CompressionItem : MenuItem {
+            WebSDRModule* module;
+            void onAction(const event::Action& e) override {
+                module->setCompression(!module->compression);
+            }
+        };
+        
+        CompressionItem* compressionItem = new CompressionItem;
+        compressionItem->text = "Compressed audio (ADPCM)";
+        compressionItem->module = this;
+        compressionItem->rightText = compression ? "✓" : "";
+        menu->addChild(compressionItem);
+        
+        // Local IQ demodulation
+        struct LocalDemodulationItem : MenuItem {
+            WebSDRModule* module;
+            void onAction(const event::Action& e) override {
+                module->setLocalDemodulation(!module->localDemodulation);
+            }
+        };
+        
+        LocalDemodulationItem* localItem = new LocalDemodulationItem;
+        localItem->text = "Demodulate locally (IQ, uncompressed)";
+        localItem->module = this;
+        localItem->rightText = localDemodulation ? "✓" : "";
+        menu->addChild(localItem);
+        
+        // Saved presets streaming in the background for a gapless recall
+        struct HotStandbyItem : MenuItem {
+            WebSDRModule* module;
+            void onAction(const event::Action& e) override {
+                module->hotStandby = !module->hotStandby;
+            }
+        };
+        
+        HotStandbyItem* standbyItem = new HotStandbyItem;
+        standbyItem->text = string::f("Hot-standby presets (first %d, a server slot each)", MAX_STANDBYS);
+        standbyItem->module = this;
+        standbyItem->rightText = hotStandby ? "✓" : "";
+        menu->addChild(standbyItem);
+        
+        // Record the stream to disk, or play a recording back as the server
+        struct RecordItem : MenuItem {
+            WebSDRModule* module;
+            void onAction(const event::Action& e) override {
+                if (module->client.isRecording()) {
+                    module->client.stopRecording();
+                } else {
+                    module->startRecording();
+                }
+            }
+        };
+        
+        RecordItem* recordItem = new RecordItem;
+        recordItem->text = "Record session";
+        recordItem->module = this;
+        if (client.isRecording()) {
+            const CaptureRecorder& recorder = client.getRecorder();
+            recordItem->rightText = string::f("%.1f MB", recorder.getBytesWritten() / 1e6);
+            if (recorder.getDropped() > 0) recordItem->rightText += string::f(", %u dropped", recorder.getDropped());
+        }
+        menu->addChild(recordItem);
+        
+        struct PlaybackItem : MenuItem {
+            WebSDRModule* module;
+            std::string path;  // empty for the live servers
+            void onAction(const event::Action& e) override {
+                module->playbackPath = path;
+                module->live = path.empty();
+                module->client.connect(module->serverUrls());
+            }
+        };
+        
+        menu->addChild(createSubmenuItem("Play back", playbackPath.empty() ? "" : system::getFilename(playbackPath), [=](Menu* menu) {
+            PlaybackItem* liveItem = new PlaybackItem;
+            liveItem->text = "Live servers";
+            liveItem->module = this;
+            liveItem->rightText = playbackPath.empty() ? "✓" : "";
+            menu->addChild(liveItem);
+            
+            std::vector<std::string> entries = system::getEntries(captureDirectory());
+            std::sort(entries.begin(), entries.end());
+            if (!entries.empty()) menu->addChild(new MenuSeparator);
+            for (const std::string& entry : entries) {
+                if (system::getExtension(entry) != ".wsdrcap") continue;
+                PlaybackItem* item = new PlaybackItem;
+                item->text = system::getFilename(entry);
+                item->module = this;
+                item->path = entry;
+                item->rightText = (playbackPath == entry) ? "✓" : "";
+                menu->addChild(item);
+            }
+        }));
+        
+        // Server waterfall for the expander
+        struct WaterfallItem : MenuItem {
+            WebSDRModule* module;
+            void onAction(const event::Action& e) override {
+                module->waterfall = !module->waterfall;
+                module->client.setWaterfallEnabled(module->waterfall);
+            }
+        };
+        
+        WaterfallItem* waterfallItem = new WaterfallItem;
+        waterfallItem->text = "Server waterfall to expander";
+        waterfallItem->module = this;
+        waterfallItem->rightText = waterfall ? "✓" : "";
+        menu->addChild(waterfallItem);
+        
         menu->addChild(new MenuSeparator);
         menu->addChild(createMenuLabel("Quick Tune"));
         
@@ -278,75 +1109,35 @@ struct WebSDRModule : Module {
             }
         };
         
-        // Time signals
-        menu->addChild(createSubmenuItem("Time Signals", "", [=](Menu* menu) {
-            for (int i = 0; i < NUM_STATIONS; i++) {
-                if (strstr(STATIONS[i].name, "wwv") || strstr(STATIONS[i].name, "chv")) {
-                    StationItem* item = new StationItem;
-                    item->text = string::f("%s (%.3f MHz)", STATIONS[i].name, STATIONS[i].freq / 1000000.0f);
-                    item->rightText = STATIONS[i].time;
-                    item->module = this;
-                    item->station = &STATIONS[i];
-                    menu->addChild(item);
-                }
-            }
-        }));
-        
-        // International broadcasters
-        menu->addChild(createSubmenuItem("International Radio", "", [=](Menu* menu) {
-            for (int i = 0; i < NUM_STATIONS; i++) {
-                if (strstr(STATIONS[i].name, "bbc") || strstr(STATIONS[i].name, "voa") || 
-                    strstr(STATIONS[i].name, "rhc") || strstr(STATIONS[i].name, "cri")) {
-                    StationItem* item = new StationItem;
-                    item->text = string::f("%s (%.3f MHz)", STATIONS[i].name, STATIONS[i].freq / 1000000.0f);
-                    item->rightText = STATIONS[i].time;
-                    item->module = this;
-                    item->station = &STATIONS[i];
-                    menu->addChild(item);
-                }
-            }
-        }));
-        
-        // Amateur radio
-        menu->addChild(createSubmenuItem("Amateur Radio", "", [=](Menu* menu) {
-            for (int i = 0; i < NUM_STATIONS; i++) {
-                if (strstr(STATIONS[i].name, "ssb") || strstr(STATIONS[i].name, "ft8")) {
-                    StationItem* item = new StationItem;
-                    item->text = string::f("%s (%.3f MHz)", STATIONS[i].name, STATIONS[i].freq / 1000000.0f);
-                    item->rightText = STATIONS[i].time;
-                    item->module = this;
-                    item->station = &STATIONS[i];
-                    menu->addChild(item);
-                }
-            }
-        }));
+        // One submenu per category, plus everything
+        struct CategoryMenu {
+            const char* title;
+            uint32_t categories;
+        };
+        static const CategoryMenu CATEGORY_MENUS[] = {
+            {"Time Signals", StationDatabase::CATEGORY_TIME},
+            {"International Radio", StationDatabase::CATEGORY_BROADCAST},
+            {"Amateur Radio", StationDatabase::CATEGORY_AMATEUR},
+            {"Mystery Stations", StationDatabase::CATEGORY_MYSTERY},
+            {"All Stations", StationDatabase::CATEGORY_ALL}
+        };
         
-        // Mystery stations
-        menu->addChild(createSubmenuItem("Mystery Stations", "", [=](Menu* menu) {
-            for (int i = 0; i < NUM_STATIONS; i++) {
-                if (strstr(STATIONS[i].name, "uvb") || strstr(STATIONS[i].name, "hfgcs") || 
-                    strstr(STATIONS[i].name, "pirate")) {
+        for (const CategoryMenu& category : CATEGORY_MENUS) {
+            uint32_t mask = category.categories;
+            menu->addChild(createSubmenuItem(category.title, "", [=](Menu* menu) {
+                std::vector<int> indices;
+                stationDatabase().filter(mask, indices);
+                for (int i : indices) {
+                    const Station& station = stationDatabase().get(i);
                     StationItem* item = new StationItem;
-                    item->text = string::f("%s (%.3f MHz)", STATIONS[i].name, STATIONS[i].freq / 1000000.0f);
-                    item->rightText = STATIONS[i].time;
+                    item->text = string::f("%s (%.3f MHz)", station.name, station.freq / 1000000.0f);
+                    item->rightText = station.time;
                     item->module = this;
-                    item->station = &STATIONS[i];
+                    item->station = &station;
                     menu->addChild(item);
                 }
-            }
-        }));
-        
-        // All stations
-        menu->addChild(createSubmenuItem("All Stations", "", [=](Menu* menu) {
-            for (int i = 0; i < NUM_STATIONS; i++) {
-                StationItem* item = new StationItem;
-                item->text = string::f("%s (%.3f MHz)", STATIONS[i].name, STATIONS[i].freq / 1000000.0f);
-                item->rightText = STATIONS[i].time;
-                item->module = this;
-                item->station = &STATIONS[i];
-                menu->addChild(item);
-            }
-        }));
+            }));
+        }
     }
     
     json_t* dataToJson() override {
@@ -361,6 +1152,31 @@ struct WebSDRModule : Module {
             json_array_append_new(presetsJ, presetJ);
         }
         json_object_set_new(rootJ, "presets", presetsJ);
+        json_object_set_new(rootJ, "controlDivision", json_integer(controlDivision));
+        json_object_set_new(rootJ, "compression", json_boolean(compression));
+        json_object_set_new(rootJ, "localDemodulation", json_boolean(localDemodulation));
+        json_object_set_new(rootJ, "waterfall", json_boolean(waterfall));
+        json_object_set_new(rootJ, "hotStandby", json_boolean(hotStandby));
+        json_object_set_new(rootJ, "latency", json_real(jitterBuffer.getTargetLatency()));
+        json_object_set_new(rootJ, "serverUrl", json_string(serverUrl.c_str()));
+        json_object_set_new(rootJ, "playback", json_string(playbackPath.c_str()));
+        
+        // Snapshot for bug reports, not read back
+        const WebSDRClient::Stats& stats = client.getStats();
+        const JitterBuffer::Stats& buffer = jitterBuffer.getStats();
+        json_t* diagJ = json_object();
+        json_object_set_new(diagJ, "bytesReceived", json_integer((json_int_t)stats.bytesReceived.load()));
+        json_object_set_new(diagJ, "framesReceived", json_integer((json_int_t)stats.framesReceived.load()));
+        json_object_set_new(diagJ, "packetsPerSecond", json_real(packetsPerSecond.load()));
+        json_object_set_new(diagJ, "decodeMicros", json_real(stats.decodeMicros.load()));
+        json_object_set_new(diagJ, "blockMicros", json_real(blockMicros.load()));
+        json_object_set_new(diagJ, "bufferFill", json_real(buffer.fill.load()));
+        json_object_set_new(diagJ, "driftPpm", json_real((buffer.trim.load() - 1.0f) * 1e6f));
+        json_object_set_new(diagJ, "underruns", json_integer(buffer.underruns.load()));
+        json_object_set_new(diagJ, "overruns", json_integer(buffer.overruns.load()));
+        json_object_set_new(diagJ, "reconnects", json_integer(stats.reconnects.load()));
+        json_object_set_new(diagJ, "packetsLost", json_integer(stats.packetsLost.load()));
+        json_object_set_new(rootJ, "diagnostics", diagJ);
         
         return rootJ;
     }
@@ -380,6 +1196,55 @@ struct WebSDRModule : Module {
                 }
             }
         }
+        
+        json_t* controlDivisionJ = json_object_get(rootJ, "controlDivision");
+        if (controlDivisionJ) {
+            controlDivision = std::max(1, (int)json_integer_value(controlDivisionJ));
+            controlDivider.setDivision(controlDivision);
+        }
+        
+        json_t* compressionJ = json_object_get(rootJ, "compression");
+        if (compressionJ) setCompression(json_boolean_value(compressionJ));
+        
+        json_t* localDemodulationJ = json_object_get(rootJ, "localDemodulation");
+        if (localDemodulationJ) setLocalDemodulation(json_boolean_value(localDemodulationJ));
+        
+        json_t* latencyJ = json_object_get(rootJ, "latency");
+        if (latencyJ) setTargetLatency(clamp((float)json_number_value(latencyJ), MIN_LATENCY, MAX_LATENCY));
+        
+        json_t* waterfallJ = json_object_get(rootJ, "waterfall");
+        if (waterfallJ) {
+            waterfall = json_boolean_value(waterfallJ);
+            client.setWaterfallEnabled(waterfall);
+        }
+        
+        // the standbys come up at control rate, once the module runs
+        json_t* hotStandbyJ = json_object_get(rootJ, "hotStandby");
+        if (hotStandbyJ) hotStandby = json_boolean_value(hotStandbyJ);
+        
+        // A rehearsal patch comes back playing its capture, anything else
+        // comes back live, even onto a module that was playing one
+        json_t* playbackJ = json_object_get(rootJ, "playback");
+        const char* playback = playbackJ ? json_string_value(playbackJ) : nullptr;
+        std::string path = playback ? playback : "";
+        bool reconnect = false;
+        if (path != playbackPath) {
+            playbackPath = path;
+            live = path.empty();
+            reconnect = true;
+        }
+        
+        json_t* serverUrlJ = json_object_get(rootJ, "serverUrl");
+        const char* url = serverUrlJ ? json_string_value(serverUrlJ) : nullptr;
+        std::string server = url ? url : "";
+        
+        // on patch load onAdd connects; this is for presets applied to a running module
+        if (server != serverUrl) {
+            if (added) setServer(server);
+            else serverUrl = server;
+        } else if (reconnect && added) {
+            client.connect(serverUrls());
+        }
     }
 };
 
@@ -435,8 +1300,9 @@ struct WebSDRModuleWidget : ModuleWidget {
         addChild(createWidget<ScrewSilver>(Vec(15, 365)));
         addChild(createWidget<ScrewSilver>(Vec(box.size.x - 30, 365)));
         
-        // Frequency knob (centered)
+        // Frequency knob (centered), and its CV to the left
         addParam(createParamCentered<RoundBigBlackKnob>(Vec(75, 100), module, WebSDRModule::FREQ_PARAM));
+        addInput(createInputCentered<PJ301MPort>(Vec(25, 100), module, WebSDRModule::FREQ_CV_INPUT));
         
         // Gain knob (centered)
         addParam(createParamCentered<RoundBlackKnob>(Vec(75, 160), module, WebSDRModule::GAIN_PARAM));
@@ -474,6 +1340,11 @@ struct WebSDRModuleWidget : ModuleWidget {
         
         // Audio output (centered)
         addOutput(createOutputCentered<PJ301MPort>(Vec(75, 360), module, WebSDRModule::AUDIO_OUTPUT));
+        addOutput(createOutputCentered<PJ301MPort>(Vec(109, 357), module, WebSDRModule::DIAG_OUTPUT));
+        
+        // Signal outputs, right of the gain and mode knobs
+        addOutput(createOutputCentered<PJ301MPort>(Vec(125, 160), module, WebSDRModule::SIGNAL_STRENGTH_OUTPUT));
+        addOutput(createOutputCentered<PJ301MPort>(Vec(125, 220), module, WebSDRModule::CARRIER_OUTPUT));
         
         // Connection light (centered)
         addChild(createLightCentered<SmallLight<GreenLight>>(Vec(75, 40), module, WebSDRModule::CONNECTION_LIGHT));
@@ -485,6 +1356,11 @@ struct WebSDRModuleWidget : ModuleWidget {
         display->box.size = Vec(80, 20);
         addChild(display);
     }
+    
+    void appendContextMenu(Menu* menu) override {
+        WebSDRModule* module = dynamic_cast<WebSDRModule*>(this->module);
+        if (module) module->appendContextMenu(menu);
+    }
 };
 
 Model* modelWebSDRReceiver = createModel<WebSDRModule, WebSDRModuleWidget>("WebSDRReceiver");
\ No newline at end of file
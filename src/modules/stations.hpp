@@ -1,3 +1,4 @@
+#pragma once
 // known shortwave stations that are often active
 // frequencies in hz, times in utc
 
@@ -86,27 +87,3 @@ static const int FAVORITES[] = {
     31,  // uvb-76 buzzer
     35,  // pirate radio
 };
-
-// get station by index
-inline const Station* getStation(int index) {
-    if (index >= 0 && index < NUM_STATIONS) {
-        return &STATIONS[index];
-    }
-    return nullptr;
-}
-
-// find nearest station to frequency
-inline const Station* findNearestStation(float freq) {
-    const Station* nearest = nullptr;
-    float minDiff = 1000000.0f;  // 1mhz max diff
-    
-    for (int i = 0; i < NUM_STATIONS; i++) {
-        float diff = fabsf(STATIONS[i].freq - freq);
-        if (diff < minDiff) {
-            minDiff = diff;
-            nearest = &STATIONS[i];
-        }
-    }
-    
-    return nearest;
-}
\ No newline at end of file
@@ -0,0 +1,92 @@
+#include "AsyncLog.hpp"
+#include <chrono>
+#include <cstdarg>
+#include <cstdio>
+
+constexpr size_t AsyncLog::CAPACITY;
+constexpr size_t AsyncLog::TEXT_SIZE;
+constexpr int AsyncLog::DRAIN_INTERVAL_MS;
+
+AsyncLog::AsyncLog() {
+    for (size_t i = 0; i < CAPACITY; i++) {
+        slots[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    thread = std::thread(&AsyncLog::drainLoop, this);
+}
+
+AsyncLog::~AsyncLog() {
+    running = false;
+    if (thread.joinable()) thread.join();
+}
+
+bool AsyncLog::write(Level level, const char* format, ...) {
+    // Claim a slot (bounded multi-producer queue: a slot is free for
+    // position pos when its sequence equals pos)
+    size_t pos = writePos.load(std::memory_order_relaxed);
+    Slot* slot;
+    for (;;) {
+        slot = &slots[pos & (CAPACITY - 1)];
+        size_t sequence = slot->sequence.load(std::memory_order_acquire);
+        intptr_t diff = (intptr_t)sequence - (intptr_t)pos;
+        if (diff == 0) {
+            if (writePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+        } else if (diff < 0) {
+            // full: the drain thread hasn't caught up
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        } else {
+            pos = writePos.load(std::memory_order_relaxed);
+        }
+    }
+    
+    slot->level = level;
+    va_list args;
+    va_start(args, format);
+    vsnprintf(slot->text, TEXT_SIZE, format, args);
+    va_end(args);
+    slot->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+}
+
+bool AsyncLog::drainOne() {
+    Slot& slot = slots[readPos & (CAPACITY - 1)];
+    if (slot.sequence.load(std::memory_order_acquire) != readPos + 1) return false;
+    
+    emit(slot.level, slot.text);
+    slot.sequence.store(readPos + CAPACITY, std::memory_order_release);
+    readPos++;
+    return true;
+}
+
+void AsyncLog::drainLoop() {
+    while (running) {
+        while (drainOne()) {}
+        
+        uint32_t lost = dropped.load(std::memory_order_relaxed);
+        if (lost != reportedDropped) {
+            char text[64];
+            snprintf(text, sizeof(text), "%u log messages dropped", (unsigned)(lost - reportedDropped));
+            emit(LEVEL_WARN, text);
+            reportedDropped = lost;
+        }
+        
+        std::this_thread::sleep_for(std::chrono::milliseconds(DRAIN_INTERVAL_MS));
+    }
+    
+    // whatever was logged during shutdown
+    while (drainOne()) {}
+}
+
+void AsyncLog::emit(Level level, const char* text) {
+    Sink target = sink.load();
+    if (target) {
+        target(level, text);
+    } else {
+        fprintf(stderr, "[WebSDR] %s\n", text);
+    }
+}
+
+AsyncLog& asyncLog() {
+    static AsyncLog log;
+    return log;
+}
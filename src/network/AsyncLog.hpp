@@ -0,0 +1,71 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+
+// Logging that is safe to call from the audio and network threads.
+//
+// Callers only format into a preallocated slot of a lock-free ring; a
+// background thread drains the ring and hands each line to the sink, which
+// the plugin points at Rack's logger. Nothing on the calling thread touches
+// stdio, takes a lock or allocates. If the ring is full the message is
+// dropped and counted, so a flood can never stall the caller.
+class AsyncLog {
+public:
+    enum Level {
+        LEVEL_DEBUG,
+        LEVEL_INFO,
+        LEVEL_WARN
+    };
+    
+    typedef void (*Sink)(Level level, const char* text);
+    
+    static constexpr size_t CAPACITY = 256;    // messages, a power of two
+    static constexpr size_t TEXT_SIZE = 160;   // longer messages are truncated
+    static constexpr int DRAIN_INTERVAL_MS = 50;
+    
+    AsyncLog();
+    ~AsyncLog();
+    
+    // Any thread. Returns false if the message was dropped.
+    bool write(Level level, const char* format, ...)
+#if defined(__GNUC__)
+        __attribute__((format(printf, 3, 4)))
+#endif
+        ;
+    
+    // Where drained lines go; stderr until this is called
+    void setSink(Sink sink) { this->sink.store(sink); }
+    
+    uint32_t getDropped() const { return dropped.load(std::memory_order_relaxed); }
+
+private:
+    struct Slot {
+        std::atomic<size_t> sequence;
+        Level level;
+        char text[TEXT_SIZE];
+    };
+    
+    Slot slots[CAPACITY];
+    std::atomic<size_t> writePos{0};
+    size_t readPos = 0;  // drain thread only
+    
+    std::atomic<Sink> sink{nullptr};
+    std::atomic<uint32_t> dropped{0};
+    uint32_t reportedDropped = 0;
+    
+    std::atomic<bool> running{true};
+    std::thread thread;
+    
+    void drainLoop();
+    bool drainOne();
+    void emit(Level level, const char* text);
+};
+
+// The plugin-wide log
+AsyncLog& asyncLog();
+
+#define WEBSDR_DEBUG(...) asyncLog().write(AsyncLog::LEVEL_DEBUG, __VA_ARGS__)
+#define WEBSDR_INFO(...) asyncLog().write(AsyncLog::LEVEL_INFO, __VA_ARGS__)
+#define WEBSDR_WARN(...) asyncLog().write(AsyncLog::LEVEL_WARN, __VA_ARGS__)
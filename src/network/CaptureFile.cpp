@@ -0,0 +1,198 @@
+#include "CaptureFile.hpp"
+#include <algorithm>
+#include <chrono>
+
+#ifdef _WIN32
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+constexpr size_t CaptureRecorder::QUEUE_BYTES;
+constexpr int CaptureRecorder::WRITE_INTERVAL_MS;
+
+static const size_t MAX_FRAME_HEADER = 10;  // WebSocket header with a 64-bit length, unmasked
+
+static double nowSeconds() {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Server->client frame header for a payload of length bytes
+static size_t makeFrameHeader(uint8_t opcode, size_t length, uint8_t* out) {
+    out[0] = 0x80 | opcode;
+    if (length < 126) {
+        out[1] = (uint8_t)length;
+        return 2;
+    }
+    if (length < 65536) {
+        out[1] = 126;
+        out[2] = (uint8_t)(length >> 8);
+        out[3] = (uint8_t)length;
+        return 4;
+    }
+    out[1] = 127;
+    for (int i = 0; i < 8; i++) out[2 + i] = (uint8_t)((uint64_t)length >> (8 * (7 - i)));
+    return MAX_FRAME_HEADER;
+}
+
+bool MappedCapture::open(const std::string& path) {
+    close();
+#ifdef _WIN32
+    HANDLE handle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (handle == INVALID_HANDLE_VALUE) return false;
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(handle, &fileSize) || fileSize.QuadPart == 0) {
+        CloseHandle(handle);
+        return false;
+    }
+    HANDLE view = CreateFileMappingA(handle, NULL, PAGE_READONLY, 0, 0, NULL);
+    void* address = view ? MapViewOfFile(view, FILE_MAP_READ, 0, 0, 0) : NULL;
+    if (!address) {
+        if (view) CloseHandle(view);
+        CloseHandle(handle);
+        return false;
+    }
+    file = handle;
+    mapping = view;
+    mapped = (const uint8_t*)address;
+    length = (size_t)fileSize.QuadPart;
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size == 0) {
+        ::close(fd);
+        return false;
+    }
+    void* address = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);  // the mapping keeps the file open
+    if (address == MAP_FAILED) return false;
+    mapped = (const uint8_t*)address;
+    length = (size_t)info.st_size;
+#endif
+    return true;
+}
+
+void MappedCapture::close() {
+    if (!mapped) return;
+#ifdef _WIN32
+    UnmapViewOfFile(mapped);
+    CloseHandle(mapping);
+    CloseHandle(file);
+    mapping = nullptr;
+    file = nullptr;
+#else
+    munmap((void*)mapped, length);
+#endif
+    mapped = nullptr;
+    length = 0;
+}
+
+bool CaptureRecorder::start(const std::string& path, double sampleRate) {
+    stop();
+    
+    FILE* out = fopen(path.c_str(), "wb");
+    if (!out) return false;
+    
+    // The rate went by in a MSG frame long before recording started, so
+    // the capture opens with one of its own
+    std::vector<uint8_t> header;
+    appendCaptureHeader(header);
+    char hello[96];
+    int helloLength = snprintf(hello, sizeof(hello), "MSG audio_init=0 audio_rate=%d sample_rate=%.3f",
+                               (int)(sampleRate + 0.5), sampleRate);
+    uint8_t frame[MAX_FRAME_HEADER + sizeof(hello)];
+    size_t frameLength = makeFrameHeader(2, helloLength, frame);
+    memcpy(frame + frameLength, hello, helloLength);
+    appendCaptureChunk(header, 0, frame, (uint32_t)(frameLength + helloLength));
+    if (fwrite(header.data(), 1, header.size(), out) != header.size()) {
+        fclose(out);
+        return false;
+    }
+    
+    // Neither side is running, so the ring may be (re)allocated
+    if (ring.size() < QUEUE_BYTES) {
+        ring.assign(QUEUE_BYTES, 0);
+        mask = QUEUE_BYTES - 1;
+    }
+    queued.store(0);
+    consumed.store(0);
+    file = out;
+    bytesWritten.store(header.size());
+    dropped.store(0);
+    startTime = nowSeconds();
+    running = true;
+    thread = std::thread(&CaptureRecorder::writeLoop, this);
+    active.store(true);
+    return true;
+}
+
+void CaptureRecorder::stop() {
+    active.store(false);
+    // Once the I/O thread is out of record() nothing more reaches the ring
+    while (inRecord.load()) {
+        std::this_thread::yield();
+    }
+    running = false;
+    if (thread.joinable()) thread.join();
+}
+
+void CaptureRecorder::enqueue(uint8_t opcode, const uint8_t* data, size_t length) {
+    uint8_t header[CaptureChunk::HEADER_SIZE + MAX_FRAME_HEADER];
+    size_t frameHeader = makeFrameHeader(opcode, length, header + CaptureChunk::HEADER_SIZE);
+    size_t chunkLength = frameHeader + length;
+    size_t headerLength = CaptureChunk::HEADER_SIZE + frameHeader;
+    
+    // All of a chunk or none of it
+    uint64_t pos = queued.load(std::memory_order_relaxed);
+    if (pos + headerLength + length - consumed.load(std::memory_order_acquire) > ring.size()) {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    
+    uint64_t micros = (uint64_t)((nowSeconds() - startTime) * 1e6);
+    for (int i = 0; i < 8; i++) header[i] = (uint8_t)(micros >> (8 * i));
+    for (int i = 0; i < 4; i++) header[8 + i] = (uint8_t)((uint32_t)chunkLength >> (8 * i));
+    copyIn(pos, header, headerLength);
+    copyIn(pos + headerLength, data, length);
+    queued.store(pos + headerLength + length, std::memory_order_release);
+}
+
+void CaptureRecorder::copyIn(uint64_t pos, const uint8_t* data, size_t length) {
+    size_t start = (size_t)pos & mask;
+    size_t first = std::min(length, ring.size() - start);
+    memcpy(&ring[start], data, first);
+    memcpy(&ring[0], data + first, length - first);
+}
+
+size_t CaptureRecorder::drain() {
+    // Straight from the ring to the file, in at most two pieces
+    uint64_t end = queued.load(std::memory_order_acquire);
+    uint64_t pos = consumed.load(std::memory_order_relaxed);
+    size_t total = (size_t)(end - pos);
+    if (total == 0) return 0;
+    
+    size_t start = (size_t)pos & mask;
+    size_t first = std::min(total, ring.size() - start);
+    fwrite(&ring[start], 1, first, file);
+    fwrite(&ring[0], 1, total - first, file);
+    fflush(file);  // what's been recorded survives a crash
+    consumed.store(end, std::memory_order_release);
+    bytesWritten.fetch_add(total, std::memory_order_relaxed);
+    return total;
+}
+
+void CaptureRecorder::writeLoop() {
+    while (running) {
+        if (drain() == 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(WRITE_INTERVAL_MS));
+        }
+    }
+    // stop() has made sure nothing else is coming
+    drain();
+    fclose(file);
+    file = nullptr;
+}
@@ -0,0 +1,163 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Capture of one KiwiSDR stream: the bytes the socket delivered after the
+// WebSocket upgrade, in chunks stamped with their arrival time. A chunk is
+// whatever recv() returned, or exactly one frame as CaptureRecorder writes. Replaying one through WebSDRSession::receive() runs
+// the frame parser, decoder and everything after it exactly as live.
+// Connecting to CAPTURE_URL_PREFIX + path plays one back as a server.
+//
+//   "WSDRCAP1"
+//   per chunk: arrival in microseconds since the first chunk (uint64 LE),
+//              length (uint32 LE), then the bytes
+struct CaptureChunk {
+    static const size_t HEADER_SIZE = 12;
+    
+    uint64_t micros = 0;
+    const uint8_t* data = nullptr;
+    uint32_t length = 0;
+};
+
+static const char CAPTURE_MAGIC[] = "WSDRCAP1";
+static const size_t CAPTURE_MAGIC_SIZE = 8;
+static const char CAPTURE_URL_PREFIX[] = "capture:";
+
+inline bool isCaptureUrl(const std::string& url) {
+    return url.compare(0, sizeof(CAPTURE_URL_PREFIX) - 1, CAPTURE_URL_PREFIX) == 0;
+}
+
+inline void appendCaptureHeader(std::vector<uint8_t>& out) {
+    size_t pos = out.size();
+    out.resize(pos + CAPTURE_MAGIC_SIZE);
+    memcpy(out.data() + pos, CAPTURE_MAGIC, CAPTURE_MAGIC_SIZE);
+}
+
+inline void appendCaptureChunk(std::vector<uint8_t>& out, uint64_t micros, const uint8_t* data, uint32_t length) {
+    uint8_t header[CaptureChunk::HEADER_SIZE];
+    for (int i = 0; i < 8; i++) header[i] = (uint8_t)(micros >> (8 * i));
+    for (int i = 0; i < 4; i++) header[8 + i] = (uint8_t)(length >> (8 * i));
+    out.insert(out.end(), header, header + CaptureChunk::HEADER_SIZE);
+    out.insert(out.end(), data, data + length);
+}
+
+// Walks a capture held in memory, handing out spans into it without copying
+class CaptureReader {
+public:
+    CaptureReader(const uint8_t* data, size_t size) : begin(data), end(data + size) {
+        pos = isValid() ? begin + CAPTURE_MAGIC_SIZE : end;
+    }
+    
+    bool isValid() const {
+        return (size_t)(end - begin) >= CAPTURE_MAGIC_SIZE && memcmp(begin, CAPTURE_MAGIC, CAPTURE_MAGIC_SIZE) == 0;
+    }
+    
+    // Returns false at the end, or at a chunk cut short by a truncated file
+    bool next(CaptureChunk& chunk) {
+        if ((size_t)(end - pos) < CaptureChunk::HEADER_SIZE) return false;
+        
+        uint64_t micros = 0;
+        uint32_t length = 0;
+        for (int i = 0; i < 8; i++) micros |= (uint64_t)pos[i] << (8 * i);
+        for (int i = 0; i < 4; i++) length |= (uint32_t)pos[8 + i] << (8 * i);
+        if ((size_t)(end - pos) - CaptureChunk::HEADER_SIZE < length) return false;
+        
+        chunk.micros = micros;
+        chunk.data = pos + CaptureChunk::HEADER_SIZE;
+        chunk.length = length;
+        pos += CaptureChunk::HEADER_SIZE + length;
+        return true;
+    }
+    
+    void rewind() {
+        pos = isValid() ? begin + CAPTURE_MAGIC_SIZE : end;
+    }
+
+private:
+    const uint8_t* begin;
+    const uint8_t* end;
+    const uint8_t* pos;
+};
+
+// A capture file mapped read-only into memory, for playback
+class MappedCapture {
+public:
+    MappedCapture() {}
+    ~MappedCapture() { close(); }
+    MappedCapture(const MappedCapture&) = delete;
+    MappedCapture& operator=(const MappedCapture&) = delete;
+    
+    bool open(const std::string& path);
+    void close();
+    const uint8_t* data() const { return mapped; }
+    size_t size() const { return length; }
+
+private:
+    const uint8_t* mapped = nullptr;
+    size_t length = 0;
+#ifdef _WIN32
+    void* file = nullptr;
+    void* mapping = nullptr;
+#endif
+};
+
+// Appends received frames to a capture file without ever blocking the
+// I/O thread: record() only copies the frame into a lock-free ring, and a
+// background thread writes the ring out to the file. Frames are stored as
+// they arrived, so a stream with compression on records ADPCM, about a
+// quarter of the size. When the writer falls behind, whole frames are
+// dropped and counted; playback conceals them like network loss.
+class CaptureRecorder {
+public:
+    static constexpr size_t QUEUE_BYTES = 1 << 20;  // a power of two, ~20 s of IQ; allocated on start()
+    static constexpr int WRITE_INTERVAL_MS = 50;
+    
+    CaptureRecorder() {}
+    ~CaptureRecorder() { stop(); }
+    
+    // Not from the I/O thread. Truncates path and starts with a stream
+    // header announcing sampleRate, so playback runs at the right rate.
+    bool start(const std::string& path, double sampleRate);
+    // Returns once the file is complete and closed
+    void stop();
+    bool isRecording() const { return active.load(); }
+    
+    // I/O thread: one received WebSocket message
+    void record(uint8_t opcode, const uint8_t* data, size_t length) {
+        // As the audio callback: stop() waits until this is out of the queue
+        inRecord.store(true);
+        if (active.load()) enqueue(opcode, data, length);
+        inRecord.store(false);
+    }
+    
+    uint64_t getBytesWritten() const { return bytesWritten.load(std::memory_order_relaxed); }
+    uint32_t getDropped() const { return dropped.load(std::memory_order_relaxed); }
+
+private:
+    // Byte ring, single producer (I/O thread) and consumer (writer). A
+    // chunk is published with one store, so the writer never sees half of one.
+    std::vector<uint8_t> ring;
+    size_t mask = 0;
+    std::atomic<uint64_t> queued{0};    // bytes pushed, free-running
+    std::atomic<uint64_t> consumed{0};  // bytes written out
+    
+    std::atomic<bool> active{false};
+    std::atomic<bool> inRecord{false};
+    std::atomic<bool> running{false};
+    std::atomic<uint64_t> bytesWritten{0};
+    std::atomic<uint32_t> dropped{0};
+    double startTime = 0.0;
+    FILE* file = nullptr;  // writer thread only while recording
+    std::thread thread;
+    
+    void enqueue(uint8_t opcode, const uint8_t* data, size_t length);
+    void copyIn(uint64_t pos, const uint8_t* data, size_t length);
+    void writeLoop();
+    size_t drain();
+};
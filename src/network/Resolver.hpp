@@ -0,0 +1,83 @@
+#pragma once
+#include "Socket.hpp"
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+
+static const int KIWI_DEFAULT_PORT = 8073;
+
+// getaddrinfo has no async form, so each lookup runs on a short-lived thread.
+// The job is shared so its owner can be destroyed while the lookup is still running.
+struct ResolveJob {
+    std::string host;
+    std::string port;
+    addrinfo* result = nullptr;
+    std::atomic<bool> done{false};
+    
+    ~ResolveJob() {
+        if (result) freeaddrinfo(result);
+    }
+};
+
+// Starts looking up host; wake is called (from the lookup thread) once done is set
+inline std::shared_ptr<ResolveJob> startResolve(const std::string& host, int port, void (*wake)()) {
+    std::shared_ptr<ResolveJob> job = std::make_shared<ResolveJob>();
+    job->host = host;
+    job->port = std::to_string(port);
+    
+    std::thread([job, wake]() {
+        struct addrinfo hints;
+        memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        
+        if (getaddrinfo(job->host.c_str(), job->port.c_str(), &hints, &job->result) != 0) {
+            job->result = nullptr;
+        }
+        job->done = true;
+        if (wake) wake();
+    }).detach();
+    return job;
+}
+
+// Splits a server URL like "kiwisdr.ve6slp.ca:8073" into host and port
+inline void parseServerUrl(const std::string& url, std::string& host, int& port) {
+    host = url;
+    port = KIWI_DEFAULT_PORT;
+    
+    size_t colonPos = url.find(':');
+    if (colonPos != std::string::npos) {
+        host = url.substr(0, colonPos);
+        port = atoi(url.c_str() + colonPos + 1);
+        if (port <= 0) port = KIWI_DEFAULT_PORT;
+    }
+}
+
+// Opens a non-blocking socket and starts connecting it to address.
+// Returns -1 if that failed straight away.
+inline int startConnect(const addrinfo* address) {
+    int fd = (int)socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+    if (fd < 0) return -1;
+    
+    if (!setNonBlocking(fd)) {
+        closeSocketFd(fd);
+        return -1;
+    }
+    
+    int result = ::connect(fd, address->ai_addr, (int)address->ai_addrlen);
+    if (result < 0 && !lastErrorWouldBlock()) {
+        closeSocketFd(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// After a non-blocking connect polled writable: did it succeed?
+inline bool connectSucceeded(int fd) {
+    int err = 0;
+    socklen_t errLen = sizeof(err);
+    return getsockopt(fd, SOL_SOCKET, SO_ERROR, (char*)&err, &errLen) == 0 && err == 0;
+}
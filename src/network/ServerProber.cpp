@@ -0,0 +1,278 @@
+#include "ServerProber.hpp"
+#include "Resolver.hpp"
+#include "CaptureFile.hpp"
+#include "AsyncLog.hpp"
+#include <chrono>
+#include <fstream>
+
+constexpr double ServerProber::PROBE_INTERVAL;
+constexpr double ServerProber::REQUEST_INTERVAL;
+constexpr double ServerProber::PROBE_TIMEOUT;
+constexpr size_t ServerProber::MAX_REPLY;
+
+// Used until the user folder has a servers.txt
+static const char* const DEFAULT_SERVERS[] = {"kiwisdr.ve6slp.ca:8073", "sdr.ve3sun.com:8073", "kiwisdr.n3lga.com:8073"};
+
+static double nowSeconds() {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+struct ServerProber::Probe {
+    enum Stage { RESOLVING, CONNECTING, WAITING, DONE };
+    
+    Stage stage = RESOLVING;
+    ServerStatus status;
+    std::shared_ptr<ResolveJob> resolveJob;
+    int fd = -1;
+    double deadline = 0.0;
+    double sentAt = 0.0;  // when the connect, later the request, went out
+    std::string request;
+    size_t requestSent = 0;
+    std::string reply;
+    
+    ~Probe() {
+        if (fd >= 0) closeSocketFd(fd);
+    }
+};
+
+ServerProber::ServerProber() : servers(DEFAULT_SERVERS, DEFAULT_SERVERS + sizeof(DEFAULT_SERVERS) / sizeof(DEFAULT_SERVERS[0])) {}
+
+ServerProber::~ServerProber() {}
+
+void ServerProber::setServers(const std::vector<std::string>& urls) {
+    std::lock_guard<std::mutex> lock(mutex);
+    servers = urls;
+}
+
+bool ServerProber::loadServers(const std::string& path) {
+    std::ifstream file(path);
+    if (!file) return false;
+    
+    std::vector<std::string> urls;
+    std::string line;
+    while (std::getline(file, line)) {
+        line = line.substr(0, line.find('#'));
+        size_t start = line.find_first_not_of(" \t\r");
+        if (start == std::string::npos) continue;
+        size_t end = line.find_last_not_of(" \t\r");
+        std::string url = line.substr(start, end - start + 1);
+        if (std::find(urls.begin(), urls.end(), url) == urls.end()) urls.push_back(url);
+    }
+    if (urls.empty()) return false;
+    
+    setServers(urls);
+    WEBSDR_INFO("Loaded %d servers from %s", (int)urls.size(), path.c_str());
+    return true;
+}
+
+std::vector<std::string> ServerProber::getServers() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return servers;
+}
+
+std::vector<ServerStatus> ServerProber::getStatuses() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<ServerStatus> result;
+    for (const std::string& url : servers) {
+        ServerStatus status;
+        status.url = url;
+        for (const ServerStatus& entry : statuses) {
+            if (entry.url == url) status = entry;
+        }
+        result.push_back(status);
+    }
+    return result;
+}
+
+std::vector<std::string> ServerProber::rank(const std::vector<std::string>& urls) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return rankServers(urls, statuses);
+}
+
+size_t ServerProber::appendPollFds(std::vector<pollfd>& fds) const {
+    size_t added = 0;
+    for (const std::unique_ptr<Probe>& probe : probes) {
+        if (probe->fd < 0) continue;
+        
+        pollfd pfd;
+        pfd.fd = probe->fd;
+        pfd.revents = 0;
+        if (probe->stage == Probe::CONNECTING) {
+            pfd.events = POLLOUT;
+        } else {
+            pfd.events = POLLIN;
+            if (probe->requestSent < probe->request.size()) pfd.events |= POLLOUT;
+        }
+        fds.push_back(pfd);
+        added++;
+    }
+    return added;
+}
+
+void ServerProber::handlePollEvents(const pollfd* fds, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        if (fds[i].revents == 0) continue;
+        
+        for (const std::unique_ptr<Probe>& probe : probes) {
+            if (probe->fd != fds[i].fd) continue;
+            
+            if (probe->stage == Probe::CONNECTING) {
+                onWritable(*probe);
+            } else if (probe->stage == Probe::WAITING) {
+                if (fds[i].revents & POLLOUT) onWritable(*probe);
+                if (probe->stage == Probe::WAITING && (fds[i].revents & (POLLIN | POLLERR | POLLHUP))) onReadable(*probe);
+            }
+            break;
+        }
+    }
+}
+
+void ServerProber::update(double now, bool inUse) {
+    if (probes.empty()) {
+        // Requested rounds wait too, until somebody is listening
+        if (!inUse) return;
+        // Reconnects back off, but failing races shouldn't make the probes hammer the servers
+        double since = now - lastRound;
+        if (since < PROBE_INTERVAL && !(probeRequested && since >= REQUEST_INTERVAL)) return;
+        startRound(now);
+    }
+    
+    bool done = true;
+    for (const std::unique_ptr<Probe>& probe : probes) {
+        step(*probe, now);
+        if (probe->stage != Probe::DONE) done = false;
+    }
+    if (done) publish();
+}
+
+void ServerProber::startRound(double now) {
+    lastRound = now;
+    probeRequested = false;
+    
+    for (const std::string& url : getServers()) {
+        if (isCaptureUrl(url)) continue;
+        
+        std::unique_ptr<Probe> probe(new Probe);
+        probe->status.url = url;
+        std::string host;
+        int port;
+        parseServerUrl(url, host, port);
+        probe->request = "GET /status HTTP/1.1\r\nHost: " + host + ":" + std::to_string(port) + "\r\nConnection: close\r\n\r\n";
+        probe->resolveJob = startResolve(host, port, wakeCallback);
+        probe->deadline = now + PROBE_TIMEOUT;
+        probes.push_back(std::move(probe));
+    }
+}
+
+void ServerProber::step(Probe& probe, double now) {
+    if (probe.stage == Probe::DONE) return;
+    
+    if (now > probe.deadline) {
+        // A reply cut off by the timeout still says the server is up
+        finish(probe, probe.stage == Probe::WAITING && !probe.reply.empty());
+        return;
+    }
+    
+    if (probe.stage == Probe::RESOLVING && probe.resolveJob->done) {
+        // The first address is enough to tell how far away the server is
+        addrinfo* address = probe.resolveJob->result;
+        probe.fd = address ? startConnect(address) : -1;
+        if (probe.fd < 0) {
+            finish(probe, false);
+            return;
+        }
+        probe.sentAt = nowSeconds();
+        probe.stage = Probe::CONNECTING;
+    }
+}
+
+void ServerProber::onWritable(Probe& probe) {
+    if (probe.stage == Probe::CONNECTING) {
+        if (!connectSucceeded(probe.fd)) {
+            finish(probe, false);
+            return;
+        }
+        double now = nowSeconds();
+        probe.status.connectMs = (float)((now - probe.sentAt) * 1000.0);
+        probe.sentAt = now;
+        probe.stage = Probe::WAITING;
+    }
+    
+    while (probe.requestSent < probe.request.size()) {
+        int sent = send(probe.fd, probe.request.data() + probe.requestSent, probe.request.size() - probe.requestSent, SEND_FLAGS);
+        if (sent < 0) {
+            if (!lastErrorWouldBlock()) finish(probe, false);
+            return;
+        }
+        probe.requestSent += sent;
+    }
+}
+
+void ServerProber::onReadable(Probe& probe) {
+    char buffer[1024];
+    int received = recv(probe.fd, buffer, sizeof(buffer), 0);
+    if (received < 0) {
+        if (!lastErrorWouldBlock()) finish(probe, !probe.reply.empty());
+        return;
+    }
+    
+    if (received > 0 && probe.reply.empty()) {
+        probe.status.handshakeMs = (float)((nowSeconds() - probe.sentAt) * 1000.0);
+    }
+    probe.reply.append(buffer, received);
+    
+    // The server closes once the whole reply is out
+    if (received == 0 || probe.reply.size() >= MAX_REPLY) {
+        finish(probe, !probe.reply.empty());
+    }
+}
+
+void ServerProber::finish(Probe& probe, bool reachable) {
+    if (probe.fd >= 0) {
+        closeSocketFd(probe.fd);
+        probe.fd = -1;
+    }
+    probe.stage = Probe::DONE;
+    probe.status.probed = true;
+    probe.status.reachable = reachable;
+    if (!reachable) return;
+    
+    // Anything but a 200 still answered, it just says nothing about load
+    size_t statusEnd = probe.reply.find("\r\n");
+    size_t bodyStart = probe.reply.find("\r\n\r\n");
+    if (bodyStart == std::string::npos || probe.reply.substr(0, statusEnd).find(" 200") == std::string::npos) return;
+    bodyStart += 4;
+    parseKiwiStatus(probe.reply.data() + bodyStart, probe.reply.size() - bodyStart, probe.status);
+}
+
+void ServerProber::publish() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const std::unique_ptr<Probe>& probe : probes) {
+            auto it = std::find_if(statuses.begin(), statuses.end(), [&](const ServerStatus& entry) {
+                return entry.url == probe->status.url;
+            });
+            if (it != statuses.end()) {
+                *it = probe->status;
+            } else {
+                statuses.push_back(probe->status);
+            }
+        }
+    }
+    
+    for (const std::unique_ptr<Probe>& probe : probes) {
+        const ServerStatus& status = probe->status;
+        if (status.reachable) {
+            WEBSDR_DEBUG("Probed %s: %.0f ms connect, %.0f ms status, %d/%d users", status.url.c_str(),
+                         status.connectMs, status.handshakeMs, status.users, status.maxUsers);
+        } else {
+            WEBSDR_DEBUG("Probed %s: unreachable", status.url.c_str());
+        }
+    }
+    probes.clear();
+}
+
+ServerProber& serverProber() {
+    static ServerProber prober;
+    return prober;
+}
@@ -0,0 +1,131 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+struct pollfd;
+
+// What the prober last measured of one server
+struct ServerStatus {
+    std::string url;
+    bool probed = false;       // a round has finished with this server in it
+    bool reachable = false;
+    float connectMs = 0.0f;    // TCP connect round trip
+    float handshakeMs = 0.0f;  // status request to the first byte of the reply
+    int users = 0;
+    int maxUsers = 0;          // 0 if the server didn't say
+    
+    bool isFull() const { return maxUsers > 0 && users >= maxUsers; }
+    float latencyMs() const { return connectMs + handshakeMs; }
+    
+    // Free slots by latency, then servers not probed yet, then full ones,
+    // then the unreachable. Ties keep the configured order (stable sort).
+    int tier() const {
+        if (!probed) return 1;
+        if (!reachable) return 3;
+        return isFull() ? 2 : 0;
+    }
+    bool ranksBefore(const ServerStatus& other) const {
+        if (tier() != other.tier()) return tier() < other.tier();
+        return (tier() == 0 || tier() == 2) && latencyMs() < other.latencyMs();
+    }
+};
+
+// Picks users= and users_max= out of a KiwiSDR /status reply body,
+// one key=value per line
+inline void parseKiwiStatus(const char* text, size_t length, ServerStatus& status) {
+    const char* end = text + length;
+    for (const char* line = text; line < end;) {
+        const char* lineEnd = std::find(line, end, '\n');
+        std::string entry(line, lineEnd);
+        if (entry.compare(0, 6, "users=") == 0) {
+            status.users = atoi(entry.c_str() + 6);
+        } else if (entry.compare(0, 10, "users_max=") == 0) {
+            status.maxUsers = atoi(entry.c_str() + 10);
+        }
+        line = lineEnd + 1;
+    }
+}
+
+// Orders urls best first by the given statuses; urls without one count as not probed yet
+inline std::vector<std::string> rankServers(const std::vector<std::string>& urls, const std::vector<ServerStatus>& known) {
+    std::vector<ServerStatus> ranked;
+    for (const std::string& url : urls) {
+        ServerStatus status;
+        status.url = url;
+        for (const ServerStatus& entry : known) {
+            if (entry.url == url) status = entry;
+        }
+        ranked.push_back(status);
+    }
+    std::stable_sort(ranked.begin(), ranked.end(), [](const ServerStatus& a, const ServerStatus& b) {
+        return a.ranksBefore(b);
+    });
+    
+    std::vector<std::string> result;
+    for (const ServerStatus& status : ranked) result.push_back(status.url);
+    return result;
+}
+
+// Plugin-wide list of KiwiSDR servers and how well each is doing. While any
+// stream is up, the manager's I/O thread probes every server in parallel
+// once a minute: a TCP connect, then GET /status, which also reports how many
+// of its user slots are taken. The request never opens a receiver, so a
+// probe costs the server no slot. Connects are then raced in rank order.
+class ServerProber {
+public:
+    static constexpr double PROBE_INTERVAL = 60.0;  // seconds between rounds
+    static constexpr double REQUEST_INTERVAL = 10.0;  // at the soonest, when asked for one
+    static constexpr double PROBE_TIMEOUT = 3.0;    // per server
+    static constexpr size_t MAX_REPLY = 4096;       // /status is a few hundred bytes
+    
+    ServerProber();
+    ~ServerProber();
+    
+    // Any thread (not the audio thread, these lock)
+    void setServers(const std::vector<std::string>& urls);
+    // One host:port per line, # starts a comment. Keeps the list as it
+    // was if the file can't be read or names no server.
+    bool loadServers(const std::string& path);
+    std::vector<std::string> getServers() const;
+    std::vector<ServerStatus> getStatuses() const;  // in configured order
+    // urls best first by the last round; unmeasured ones keep their order
+    std::vector<std::string> rank(const std::vector<std::string>& urls) const;
+    std::vector<std::string> rankedServers() const { return rank(getServers()); }
+    // Start a new round soon, though no sooner than REQUEST_INTERVAL after the last
+    void requestProbe() { probeRequested = true; }
+    
+    // I/O thread only, stepped by WebSDRClientManager like a session.
+    // inUse says whether anyone is streaming; rounds only start then.
+    void setWakeCallback(void (*wake)()) { wakeCallback = wake; }
+    size_t appendPollFds(std::vector<pollfd>& fds) const;
+    void handlePollEvents(const pollfd* fds, size_t count);
+    void update(double now, bool inUse);
+
+private:
+    struct Probe;
+    
+    mutable std::mutex mutex;
+    std::vector<std::string> servers;
+    std::vector<ServerStatus> statuses;  // results of the last round that had each server
+    
+    // I/O thread only
+    std::vector<std::unique_ptr<Probe>> probes;  // the round in progress
+    double lastRound = -1.0e9;
+    std::atomic<bool> probeRequested{false};
+    void (*wakeCallback)() = nullptr;
+    
+    void startRound(double now);
+    void step(Probe& probe, double now);
+    void onWritable(Probe& probe);
+    void onReadable(Probe& probe);
+    void finish(Probe& probe, bool reachable);
+    void publish();
+};
+
+ServerProber& serverProber();
@@ -0,0 +1,38 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// Header of a KiwiSDR SND audio packet:
+//   "SND", flags (1 byte), sequence (32-bit little-endian), S-meter (16-bit big-endian)
+// IQ (stereo) packets then carry a 10-byte GPS timestamp before the samples.
+struct SndHeader {
+    static const size_t SIZE = 10;
+    static const size_t GPS_SIZE = 10;
+    static const uint8_t FLAG_STEREO = 0x08;      // interleaved I/Q
+    static const uint8_t FLAG_COMPRESSED = 0x10;  // IMA ADPCM
+    
+    uint8_t flags = 0;
+    uint32_t sequence = 0;
+    float rssi = 0.0f;  // dBm
+    size_t size = 0;    // bytes ahead of the samples
+    
+    bool isStereo() const { return (flags & FLAG_STEREO) != 0; }
+    bool isCompressed() const { return (flags & FLAG_COMPRESSED) != 0; }
+};
+
+// Returns false if data doesn't start with a complete SND header
+inline bool parseSndHeader(const uint8_t* data, size_t len, SndHeader& header) {
+    if (len < SndHeader::SIZE || memcmp(data, "SND", 3) != 0) return false;
+    
+    header.flags = data[3];
+    header.sequence = (uint32_t)data[4] | ((uint32_t)data[5] << 8) | ((uint32_t)data[6] << 16) | ((uint32_t)data[7] << 24);
+    uint16_t smeter = (uint16_t)((data[8] << 8) | data[9]);
+    header.rssi = 0.1f * smeter - 127.0f;
+    header.size = SndHeader::SIZE;
+    if (header.isStereo()) {
+        if (len < SndHeader::SIZE + SndHeader::GPS_SIZE) return false;
+        header.size += SndHeader::GPS_SIZE;
+    }
+    return true;
+}
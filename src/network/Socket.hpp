@@ -0,0 +1,50 @@
+#pragma once
+// Small portability layer over BSD sockets / Winsock for the network code
+
+#ifdef _WIN32
+    #include <winsock2.h>
+    #include <ws2tcpip.h>
+    #pragma comment(lib, "ws2_32.lib")
+#else
+    #include <sys/socket.h>
+    #include <netinet/in.h>
+    #include <arpa/inet.h>
+    #include <netdb.h>
+    #include <unistd.h>
+    #include <fcntl.h>
+    #include <poll.h>
+#endif
+#include <cerrno>
+
+#ifdef _WIN32
+inline void closeSocketFd(int fd) { closesocket(fd); }
+inline bool setNonBlocking(int fd) {
+    u_long mode = 1;
+    return ioctlsocket(fd, FIONBIO, &mode) == 0;
+}
+inline bool lastErrorWouldBlock() {
+    int err = WSAGetLastError();
+    return err == WSAEWOULDBLOCK || err == WSAEINPROGRESS;
+}
+inline int pollSockets(pollfd* fds, size_t count, int timeoutMs) {
+    return WSAPoll(fds, (ULONG)count, timeoutMs);
+}
+#else
+inline void closeSocketFd(int fd) { close(fd); }
+inline bool setNonBlocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+inline bool lastErrorWouldBlock() {
+    return errno == EWOULDBLOCK || errno == EAGAIN || errno == EINPROGRESS;
+}
+inline int pollSockets(pollfd* fds, size_t count, int timeoutMs) {
+    return poll(fds, (nfds_t)count, timeoutMs);
+}
+#endif
+
+#ifdef MSG_NOSIGNAL
+static const int SEND_FLAGS = MSG_NOSIGNAL;
+#else
+static const int SEND_FLAGS = 0;
+#endif
@@ -1,318 +1,219 @@
 #include "WebSDRClient.hpp"
-#include <cstring>
-#include <iostream>
-#include <sstream>
-#include <iomanip>
+#include "WebSDRClientManager.hpp"
+#include <thread>
 #include <algorithm>
 
-#ifdef _WIN32
-    #include <winsock2.h>
-    #include <ws2tcpip.h>
-    #pragma comment(lib, "ws2_32.lib")
-#else
-    #include <sys/socket.h>
-    #include <netinet/in.h>
-    #include <arpa/inet.h>
-    #include <netdb.h>
-    #include <unistd.h>
-    #include <fcntl.h>
-#endif
+constexpr int WebSDRClient::WATERFALL_BINS;
+constexpr float WebSDRClient::IQ_PASSBAND;
+constexpr float WebSDRClient::NO_RSSI;
+constexpr double WebSDRClient::RECONNECT_MIN_DELAY;
+constexpr double WebSDRClient::RECONNECT_MAX_DELAY;
+constexpr double WebSDRClient::RECONNECT_RESET_AFTER;
 
-WebSDRClient::WebSDRClient() {
-#ifdef _WIN32
-    WSADATA wsaData;
-    WSAStartup(MAKEWORD(2, 2), &wsaData);
-#endif
+// KiwiSDR mode names, indexed by modeIndex; same order as IqDemodulator::Mode
+static const char* const KIWI_MODES[] = {"am", "nbfm", "usb", "lsb", "cw"};
+static const int NUM_KIWI_MODES = sizeof(KIWI_MODES) / sizeof(KIWI_MODES[0]);
+
+WebSDRClient::WebSDRClient() : WebSDRClient(Channel::SOUND) {
+    waterfallClient.reset(new WebSDRClient(Channel::WATERFALL));
+}
+
+WebSDRClient::WebSDRClient(Channel channel) : channel(channel) {
+    Tuning defaults;
+    freq = defaults.freq;
+    modeIndex = 0;
+    lowCut = defaults.lowCut;
+    highCut = defaults.highCut;
+    compression = defaults.compression;
+    if (channel == Channel::SOUND) {
+        demodBuffer.resize(4096);  // more than an IQ packet holds
+    }
 }
 
 WebSDRClient::~WebSDRClient() {
     disconnect();
-#ifdef _WIN32
-    WSACleanup();
-#endif
 }
 
-bool WebSDRClient::connect(const std::string& url) {
-    serverUrl = url;
-    
-    // Parse URL - expects format like "kiwisdr.ve6slp.ca:8073"
-    std::string host = url;
-    int port = 8073;  // Default KiwiSDR port
+void WebSDRClient::connect(const std::string& url) {
+    connect(std::vector<std::string>{url});
+}
+
+void WebSDRClient::connect(const std::vector<std::string>& urls) {
+    if (urls.empty()) {
+        disconnect();
+        return;
+    }
     
-    size_t colonPos = url.find(':');
-    if (colonPos != std::string::npos) {
-        host = url.substr(0, colonPos);
-        port = std::stoi(url.substr(colonPos + 1));
+    {
+        std::lock_guard<std::mutex> lock(urlMutex);
+        serverUrls = urls;
     }
     
-    std::cout << "[WebSDR] Connecting to " << host << ":" << port << std::endl;
+    // The manager drops any previous subscription, then joins a session
+    // already streaming these servers at this tuning or starts a new one
+    state = paused ? State::DISCONNECTED : State::RESOLVING;
+    WebSDRClientManager::instance().subscribe(this, urls);
     
-    // DNS lookup
-    struct hostent* server = gethostbyname(host.c_str());
-    if (!server) {
-        std::cerr << "[WebSDR] Failed to resolve host" << std::endl;
-        return false;
+    if (waterfallClient && waterfallEnabled) {
+        waterfallClient->connect(urls);
     }
-    
-    // Create socket
-    socketFd = socket(AF_INET, SOCK_STREAM, 0);
-    if (socketFd < 0) {
-        std::cerr << "[WebSDR] Failed to create socket" << std::endl;
-        return false;
+}
+
+void WebSDRClient::disconnect() {
+    if (waterfallClient) {
+        waterfallClient->disconnect();
     }
-    
-    // Connect
-    struct sockaddr_in addr;
-    memset(&addr, 0, sizeof(addr));
-    addr.sin_family = AF_INET;
-    memcpy(&addr.sin_addr.s_addr, server->h_addr, server->h_length);
-    addr.sin_port = htons(port);
-    
-    if (::connect(socketFd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
-        std::cerr << "[WebSDR] Failed to connect" << std::endl;
-        close(socketFd);
-        socketFd = -1;
-        return false;
+    WebSDRClientManager::instance().unsubscribe(this);
+    state = State::DISCONNECTED;
+}
+
+void WebSDRClient::disconnectAsync() {
+    if (waterfallClient) {
+        waterfallClient->disconnectAsync();
     }
-    
-    // Send WebSocket upgrade request
-    std::stringstream ws_request;
-    ws_request << "GET /kiwi/" << port << "/SND HTTP/1.1\r\n"
-               << "Host: " << host << ":" << port << "\r\n"
-               << "Upgrade: websocket\r\n"
-               << "Connection: Upgrade\r\n"
-               << "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
-               << "Sec-WebSocket-Version: 13\r\n\r\n";
-    
-    send(socketFd, ws_request.str().c_str(), ws_request.str().length(), 0);
-    
-    // Check for 101 response
-    char buffer[1024];
-    int received = recv(socketFd, buffer, sizeof(buffer)-1, 0);
-    
-    if (received > 0) {
-        buffer[received] = '\0';
-        if (strstr(buffer, "101 Switching Protocols")) {
-            std::cout << "[WebSDR] WebSocket connected!" << std::endl;
-            connected = true;
-            shouldStop = false;
-            
-            // Start receive thread
-            receiveThread = std::thread(&WebSDRClient::receiveLoop, this);
-            
-            // Send initial commands
-            std::this_thread::sleep_for(std::chrono::milliseconds(100));
-            sendWebSocketFrame("SET auth t=kiwi p=");
-            std::this_thread::sleep_for(std::chrono::milliseconds(100));
-            sendWebSocketFrame("SET AR OK in=12000 out=44100");
-            std::this_thread::sleep_for(std::chrono::milliseconds(100));
-            sendWebSocketFrame("SET squelch=0 max=0");
-            std::this_thread::sleep_for(std::chrono::milliseconds(100));
-            sendWebSocketFrame("SET genattn=0");
-            std::this_thread::sleep_for(std::chrono::milliseconds(100));
-            sendWebSocketFrame("SET mod=am low_cut=-4000 high_cut=4000 freq=7055.000");
-            std::this_thread::sleep_for(std::chrono::milliseconds(100));
-            sendWebSocketFrame("SET keepalive");
-            sendWebSocketFrame("SET AUDIO_COMP=0");
-            sendWebSocketFrame("SET AUDIO_START=1");
-            
-            return true;
-        }
+    WebSDRClientManager::instance().unsubscribe(this, false);
+    state = State::DISCONNECTED;
+}
+
+void WebSDRClient::setPaused(bool paused) {
+    if (this->paused.exchange(paused) == paused) return;
+    // before connect() there's no session to leave or join
+    if (subscribed) retune();
+}
+
+void WebSDRClient::setAutoReconnect(bool enabled) {
+    autoReconnect = enabled;
+    if (waterfallClient) {
+        waterfallClient->setAutoReconnect(enabled);
     }
-    
-    std::cerr << "[WebSDR] WebSocket upgrade failed" << std::endl;
-    close(socketFd);
-    socketFd = -1;
-    return false;
 }
 
-void WebSDRClient::disconnect() {
-    shouldStop = true;
-    connected = false;
+void WebSDRClient::setWaterfallEnabled(bool enabled) {
+    if (!waterfallClient || waterfallEnabled.exchange(enabled) == enabled) return;
     
-    if (socketFd >= 0) {
-#ifdef _WIN32
-        closesocket(socketFd);
-#else
-        close(socketFd);
-#endif
-        socketFd = -1;
+    if (!enabled) {
+        waterfallClient->disconnect();
+        return;
     }
     
-    if (receiveThread.joinable()) {
-        receiveThread.join();
+    std::vector<std::string> urls;
+    {
+        std::lock_guard<std::mutex> lock(urlMutex);
+        urls = serverUrls;
+    }
+    if (subscribed && !urls.empty()) {
+        waterfallClient->connect(urls);
     }
 }
 
-void WebSDRClient::setFrequency(float freq) {
-    if (!connected) return;
+bool WebSDRClient::pollWaterfall(float* bins) {
+    if (!waterfallClient || !waterfallClient->waterfall.update()) return false;
     
-    // KiwiSDR format: freq in kHz with 3 decimal places
-    float freqKhz = freq / 1000.0f;
-    std::stringstream ss;
-    ss << "SET mod=am low_cut=-4000 high_cut=4000 freq=" 
-       << std::fixed << std::setprecision(3) << freqKhz;
-    
-    if (sendWebSocketFrame(ss.str())) {
-        std::cout << "[WebSDR] Frequency changed to " << freqKhz << " kHz" << std::endl;
-    }
+    const WaterfallLine& line = waterfallClient->waterfall.read();
+    std::copy(line.bins, line.bins + WATERFALL_BINS, bins);
+    return true;
+}
+
+void WebSDRClient::setFrequency(float freq) {
+    if (this->freq.exchange(freq) == freq) return;
+    retune();
 }
 
 void WebSDRClient::setMode(const std::string& mode) {
-    if (!connected) return;
-    
     // Convert mode to KiwiSDR format
-    std::string kiwi_mode = mode;
-    if (mode == "usb") kiwi_mode = "usb";
-    else if (mode == "lsb") kiwi_mode = "lsb";
-    else if (mode == "fm") kiwi_mode = "nbfm";
-    else if (mode == "cw") kiwi_mode = "cw";
-    else kiwi_mode = "am";
-    
-    std::stringstream ss;
-    ss << "SET mod=" << kiwi_mode << " low_cut=-4000 high_cut=4000";
-    sendWebSocketFrame(ss.str());
+    int index = 0;  // am
+    if (mode == "fm" || mode == "nbfm") index = 1;
+    else if (mode == "usb") index = 2;
+    else if (mode == "lsb") index = 3;
+    else if (mode == "cw") index = 4;
+    
+    // a local demodulator picks the mode up from the next packet
+    if (modeIndex.exchange(index) == index || localDemodulation) return;
+    retune();
 }
 
 void WebSDRClient::setBandwidth(float bw) {
-    if (!connected) return;
-    
     float half_bw = bw / 2.0f;
-    std::stringstream ss;
-    ss << "SET low_cut=" << -half_bw << " high_cut=" << half_bw;
-    sendWebSocketFrame(ss.str());
+    bool changed = lowCut.exchange(-half_bw) != -half_bw;
+    changed |= highCut.exchange(half_bw) != half_bw;
+    if (!changed || localDemodulation) return;
+    retune();
 }
 
-void WebSDRClient::receiveLoop() {
-    std::cout << "[WebSDR] Receive thread started" << std::endl;
-    
-    uint8_t buffer[8192];
-    std::vector<float> audioSamples;
-    
-    while (!shouldStop && socketFd >= 0) {
-        fd_set readfds;
-        FD_ZERO(&readfds);
-        FD_SET(socketFd, &readfds);
-        
-        struct timeval tv = {0, 100000};  // 100ms timeout
-        
-        if (select(socketFd + 1, &readfds, NULL, NULL, &tv) > 0) {
-            int received = recv(socketFd, buffer, sizeof(buffer), 0);
-            
-            if (received > 0) {
-                // Parse WebSocket frame
-                if (received >= 2) {
-                    uint8_t fin = (buffer[0] & 0x80) != 0;
-                    uint8_t opcode = buffer[0] & 0x0F;
-                    bool masked = (buffer[1] & 0x80) != 0;
-                    uint64_t payloadLen = buffer[1] & 0x7F;
-                    
-                    size_t headerLen = 2;
-                    if (payloadLen == 126 && received >= 4) {
-                        payloadLen = (buffer[2] << 8) | buffer[3];
-                        headerLen = 4;
-                    } else if (payloadLen == 127 && received >= 10) {
-                        // Large payload (not handling for now)
-                        continue;
-                    }
-                    
-                    if (!masked && headerLen < received) {  // Server->client shouldn't be masked
-                        uint8_t* payload = buffer + headerLen;
-                        size_t dataLen = std::min((size_t)payloadLen, (size_t)(received - headerLen));
-                        
-                        if (opcode == 2) {  // Binary frame = audio
-                            processAudioPacket(payload, dataLen);
-                        } else if (opcode == 1) {  // Text frame
-                            std::string msg((char*)payload, dataLen);
-                            // Log server messages for debugging
-                            if (msg.find("MSG") != std::string::npos) {
-                                // Skip verbose MSG frames
-                            } else {
-                                std::cout << "[WebSDR] Server message: " << msg.substr(0, 100) << std::endl;
-                            }
-                        } else if (opcode == 9) {  // Ping
-                            // Send pong
-                            buffer[0] = 0x8A;  // FIN + Pong
-                            send(socketFd, buffer, received, 0);
-                        } else if (opcode == 8) {  // Close
-                            shouldStop = true;
-                            break;
-                        }
-                    }
-                }
-            } else if (received == 0) {
-                // Connection closed
-                std::cout << "[WebSDR] Connection closed by server" << std::endl;
-                break;
-            } else {
-                // Error
-                std::cerr << "[WebSDR] Receive error" << std::endl;
-                break;
-            }
-        }
-    }
-    
-    connected = false;
-    std::cout << "[WebSDR] Receive thread ended" << std::endl;
+void WebSDRClient::setCompression(bool enabled) {
+    if (compression.exchange(enabled) == enabled) return;
+    retune();
 }
 
-void WebSDRClient::processAudioPacket(const uint8_t* data, size_t len) {
-    // KiwiSDR audio format: 
-    // First check if it's a MSG frame (starts with "MSG ")
-    if (len > 4 && memcmp(data, "MSG ", 4) == 0) {
-        // Skip MSG frames for now
-        return;
-    }
-    
-    // Otherwise it's audio data
-    // KiwiSDR sends 16-bit signed PCM audio
-    std::vector<float> samples;
-    samples.reserve(len / 2);
-    
-    for (size_t i = 0; i + 1 < len; i += 2) {
-        // Little-endian 16-bit to float
-        int16_t sample = (int16_t)(data[i] | (data[i+1] << 8));
-        float normalized = sample / 32768.0f;
-        samples.push_back(normalized);
+WebSDRClient::Tuning WebSDRClient::getTuning() const {
+    Tuning tuning;
+    tuning.channel = channel;
+    tuning.freq = freq.load();
+    tuning.mode = KIWI_MODES[std::min(std::max(modeIndex.load(), 0), NUM_KIWI_MODES - 1)];
+    tuning.lowCut = lowCut.load();
+    tuning.highCut = highCut.load();
+    tuning.compression = compression.load();
+    if (channel == Channel::SOUND && localDemodulation) {
+        tuning.mode = "iq";
+        tuning.lowCut = -IQ_PASSBAND;
+        tuning.highCut = IQ_PASSBAND;
+        tuning.compression = false;
     }
-    
-    // Send to callback
-    if (!samples.empty()) {
-        std::lock_guard<std::mutex> lock(callbackMutex);
-        if (audioCallback) {
-            audioCallback(samples.data(), samples.size());
-        }
+    return tuning;
+}
+
+void WebSDRClient::setLocalDemodulation(bool enabled) {
+    if (localDemodulation.exchange(enabled) == enabled) return;
+    retune();
+}
+
+void WebSDRClient::retune() {
+    // Only the first request since the I/O thread last looked needs to tell it
+    if (!retunePending.exchange(true)) {
+        WebSDRClientManager::instance().retune(this);
     }
 }
 
-bool WebSDRClient::sendWebSocketFrame(const std::string& data) {
-    if (socketFd < 0) return false;
-    
-    std::vector<uint8_t> frame;
-    
-    // FIN + text opcode
-    frame.push_back(0x81);
-    
-    // Masked + length
-    if (data.size() < 126) {
-        frame.push_back(0x80 | data.size());
-    } else {
-        return false;  // Keep it simple for now
+void WebSDRClient::setAudioCallback(std::function<void(const float*, size_t)> callback) {
+    std::lock_guard<std::mutex> lock(callbackSetMutex);
+    int next = 1 - activeCallback.load();
+    audioCallbacks[next] = callback;
+    activeCallback.store(next);
+    
+    // Once the I/O thread is out of the callback the old slot is free to reuse
+    while (inCallback.load()) {
+        std::this_thread::yield();
     }
-    
-    // Masking key
-    uint8_t mask[4] = {0x12, 0x34, 0x56, 0x78};
-    frame.insert(frame.end(), mask, mask + 4);
-    
-    // Masked payload
-    for (size_t i = 0; i < data.size(); i++) {
-        frame.push_back(data[i] ^ mask[i % 4]);
+}
+
+void WebSDRClient::deliverWaterfall(const float* bins) {
+    // Only the I/O thread writes, so the triple buffer needs no lock
+    WaterfallLine& line = waterfall.write();
+    std::copy(bins, bins + WATERFALL_BINS, line.bins);
+    waterfall.publish();
+}
+
+void WebSDRClient::deliverIq(const float* iq, size_t frames) {
+    // left over from before local demodulation was switched off
+    if (!localDemodulation) return;
+    
+    demodulator.setSampleRate(sampleRate.load());
+    demodulator.setMode((IqDemodulator::Mode)modeIndex.load());
+    demodulator.setBandwidth(highCut.load() - lowCut.load());
+    if (frames > demodBuffer.size()) {
+        demodBuffer.resize(frames);
     }
-    
-    return send(socketFd, frame.data(), frame.size(), 0) > 0;
+    demodulator.process(iq, demodBuffer.data(), frames);
+    deliverAudio(demodBuffer.data(), frames);
 }
 
-bool WebSDRClient::receiveWebSocketFrame(std::vector<uint8_t>& data) {
-    // Not needed for now since receiveLoop handles everything
-    return false;
-}
\ No newline at end of file
+void WebSDRClient::deliverAudio(const float* samples, size_t count) {
+    // Both accesses are sequentially consistent, so a setter either sees
+    // inCallback set or we see its new slot
+    inCallback.store(true);
+    const std::function<void(const float*, size_t)>& callback = audioCallbacks[activeCallback.load()];
+    if (callback) {
+        callback(samples, count);
+    }
+    inCallback.store(false);
+}
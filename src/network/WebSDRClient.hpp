@@ -2,45 +2,223 @@
 #include <string>
 #include <vector>
 #include <functional>
-#include <thread>
 #include <atomic>
+#include <cstdint>
 #include <mutex>
+#include <memory>
+#include "../dsp/TripleBuffer.hpp"
+#include "../dsp/IqDemodulator.hpp"
+#include "CaptureFile.hpp"
 
+class WebSDRClientManager;
+class WebSDRSession;
+
+// Handle for one receiver's stream. The sockets and protocol live in
+// WebSDRSession objects driven by the plugin-wide WebSDRClientManager, so a
+// client owns no thread of its own, and clients tuned identically share one
+// session and one audio stream.
 class WebSDRClient {
 public:
+    enum class State {
+        DISCONNECTED,
+        RESOLVING,
+        CONNECTING,
+        HANDSHAKING,
+        STREAMING,
+        FAILED
+    };
+    
+    // Which of the server's streams a session carries
+    enum class Channel {
+        SOUND,
+        WATERFALL  // wideband W/F stream, independent of the tuning below
+    };
+    
+    struct Tuning {
+        Channel channel = Channel::SOUND;
+        float freq = 7055000.0f;
+        std::string mode = "am";  // KiwiSDR mode name
+        float lowCut = -4000.0f;
+        float highCut = 4000.0f;
+        bool compression = false;  // IMA ADPCM instead of 16-bit PCM, ~4x less bandwidth
+    };
+    
+    // Waterfall bins per line handed to the module, covering the whole 0-30 MHz band
+    static constexpr int WATERFALL_BINS = 256;
+    
+    // Passband requested from the server while demodulating locally, +-Hz
+    static constexpr float IQ_PASSBAND = 5000.0f;
+    
+    // Diagnostics, written by the I/O thread with relaxed atomics and safe
+    // to read from any thread. Clients sharing a session all count its traffic.
+    struct Stats {
+        std::atomic<uint64_t> bytesReceived{0};   // WebSocket payload bytes
+        std::atomic<uint64_t> framesReceived{0};  // WebSocket messages
+        std::atomic<uint64_t> audioPackets{0};
+        std::atomic<float> decodeMicros{0.0f};    // decoding one audio packet, smoothed
+        std::atomic<uint32_t> reconnects{0};      // sessions restarted after a drop
+        std::atomic<uint32_t> packetsLost{0};     // SND sequence gaps, filled in unless long
+    };
+    
+    // getRssi() before any SND header arrived
+    static constexpr float NO_RSSI = -1000.0f;
+    
+    // Automatic reconnect backoff, seconds: doubles from the minimum on
+    // every failure in a row, and a stream that stays up for
+    // RECONNECT_RESET_AFTER starts it over
+    static constexpr double RECONNECT_MIN_DELAY = 1.0;
+    static constexpr double RECONNECT_MAX_DELAY = 60.0;
+    static constexpr double RECONNECT_RESET_AFTER = 30.0;
+    
     WebSDRClient();
     ~WebSDRClient();
     
-    bool connect(const std::string& url);
+    // Start connecting in the background and return immediately.
+    // Servers are raced in the order given, each a quarter second after the
+    // one before, and the first to accept the connection streams. Pass
+    // serverProber().rankedServers() to start with the fastest.
+    void connect(const std::string& url);
+    void connect(const std::vector<std::string>& urls);
+    // Once this returns the audio callback will not be called again
     void disconnect();
-    bool isConnected() const { return connected.load(); }
+    // Returns at once, for the audio thread. The callback may still run for a
+    // moment afterwards, so whatever it writes to must outlive the call.
+    void disconnectAsync();
+    
+    // Keep the subscription but stop streaming: a paused client is detached
+    // from its session, so it holds no server slot, and resuming attaches it
+    // again at its current tuning. Lock-free like the tuning setters below,
+    // so process() can start and stop streams that a UI or worker thread
+    // connected; the I/O thread acts on it with the next retune. A client
+    // connected while paused only remembers its servers.
+    void setPaused(bool paused);
+    bool isPaused() const { return paused.load(); }
+    
+    // Reconnect on the I/O thread whenever the stream fails or the server
+    // hangs up, after an exponential backoff with random jitter so receivers
+    // on a server that went down don't all come back at once. The new
+    // session starts with the current tuning, fastest server first. Safe
+    // from any thread; off until enabled.
+    void setAutoReconnect(bool enabled);
+    bool getAutoReconnect() const { return autoReconnect.load(); }
+    
+    State getState() const { return state.load(); }
+    bool isConnected() const { return state.load() == State::STREAMING; }
+    
+    // Audio sample rate as reported by the server (sample_rate=, else audio_rate=)
+    double getSampleRate() const { return sampleRate.load(); }
     
+    const Stats& getStats() const { return stats; }
+    
+    // The server's S-meter in dBm, from the newest SND header
+    float getRssi() const { return rssi.load(std::memory_order_relaxed); }
+    
+    // Tuning is remembered and sent as part of the handshake, so these can be
+    // called before the connection is up. They never lock, allocate, block
+    // or touch the socket, so they are safe from process(): each one just
+    // overwrites the latest request and wakes the I/O thread, which sends
+    // whatever is newest as one SET frame, at most getRetuneRate() times a
+    // second.
     void setFrequency(float freq);
     void setMode(const std::string& mode);
     void setBandwidth(float bw);
+    void setCompression(bool enabled);
+    Tuning getTuning() const;
+    
+    // Stream IQ and demodulate on the I/O thread instead of on the server.
+    // Mode and bandwidth changes then apply to the next packet without a
+    // retune, and receivers on the same frequency share one stream whatever
+    // their modes. The callback still gets demodulated audio.
+    void setLocalDemodulation(bool enabled);
+    bool getLocalDemodulation() const { return localDemodulation.load(); }
+    
+    // Upper bound on retunes sent to the server, in Hz
+    void setRetuneRate(float hz) { retuneRate.store(hz); }
+    float getRetuneRate() const { return retuneRate.load(); }
     
-    // Callback for received audio data
-    void setAudioCallback(std::function<void(const float*, size_t)> callback) {
-        audioCallback = callback;
-    }
+    // Callback for received audio data, called on the manager's I/O thread.
+    // The I/O thread never locks to call it; replacing it waits for any call
+    // in progress, so don't call this from inside the callback.
+    void setAudioCallback(std::function<void(const float*, size_t)> callback);
     
+    // Write every frame this receiver's stream delivers to a capture file,
+    // from a background thread, until stopRecording(). Not from the audio
+    // thread: both open or close the file. Connecting to
+    // CAPTURE_URL_PREFIX + path plays the recording back in place of a server.
+    bool startRecording(const std::string& path) { return recorder.start(path, sampleRate.load()); }
+    void stopRecording() { recorder.stop(); }
+    bool isRecording() const { return recorder.isRecording(); }
+    const CaptureRecorder& getRecorder() const { return recorder; }
+    
+    // Also open the server's waterfall stream alongside the audio. Receivers
+    // on the same server share one waterfall session.
+    void setWaterfallEnabled(bool enabled);
+    // Copy the newest waterfall line (WATERFALL_BINS values, 0..1) into bins.
+    // Returns false if no new line arrived since the last call. One reader thread only.
+    bool pollWaterfall(float* bins);
+
 private:
-    std::atomic<bool> connected{false};
-    std::atomic<bool> shouldStop{false};
-    std::thread receiveThread;
+    friend class WebSDRClientManager;
+    friend class WebSDRSession;
+    
+    // published by the session this client is attached to
+    std::atomic<State> state{State::DISCONNECTED};
+    std::atomic<double> sampleRate{12000.0};
+    std::atomic<float> rssi{NO_RSSI};
+    Stats stats;
+    
+    std::atomic<bool> subscribed{false};
+    std::atomic<bool> paused{false};
+    std::atomic<int> pendingReleases{0};  // disconnectAsync() calls the I/O thread hasn't run yet
+    
+    std::mutex urlMutex;
+    std::vector<std::string> serverUrls;  // from the last connect()
+    
+    // Latest requested tuning, a slot the setters overwrite. retunePending
+    // is raised after the fields are stored and dropped by the I/O thread
+    // before it reads them, so no request is ever lost, only superseded.
+    Channel channel = Channel::SOUND;
+    std::atomic<float> freq;
+    std::atomic<int> modeIndex;  // into KIWI_MODES
+    std::atomic<float> lowCut;
+    std::atomic<float> highCut;
+    std::atomic<bool> compression;
+    std::atomic<bool> localDemodulation{false};
+    std::atomic<bool> retunePending{false};
+    std::atomic<float> retuneRate{20.0f};
+    double lastRetuneTime = -1.0e9;  // I/O thread only
+    
+    // Reconnect supervision by the manager, I/O thread only but the flag
+    std::atomic<bool> autoReconnect{false};
+    int reconnectFailures = 0;      // in a row, sets the backoff
+    double reconnectAt = -1.0;      // scheduled attempt, -1 if none
+    double streamingSince = -1.0;
+    
+    // I/O thread only: demodulates IQ packets in the mode set above
+    IqDemodulator demodulator;
+    std::vector<float> demodBuffer;
+    
+    // Fed by the I/O thread with every frame of the session
+    CaptureRecorder recorder;
     
-    std::string serverUrl;
-    int socketFd = -1;
+    // Two slots: setters fill the idle one and flip activeCallback
+    std::mutex callbackSetMutex;  // serialises setters only
+    std::function<void(const float*, size_t)> audioCallbacks[2];
+    std::atomic<int> activeCallback{0};
+    std::atomic<bool> inCallback{false};
     
-    std::mutex callbackMutex;
-    std::function<void(const float*, size_t)> audioCallback;
+    // Waterfall subscription, a second handle on the WATERFALL channel
+    struct WaterfallLine {
+        float bins[WATERFALL_BINS];
+    };
+    std::unique_ptr<WebSDRClient> waterfallClient;
+    std::atomic<bool> waterfallEnabled{false};
+    TripleBuffer<WaterfallLine> waterfall;  // filled on the waterfall handle itself
     
-    // WebSDR protocol handling
-    void receiveLoop();
-    bool sendCommand(const std::string& cmd);
-    void processAudioPacket(const uint8_t* data, size_t len);
+    explicit WebSDRClient(Channel channel);
     
-    // Simple WebSocket frame handling
-    bool sendWebSocketFrame(const std::string& data);
-    bool receiveWebSocketFrame(std::vector<uint8_t>& data);
-};
\ No newline at end of file
+    void retune();
+    void deliverAudio(const float* samples, size_t count);
+    void deliverIq(const float* iq, size_t frames);
+    void deliverWaterfall(const float* bins);
+};
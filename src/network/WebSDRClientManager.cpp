@@ -0,0 +1,385 @@
+#include "WebSDRClientManager.hpp"
+#include "WebSDRSession.hpp"
+#include "Socket.hpp"
+#include "AsyncLog.hpp"
+#include "ServerProber.hpp"
+#include <algorithm>
+#include <cmath>
+
+static const int POLL_TIMEOUT_MS = 100;  // upper bound, timeouts are checked every loop
+
+// Write end of the wake pipe. Kept outside the manager because lookup threads
+// may still finish after it has gone away at shutdown.
+static std::atomic<int> wakeFd{-1};
+
+WebSDRClientManager& WebSDRClientManager::instance() {
+    static WebSDRClientManager manager;
+    return manager;
+}
+
+WebSDRClientManager::WebSDRClientManager() : prober(serverProber()) {
+    // Constructed first, so the prober outlives the I/O thread at exit
+    prober.setWakeCallback(&WebSDRClientManager::wake);
+#ifdef _WIN32
+    WSADATA wsaData;
+    WSAStartup(MAKEWORD(2, 2), &wsaData);
+#else
+    int fds[2];
+    if (pipe(fds) == 0) {
+        setNonBlocking(fds[0]);
+        setNonBlocking(fds[1]);
+        wakeRead = fds[0];
+        wakeWrite = fds[1];
+        wakeFd = wakeWrite;
+    }
+#endif
+    
+    std::random_device seed;
+    jitter.seed(seed());
+    
+    running = true;
+    ioThread = std::thread(&WebSDRClientManager::ioLoop, this);
+}
+
+WebSDRClientManager::~WebSDRClientManager() {
+    running = false;
+    wake();
+    if (ioThread.joinable()) {
+        ioThread.join();
+    }
+    sessions.clear();
+    wakeFd = -1;
+
+#ifdef _WIN32
+    WSACleanup();
+#else
+    if (wakeRead >= 0) close(wakeRead);
+    if (wakeWrite >= 0) close(wakeWrite);
+#endif
+}
+
+void WebSDRClientManager::subscribe(WebSDRClient* client, const std::vector<std::string>& urls) {
+    client->subscribed = true;
+    post(Command{Command::SUBSCRIBE, client, urls, nullptr});
+}
+
+void WebSDRClientManager::unsubscribe(WebSDRClient* client, bool wait) {
+    bool wasSubscribed = client->subscribed.exchange(false);
+    if (!wait) {
+        if (wasSubscribed) {
+            client->pendingReleases++;
+            post(Command{Command::UNSUBSCRIBE, client, std::vector<std::string>(), nullptr});
+        }
+        return;
+    }
+    // a queued release still has to run before the caller may free the client
+    if (!wasSubscribed && client->pendingReleases == 0) return;
+    
+    std::promise<void> done;
+    std::future<void> acknowledged = done.get_future();
+    post(Command{Command::UNSUBSCRIBE, client, std::vector<std::string>(), &done});
+    acknowledged.wait();
+}
+
+void WebSDRClientManager::retune(WebSDRClient* client) {
+    if (!client->subscribed) return;
+    // One byte per pass of the I/O loop at most, from the first request
+    // since it last looked. The pipe is non-blocking, so a full one just
+    // means the loop is already due to wake.
+    if (!retuneRequested.exchange(true, std::memory_order_acq_rel)) wake();
+}
+
+void WebSDRClientManager::post(const Command& command) {
+    {
+        std::lock_guard<std::mutex> lock(commandMutex);
+        commands.push_back(command);
+    }
+    wake();
+}
+
+void WebSDRClientManager::wake() {
+#ifndef _WIN32
+    int fd = wakeFd.load();
+    if (fd >= 0) {
+        char byte = 1;
+        ssize_t ignored = write(fd, &byte, 1);
+        (void)ignored;
+    }
+#endif
+}
+
+void WebSDRClientManager::ioLoop() {
+    std::vector<pollfd> fds;
+    std::vector<WebSDRSession*> polled;
+    std::vector<size_t> polledCounts;  // fds each polled session added
+    
+    while (running) {
+        runCommands();
+        // cleared before looking, so a request from here on wakes the next poll
+        retuneRequested.store(false, std::memory_order_release);
+        double retuneDue = runRetunes(WebSDRSession::monotonicSeconds());
+        pruneSessions();
+        
+        fds.clear();
+        polled.clear();
+        polledCounts.clear();
+
+#ifdef _WIN32
+        // WSAPoll can't wait on a pipe, so commands are picked up on a short timeout
+        int timeoutMs = 10;
+#else
+        int timeoutMs = POLL_TIMEOUT_MS;
+        if (wakeRead >= 0) {
+            pollfd wakePfd;
+            wakePfd.fd = wakeRead;
+            wakePfd.events = POLLIN;
+            wakePfd.revents = 0;
+            fds.push_back(wakePfd);
+        }
+#endif
+        if (retuneDue >= 0.0) {
+            // a deferred retune has to go out on time even if nothing else happens
+            timeoutMs = std::min(timeoutMs, (int)std::ceil(retuneDue * 1000.0));
+        }
+        // and the next chunk of a capture being played back has to go out on time
+        double now = WebSDRSession::monotonicSeconds();
+        for (const std::unique_ptr<WebSDRSession>& session : sessions) {
+            double delay = session->getWakeDelay(now);
+            if (delay >= 0.0) timeoutMs = std::min(timeoutMs, (int)std::ceil(delay * 1000.0));
+        }
+        size_t firstProbe = fds.size();
+        size_t probeCount = prober.appendPollFds(fds);
+        size_t firstSession = fds.size();
+        
+        for (const std::unique_ptr<WebSDRSession>& session : sessions) {
+            size_t count = session->appendPollFds(fds);
+            if (count > 0) {
+                polled.push_back(session.get());
+                polledCounts.push_back(count);
+            }
+        }
+        
+        int ready = 0;
+        if (fds.empty()) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(timeoutMs));
+        } else {
+            ready = pollSockets(fds.data(), fds.size(), timeoutMs);
+        }
+
+#ifndef _WIN32
+        if (ready > 0 && firstProbe > 0 && (fds[0].revents & POLLIN)) {
+            char drain[64];
+            while (read(wakeRead, drain, sizeof(drain)) > 0) {}
+        }
+#endif
+        
+        if (ready > 0) {
+            prober.handlePollEvents(fds.data() + firstProbe, probeCount);
+            size_t first = firstSession;
+            for (size_t i = 0; i < polled.size(); i++) {
+                polled[i]->handlePollEvents(fds.data() + first, polledCounts[i]);
+                first += polledCounts[i];
+            }
+        }
+        
+        now = WebSDRSession::monotonicSeconds();
+        for (const std::unique_ptr<WebSDRSession>& session : sessions) {
+            session->update(now);
+        }
+        superviseReconnects(now);
+        prober.update(now, !sessions.empty());
+    }
+    
+    // Release anyone still waiting on an unsubscribe
+    runCommands();
+}
+
+void WebSDRClientManager::runCommands() {
+    std::vector<Command> pending;
+    {
+        std::lock_guard<std::mutex> lock(commandMutex);
+        pending.swap(commands);
+    }
+    
+    for (const Command& command : pending) {
+        WebSDRClient* client = command.client;
+        
+        switch (command.type) {
+            case Command::SUBSCRIBE: {
+                detach(client);
+                client->reconnectFailures = 0;
+                client->reconnectAt = -1.0;
+                clientUrls[client] = command.urls;
+                // a paused client joins once it's resumed
+                if (!client->paused) attach(client, command.urls, client->getTuning());
+                break;
+            }
+            case Command::UNSUBSCRIBE: {
+                detach(client);
+                clientUrls.erase(client);
+                client->state = WebSDRClient::State::DISCONNECTED;
+                if (command.done) {
+                    command.done->set_value();
+                } else {
+                    client->pendingReleases--;
+                }
+                break;
+            }
+        }
+    }
+}
+
+double WebSDRClientManager::runRetunes(double now) {
+    // Collect first, applying may move clients between sessions. Paused
+    // clients have no session but are subscribed all the same.
+    double due = -1.0;
+    dueRetunes.clear();
+    for (const auto& subscription : clientUrls) {
+        WebSDRClient* client = subscription.first;
+        if (!client->retunePending.load()) continue;
+        
+        double wait = client->lastRetuneTime + 1.0 / std::max(0.1f, client->retuneRate.load()) - now;
+        if (wait > 0.0) {
+            due = (due < 0.0) ? wait : std::min(due, wait);
+        } else {
+            dueRetunes.push_back(client);
+        }
+    }
+    
+    for (WebSDRClient* client : dueRetunes) {
+        // Dropped before the read, so a request landing mid-way is picked up next time
+        client->retunePending = false;
+        client->lastRetuneTime = now;
+        applyRetune(client);
+    }
+    return due;
+}
+
+void WebSDRClientManager::applyRetune(WebSDRClient* client) {
+    auto it = attachments.find(client);
+    bool attached = it != attachments.end();
+    
+    // Pausing leaves the session, which closes once nobody else listens
+    if (client->paused) {
+        if (attached) {
+            detach(client);
+            client->state = WebSDRClient::State::DISCONNECTED;
+        }
+        return;
+    }
+    if (!attached) {
+        client->reconnectFailures = 0;
+        client->reconnectAt = -1.0;
+        attach(client, clientUrls[client], client->getTuning());
+        return;
+    }
+    
+    WebSDRSession* session = it->second;
+    WebSDRClient::Tuning tuning = client->getTuning();
+    std::string key = WebSDRSession::makeKey(session->getUrls(), tuning);
+    if (key == session->getKey()) return;
+    
+    // A sole listener retunes its stream in place, unless someone
+    // else is already streaming exactly what it wants
+    WebSDRSession* existing = findSession(key);
+    if (session->getSubscriberCount() == 1 && !existing && session->isUsable()) {
+        session->retune(tuning);
+    } else {
+        detach(client);
+        attach(client, clientUrls[client], tuning);
+    }
+}
+
+void WebSDRClientManager::superviseReconnects(double now) {
+    dueSessions.clear();
+    for (const auto& attachment : attachments) {
+        WebSDRClient* client = attachment.first;
+        WebSDRClient::State state = attachment.second->getState();
+        
+        if (state == WebSDRClient::State::STREAMING) {
+            // A server that hangs up straight after accepting keeps the backoff growing
+            if (client->streamingSince < 0.0) client->streamingSince = now;
+            if (now - client->streamingSince >= WebSDRClient::RECONNECT_RESET_AFTER) client->reconnectFailures = 0;
+            continue;
+        }
+        client->streamingSince = -1.0;
+        if (state != WebSDRClient::State::FAILED || !client->autoReconnect.load()) {
+            client->reconnectAt = -1.0;
+            continue;
+        }
+        
+        if (client->reconnectAt < 0.0) {
+            // Somewhere between half and all of the doubled delay
+            double delay = WebSDRClient::RECONNECT_MIN_DELAY * std::pow(2.0, std::min(client->reconnectFailures, 16));
+            delay = std::min(delay, WebSDRClient::RECONNECT_MAX_DELAY);
+            delay *= std::uniform_real_distribution<double>(0.5, 1.0)(jitter);
+            client->reconnectAt = now + delay;
+            client->reconnectFailures++;
+            WEBSDR_INFO("Reconnecting in %.1f s", delay);
+        } else if (now >= client->reconnectAt) {
+            WebSDRSession* session = attachment.second;
+            if (std::find(dueSessions.begin(), dueSessions.end(), session) == dueSessions.end()) dueSessions.push_back(session);
+        }
+    }
+    if (dueSessions.empty()) return;
+    
+    // Listeners of one session only ever cost one stream, so the first one
+    // due takes the others along; they meet again in the new session, which
+    // resumes at their current tuning
+    dueReconnects.clear();
+    for (const auto& attachment : attachments) {
+        if (attachment.first->reconnectAt >= 0.0 &&
+            std::find(dueSessions.begin(), dueSessions.end(), attachment.second) != dueSessions.end()) {
+            dueReconnects.push_back(attachment.first);
+        }
+    }
+    for (WebSDRClient* client : dueReconnects) {
+        client->reconnectAt = -1.0;
+        client->stats.reconnects.fetch_add(1, std::memory_order_relaxed);
+        std::vector<std::string>& urls = clientUrls[client];
+        urls = prober.rank(urls);
+        detach(client);
+        attach(client, urls, client->getTuning());
+    }
+}
+
+void WebSDRClientManager::attach(WebSDRClient* client, const std::vector<std::string>& urls, const WebSDRClient::Tuning& tuning) {
+    if (urls.empty()) return;
+    
+    WebSDRSession* session = findSession(WebSDRSession::makeKey(urls, tuning));
+    if (!session) {
+        sessions.emplace_back(new WebSDRSession(urls, tuning, &WebSDRClientManager::wake));
+        session = sessions.back().get();
+        sessionCount = sessions.size();
+    }
+    session->addSubscriber(client);
+    attachments[client] = session;
+}
+
+void WebSDRClientManager::detach(WebSDRClient* client) {
+    auto it = attachments.find(client);
+    if (it == attachments.end()) return;
+    
+    it->second->removeSubscriber(client);
+    attachments.erase(it);
+    pruneSessions();
+}
+
+WebSDRSession* WebSDRClientManager::findSession(const std::string& key) {
+    // Failed sessions keep their listeners (so they can see the failure) but
+    // are never shared with newcomers
+    for (const std::unique_ptr<WebSDRSession>& session : sessions) {
+        if (session->isUsable() && session->getKey() == key) {
+            return session.get();
+        }
+    }
+    return nullptr;
+}
+
+void WebSDRClientManager::pruneSessions() {
+    sessions.erase(std::remove_if(sessions.begin(), sessions.end(),
+        [](const std::unique_ptr<WebSDRSession>& session) {
+            return session->getSubscriberCount() == 0;
+        }), sessions.end());
+    sessionCount = sessions.size();
+}
@@ -0,0 +1,82 @@
+#pragma once
+#include "WebSDRClient.hpp"
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <future>
+#include <random>
+
+class WebSDRSession;
+class ServerProber;
+
+// Plugin-wide owner of every WebSDR connection. A single I/O thread polls all
+// sessions' sockets; receivers attach to sessions through WebSDRClient handles.
+// Subscriptions to the same servers with the same tuning share one session,
+// so two receivers on the same frequency cost one socket and one decode.
+class WebSDRClientManager {
+public:
+    static WebSDRClientManager& instance();
+    ~WebSDRClientManager();
+    
+    // All of these return immediately except unsubscribe, which by default
+    // waits until the I/O thread has detached the client.
+    void subscribe(WebSDRClient* client, const std::vector<std::string>& urls);
+    void unsubscribe(WebSDRClient* client, bool wait = true);
+    // The client's new tuning, or pause, is in its own slots; this only
+    // raises a flag and wakes the I/O thread with a non-blocking pipe write,
+    // never locking or waiting, so it may be called from the audio thread
+    void retune(WebSDRClient* client);
+    
+    // Number of live sessions, for diagnostics
+    size_t getSessionCount() const { return sessionCount.load(); }
+
+private:
+    WebSDRClientManager();
+    
+    struct Command {
+        enum Type { SUBSCRIBE, UNSUBSCRIBE };
+        Type type;
+        WebSDRClient* client;
+        std::vector<std::string> urls;
+        std::promise<void>* done;
+    };
+    
+    std::mutex commandMutex;
+    std::vector<Command> commands;
+    
+    std::thread ioThread;
+    std::atomic<bool> running{false};
+    std::atomic<size_t> sessionCount{0};
+    std::atomic<bool> retuneRequested{false};  // woken for a retune since the loop last looked
+    
+    // I/O thread only
+    ServerProber& prober;  // stepped alongside the sessions
+    std::vector<std::unique_ptr<WebSDRSession>> sessions;
+    std::map<WebSDRClient*, WebSDRSession*> attachments;
+    std::map<WebSDRClient*, std::vector<std::string>> clientUrls;
+    std::vector<WebSDRClient*> dueRetunes;
+    std::vector<WebSDRSession*> dueSessions;
+    std::vector<WebSDRClient*> dueReconnects;
+    std::mt19937 jitter;
+    
+    // self-pipe so commands, retunes and finished lookups interrupt poll()
+    int wakeRead = -1;
+    int wakeWrite = -1;
+    
+    void post(const Command& command);
+    static void wake();
+    
+    void ioLoop();
+    void runCommands();
+    double runRetunes(double now);
+    void applyRetune(WebSDRClient* client);
+    void superviseReconnects(double now);
+    void attach(WebSDRClient* client, const std::vector<std::string>& urls, const WebSDRClient::Tuning& tuning);
+    void detach(WebSDRClient* client);
+    WebSDRSession* findSession(const std::string& key);
+    void pruneSessions();
+};
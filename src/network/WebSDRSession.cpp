@@ -0,0 +1,755 @@
+#include "WebSDRSession.hpp"
+#include "Socket.hpp"
+#include "Resolver.hpp"
+#include "ServerProber.hpp"
+#include "../dsp/SampleConvert.hpp"
+#include "../dsp/PolyphaseResampler.hpp"
+#include "SndPacket.hpp"
+#include "AsyncLog.hpp"
+#include <cstring>
+#include <cstdlib>
+#include <sstream>
+#include <cstdio>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <chrono>
+
+static const double CONNECT_TIMEOUT = 5.0;  // seconds, per address
+static const double ATTEMPT_DELAY = 0.25;   // before the next server joins the race, as RFC 8305
+static const size_t RECV_CHUNK = 8192;      // minimum free arena space per recv()
+static const size_t DECODE_BUFFER_SIZE = 8192;  // samples, more than a Kiwi packet holds
+static const uint32_t MAX_CONCEALED_PACKETS = 8;  // longer gaps just resync
+static const size_t WF_HEADER_SIZE = 16;
+static const float WF_MIN_DB = -130.0f;  // rough noise floor of an HF waterfall
+static const float WF_MAX_DB = -30.0f;   // strong broadcast carrier
+static const double PLAYBACK_LOOP_GAP = 0.1;  // seconds of silence before a capture starts over
+
+// One server in the connection race
+struct WebSDRSession::Attempt {
+    std::string url;
+    std::string host;
+    int port = KIWI_DEFAULT_PORT;
+    std::shared_ptr<ResolveJob> resolveJob;
+    addrinfo* address = nullptr;  // being connected to
+    int fd = -1;
+    double deadline = 0.0;
+    bool failed = false;
+    
+    ~Attempt() {
+        if (fd >= 0) closeSocketFd(fd);
+    }
+};
+
+double WebSDRSession::monotonicSeconds() {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+WebSDRSession::WebSDRSession(const std::vector<std::string>& urls, const WebSDRClient::Tuning& tuning, void (*wake)())
+    : tuning(tuning), serverUrls(urls), wakeCallback(wake) {
+    decodeBuffer.resize(DECODE_BUFFER_SIZE);
+    concealBuffer.resize(PacketConcealer::MAX_VALUES);
+    key = makeKey(urls, tuning);
+    startRace();
+}
+
+WebSDRSession::WebSDRSession(const WebSDRClient::Tuning& tuning) : tuning(tuning) {
+    decodeBuffer.resize(DECODE_BUFFER_SIZE);
+    concealBuffer.resize(PacketConcealer::MAX_VALUES);
+    key = makeKey(serverUrls, tuning);
+    state = WebSDRClient::State::STREAMING;
+}
+
+WebSDRSession::~WebSDRSession() {
+    closeSocket();
+}
+
+std::string WebSDRSession::makeKey(const std::vector<std::string>& urls, const WebSDRClient::Tuning& tuning) {
+    // The order only says which server to try first
+    std::vector<std::string> sorted = urls;
+    std::sort(sorted.begin(), sorted.end());
+    std::stringstream ss;
+    for (const std::string& url : sorted) ss << url << ",";
+    
+    // The waterfall always shows the whole band, so every listener can share it
+    if (tuning.channel == WebSDRClient::Channel::WATERFALL) {
+        ss << "|wf";
+        return ss.str();
+    }
+    ss << "|" << tuning.mode << "|" << (long)tuning.freq
+       << "|" << (int)tuning.lowCut << "|" << (int)tuning.highCut
+       << "|" << (tuning.compression ? "adpcm" : "pcm");
+    return ss.str();
+}
+
+void WebSDRSession::addSubscriber(WebSDRClient* client) {
+    subscribers.push_back(client);
+    client->sampleRate = sampleRate;
+    client->state = state;
+}
+
+void WebSDRSession::removeSubscriber(WebSDRClient* client) {
+    subscribers.erase(std::remove(subscribers.begin(), subscribers.end(), client), subscribers.end());
+}
+
+void WebSDRSession::setState(WebSDRClient::State newState) {
+    state = newState;
+    for (WebSDRClient* client : subscribers) {
+        client->state = newState;
+    }
+}
+
+void WebSDRSession::retune(const WebSDRClient::Tuning& newTuning) {
+    bool formatChanged = newTuning.compression != tuning.compression;
+    tuning = newTuning;
+    key = makeKey(serverUrls, tuning);
+    
+    // A capture plays as recorded
+    if (tuning.channel == WebSDRClient::Channel::WATERFALL || capture.data()) return;
+    
+    if (state == WebSDRClient::State::STREAMING) {
+        if (formatChanged) {
+            adpcm.reset();
+            sendWebSocketFrame(tuning.compression ? "SET AUDIO_COMP=1" : "SET AUDIO_COMP=0");
+        }
+        if (sendWebSocketFrame(tuningCommand())) {
+            WEBSDR_DEBUG("Frequency changed to %.3f kHz", tuning.freq / 1000.0f);
+        }
+        flushSendQueue();
+    }
+}
+
+const char* WebSDRSession::tuningCommand() {
+    // Mode, passband and frequency in one frame. KiwiSDR format: freq in kHz with 3 decimal places
+    snprintf(commandText, sizeof(commandText), "SET mod=%s low_cut=%d high_cut=%d freq=%.3f",
+             tuning.mode.c_str(), (int)tuning.lowCut, (int)tuning.highCut, tuning.freq / 1000.0f);
+    return commandText;
+}
+
+size_t WebSDRSession::appendPollFds(std::vector<pollfd>& fds) const {
+    pollfd pfd;
+    pfd.revents = 0;
+    
+    if (isRacing()) {
+        // every server still in the race waits for its connect to finish
+        size_t added = 0;
+        for (const std::unique_ptr<Attempt>& attempt : attempts) {
+            if (attempt->fd < 0) continue;
+            pfd.fd = attempt->fd;
+            pfd.events = POLLOUT;
+            fds.push_back(pfd);
+            added++;
+        }
+        return added;
+    }
+    
+    if (socketFd < 0) return 0;
+    pfd.fd = socketFd;
+    pfd.events = POLLIN;
+    if (!writer.empty()) pfd.events |= POLLOUT;
+    fds.push_back(pfd);
+    return 1;
+}
+
+void WebSDRSession::handlePollEvents(const pollfd* fds, size_t count) {
+    if (isRacing()) {
+        // writable (or error) means a non-blocking connect has finished;
+        // the first one through wins
+        double now = monotonicSeconds();
+        for (size_t i = 0; i < count && isRacing(); i++) {
+            if (fds[i].revents == 0) continue;
+            for (const std::unique_ptr<Attempt>& attempt : attempts) {
+                if (attempt->fd != fds[i].fd) continue;
+                
+                if (connectSucceeded(attempt->fd)) {
+                    winRace(*attempt, now);
+                } else {
+                    nextAddress(*attempt, now);
+                }
+                break;
+            }
+        }
+        flushSendQueue();
+        return;
+    }
+    
+    short revents = count > 0 ? fds[0].revents : 0;
+    if (socketFd < 0 || revents == 0) return;
+    
+    if (revents & (POLLIN | POLLERR | POLLHUP)) {
+        // Receive straight into the frame reader's arena
+        uint8_t* dst = reader.prepare(RECV_CHUNK);
+        int received = recv(socketFd, (char*)dst, reader.writable(), 0);
+        
+        if (received > 0) {
+            reader.commit(received);
+            if (state == WebSDRClient::State::HANDSHAKING) {
+                onHandshakeData();
+            } else {
+                processFrames();
+            }
+        } else if (received == 0 || !lastErrorWouldBlock()) {
+            if (state == WebSDRClient::State::STREAMING) {
+                WEBSDR_INFO("Connection closed by server");
+                closeSocket();
+                setState(WebSDRClient::State::FAILED);
+                return;
+            }
+            // dropped during the handshake, the other servers get another go
+            resumeRace();
+        }
+    }
+    
+    // Replies queued while handling these events, and anything left over
+    // from a full socket, go out together
+    flushSendQueue();
+}
+
+void WebSDRSession::receive(const uint8_t* data, size_t len) {
+    if (state != WebSDRClient::State::STREAMING) return;
+    
+    uint8_t* dst = reader.prepare(len);
+    memcpy(dst, data, len);
+    reader.commit(len);
+    processFrames();
+}
+
+void WebSDRSession::update(double now) {
+    if (capture.data()) {
+        playCapture(now);
+        return;
+    }
+    
+    if (isRacing()) {
+        stepRace(now);
+        return;
+    }
+    
+    // the handshake has a deadline
+    if (state == WebSDRClient::State::HANDSHAKING && now > attemptDeadline) {
+        WEBSDR_WARN("Timed out connecting to %s", serverUrl.c_str());
+        resumeRace();
+    }
+}
+
+double WebSDRSession::getWakeDelay(double now) const {
+    // the next server joins the race on time
+    if (isRacing() && attemptsStarted < attempts.size()) return std::max(0.0, nextAttemptTime - now);
+    
+    if (!capture.data() || !chunkPending || state != WebSDRClient::State::STREAMING) return -1.0;
+    return std::max(0.0, playbackStart + nextChunk.micros * 1e-6 - now);
+}
+
+bool WebSDRSession::isRacing() const {
+    return state == WebSDRClient::State::RESOLVING || state == WebSDRClient::State::CONNECTING;
+}
+
+void WebSDRSession::startRace() {
+    attempts.clear();
+    for (const std::string& url : serverUrls) {
+        std::unique_ptr<Attempt> attempt(new Attempt);
+        attempt->url = url;
+        if (!isCaptureUrl(url)) parseServerUrl(url, attempt->host, attempt->port);
+        attempts.push_back(std::move(attempt));
+    }
+    attemptsStarted = 0;
+    setState(WebSDRClient::State::RESOLVING);
+    stepRace(monotonicSeconds());
+}
+
+void WebSDRSession::resumeRace() {
+    // The winner is out; the others only lost, so they connect again at once
+    closeSocket();
+    for (const std::unique_ptr<Attempt>& attempt : attempts) {
+        if (attempt->url == serverUrl) attempt->failed = true;
+        attempt->address = nullptr;
+    }
+    setState(WebSDRClient::State::RESOLVING);
+    stepRace(monotonicSeconds());
+}
+
+void WebSDRSession::stepRace(double now) {
+    size_t running = 0;
+    for (size_t i = 0; i < attemptsStarted; i++) {
+        Attempt& attempt = *attempts[i];
+        if (attempt.failed) continue;
+        
+        if (attempt.fd < 0 && attempt.resolveJob->done) {
+            if (!attempt.resolveJob->result) {
+                WEBSDR_WARN("Failed to resolve %s", attempt.host.c_str());
+                attempt.failed = true;
+                continue;
+            }
+            nextAddress(attempt, now);
+        } else if (attempt.fd >= 0 && now > attempt.deadline) {
+            WEBSDR_WARN("Timed out connecting to %s", attempt.url.c_str());
+            nextAddress(attempt, now);
+        }
+        if (!attempt.failed) running++;
+    }
+    
+    // Happy eyeballs: the next server joins after ATTEMPT_DELAY, or right
+    // away once everything before it has failed
+    while (attemptsStarted < attempts.size() && (running == 0 || now >= nextAttemptTime)) {
+        Attempt& attempt = *attempts[attemptsStarted++];
+        nextAttemptTime = now + ATTEMPT_DELAY;
+        
+        if (isCaptureUrl(attempt.url)) {
+            // nothing to race, it either opens or it doesn't
+            if (startPlayback(attempt.url.substr(sizeof(CAPTURE_URL_PREFIX) - 1))) {
+                serverUrl = attempt.url;
+                attempts.clear();
+                return;
+            }
+            attempt.failed = true;
+            continue;
+        }
+        
+        WEBSDR_INFO("Connecting to %s:%d", attempt.host.c_str(), attempt.port);
+        attempt.resolveJob = startResolve(attempt.host, attempt.port, wakeCallback);
+        running++;
+    }
+    
+    if (running == 0) {
+        WEBSDR_WARN("No server reachable");
+        attempts.clear();
+        setState(WebSDRClient::State::FAILED);
+        // whatever the ranking said is out of date
+        serverProber().requestProbe();
+    }
+}
+
+bool WebSDRSession::startPlayback(const std::string& path) {
+    if (!capture.open(path) || !CaptureReader(capture.data(), capture.size()).isValid()) {
+        WEBSDR_WARN("Can't play back %s", path.c_str());
+        capture.close();
+        return false;
+    }
+    
+    WEBSDR_INFO("Playing back %s", path.c_str());
+    captureReader = CaptureReader(capture.data(), capture.size());
+    restartPlayback(monotonicSeconds());
+    setState(WebSDRClient::State::STREAMING);
+    return true;
+}
+
+void WebSDRSession::restartPlayback(double start) {
+    // From the top, as if the server had just accepted us
+    captureReader.rewind();
+    chunkPending = captureReader.next(nextChunk);
+    playbackStart = start;
+    reader.reset();
+    adpcm.reset();
+    concealer.reset();
+    sequenceKnown = false;
+}
+
+void WebSDRSession::playCapture(double now) {
+    // Everything that was due by now, in order
+    while (state == WebSDRClient::State::STREAMING && chunkPending &&
+           playbackStart + nextChunk.micros * 1e-6 <= now) {
+        double arrival = playbackStart + nextChunk.micros * 1e-6;
+        receive(nextChunk.data, nextChunk.length);
+        chunkPending = captureReader.next(nextChunk);
+        
+        if (!chunkPending) {
+            // Loop, but only catch up on a short stall, not an hour asleep
+            double restart = arrival + PLAYBACK_LOOP_GAP;
+            restartPlayback(restart < now - 1.0 ? now : restart);
+        }
+    }
+}
+
+void WebSDRSession::nextAddress(Attempt& attempt, double now) {
+    if (attempt.fd >= 0) {
+        closeSocketFd(attempt.fd);
+        attempt.fd = -1;
+    }
+    
+    // Walk the resolved addresses (IPv6 and IPv4) before giving up on this server
+    attempt.address = attempt.address ? attempt.address->ai_next : attempt.resolveJob->result;
+    for (; attempt.address; attempt.address = attempt.address->ai_next) {
+        int fd = startConnect(attempt.address);
+        if (fd < 0) continue;
+        
+        attempt.fd = fd;
+        attempt.deadline = now + CONNECT_TIMEOUT;
+        if (state == WebSDRClient::State::RESOLVING) setState(WebSDRClient::State::CONNECTING);
+        return;
+    }
+    attempt.failed = true;
+}
+
+void WebSDRSession::winRace(Attempt& attempt, double now) {
+    // The losers are dropped before they send a byte, so they never hold
+    // a slot on their server
+    socketFd = attempt.fd;
+    attempt.fd = -1;
+    for (const std::unique_ptr<Attempt>& other : attempts) {
+        if (other->fd >= 0) {
+            closeSocketFd(other->fd);
+            other->fd = -1;
+        }
+    }
+    serverUrl = attempt.url;
+    host = attempt.host;
+    port = attempt.port;
+    
+    // Send WebSocket upgrade request
+    std::stringstream ws_request;
+    const char* stream = (tuning.channel == WebSDRClient::Channel::WATERFALL) ? "W/F" : "SND";
+    ws_request << "GET /kiwi/" << port << "/" << stream << " HTTP/1.1\r\n"
+               << "Host: " << host << ":" << port << "\r\n"
+               << "Upgrade: websocket\r\n"
+               << "Connection: Upgrade\r\n"
+               << "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+               << "Sec-WebSocket-Version: 13\r\n\r\n";
+    std::string request = ws_request.str();
+    
+    reader.reset();
+    writer.clear();
+    setState(WebSDRClient::State::HANDSHAKING);
+    attemptDeadline = now + CONNECT_TIMEOUT;
+    writer.appendRaw((const uint8_t*)request.data(), request.size());
+}
+
+void WebSDRSession::onHandshakeData() {
+    static const char HEADER_END[] = "\r\n\r\n";
+    const char* response = (const char*)reader.data();
+    const char* end = response + reader.size();
+    
+    const char* headerEnd = std::search(response, end, HEADER_END, HEADER_END + 4);
+    if (headerEnd == end) {
+        if (reader.size() > 8192) {
+            WEBSDR_WARN("WebSocket upgrade failed");
+            resumeRace();
+        }
+        return;
+    }
+    
+    // Check for 101 response
+    std::string header(response, headerEnd);
+    if (header.find("101 Switching Protocols") == std::string::npos) {
+        WEBSDR_WARN("WebSocket upgrade failed");
+        resumeRace();
+        return;
+    }
+    
+    WEBSDR_INFO("WebSocket connected to %s", serverUrl.c_str());
+    rateAcknowledged = false;
+    adpcm.reset();
+    concealer.reset();
+    sequenceKnown = false;
+    setState(WebSDRClient::State::STREAMING);
+    
+    // Pipeline the whole session setup; the server processes them in order
+    sendWebSocketFrame("SET auth t=kiwi p=");
+    if (tuning.channel == WebSDRClient::Channel::WATERFALL) {
+        // Fully zoomed out, uncompressed 8-bit dB values, a few lines a second
+        sendWebSocketFrame("SET zoom=0 start=0");
+        sendWebSocketFrame("SET maxdb=0 mindb=-100");
+        sendWebSocketFrame("SET wf_speed=2");
+        sendWebSocketFrame("SET wf_comp=0");
+        sendWebSocketFrame("SET keepalive");
+    } else {
+        sendSoundSetup();
+    }
+    
+    // Anything after the HTTP header is already WebSocket data
+    reader.consume(headerEnd + 4 - response);
+    processFrames();
+}
+
+void WebSDRSession::sendSoundSetup() {
+    // SET AR OK waits for the server's audio_rate, see processServerMessage()
+    sendWebSocketFrame("SET squelch=0 max=0");
+    sendWebSocketFrame("SET genattn=0");
+    sendWebSocketFrame(tuningCommand());
+    sendWebSocketFrame("SET keepalive");
+    sendWebSocketFrame(tuning.compression ? "SET AUDIO_COMP=1" : "SET AUDIO_COMP=0");
+    sendWebSocketFrame("SET AUDIO_START=1");
+}
+
+void WebSDRSession::closeSocket() {
+    if (socketFd >= 0) {
+        closeSocketFd(socketFd);
+        socketFd = -1;
+    }
+    writer.clear();
+}
+
+void WebSDRSession::flushSendQueue() {
+    // Frames sit back to back in the writer, so a batch is one send()
+    while (socketFd >= 0 && !writer.empty()) {
+        int sent = send(socketFd, (const char*)writer.data(), writer.size(), SEND_FLAGS);
+        if (sent < 0) {
+            if (lastErrorWouldBlock()) return;  // the rest goes on POLLOUT
+            
+            if (state == WebSDRClient::State::HANDSHAKING) {
+                resumeRace();
+                return;
+            }
+            WEBSDR_WARN("Send failed");
+            closeSocket();
+            setState(WebSDRClient::State::FAILED);
+            return;
+        }
+        writer.consume(sent);
+    }
+}
+
+void WebSDRSession::processFrames() {
+    WebSocketFrameReader::Message msg;
+    
+    // Errors and close frames leave STREAMING, which stops the loop
+    while (state == WebSDRClient::State::STREAMING) {
+        WebSocketFrameReader::Result result = reader.next(msg);
+        if (result == WebSocketFrameReader::NEED_MORE) return;
+        
+        if (result == WebSocketFrameReader::PROTOCOL_ERROR) {
+            WEBSDR_WARN("Malformed WebSocket frame, closing");
+            closeSocket();
+            setState(WebSDRClient::State::FAILED);
+            return;
+        }
+        
+        for (WebSDRClient* client : subscribers) {
+            client->stats.framesReceived.fetch_add(1, std::memory_order_relaxed);
+            client->stats.bytesReceived.fetch_add(msg.length, std::memory_order_relaxed);
+            if (msg.opcode == 1 || msg.opcode == 2) {
+                client->recorder.record(msg.opcode, msg.data, msg.length);
+            }
+        }
+        
+        if (msg.opcode == 2 && tuning.channel == WebSDRClient::Channel::WATERFALL) {
+            processWaterfallPacket(msg.data, msg.length);
+        } else if (msg.opcode == 2) {  // Binary frame = audio
+            processAudioPacket(msg.data, msg.length);
+        } else if (msg.opcode == 1) {  // Text frame
+            // Log server messages for debugging, skipping the verbose MSG frames
+            const char* text = (const char*)msg.data;
+            const char* tag = "MSG";
+            if (std::search(text, text + msg.length, tag, tag + 3) == text + msg.length) {
+                WEBSDR_DEBUG("Server message: %.*s", (int)std::min<size_t>(msg.length, 100), text);
+            }
+        } else if (msg.opcode == 9) {  // Ping
+            // Pong echoes the ping payload
+            sendFrame(0xA, msg.data, msg.length);
+        } else if (msg.opcode == 8) {  // Close
+            closeSocket();
+            setState(WebSDRClient::State::FAILED);
+        }
+    }
+}
+
+void WebSDRSession::processAudioPacket(const uint8_t* data, size_t len) {
+    // KiwiSDR audio format:
+    // First check if it's a MSG frame (starts with "MSG ")
+    if (len > 4 && memcmp(data, "MSG ", 4) == 0) {
+        processServerMessage(std::string((const char*)data + 4, len - 4));
+        return;
+    }
+    
+    // Without a header the format can only follow the tuning
+    bool stereo = tuning.mode == "iq";
+    bool compressed = tuning.compression && !stereo;
+    SndHeader header;
+    if (parseSndHeader(data, len, header)) {
+        // The flags say what this packet is, even while a format change is on its way
+        data += header.size;
+        len -= header.size;
+        stereo = header.isStereo();
+        compressed = header.isCompressed();
+        for (WebSDRClient* client : subscribers) {
+            client->rssi.store(header.rssi, std::memory_order_relaxed);
+        }
+        concealer.setChannels(stereo ? 2 : 1);
+        concealLostPackets(header.sequence, stereo);
+    }
+    
+    double decodeStart = monotonicSeconds();
+    size_t count;
+    if (compressed) {
+        // IMA ADPCM, two samples per byte
+        count = len * 2;
+        if (count == 0) return;
+        if (count > decodeBuffer.size()) {
+            decodeBuffer.resize(count);
+        }
+        adpcm.decode(data, len, decodeBuffer.data());
+    } else {
+        // 16-bit signed PCM, I/Q pairs when stereo
+        count = stereo ? len / 4 * 2 : len / 2;
+        if (count == 0) return;
+        if (count > decodeBuffer.size()) {
+            // only if the server sends unusually large packets
+            decodeBuffer.resize(count);
+        }
+        convertInt16LE(data, decodeBuffer.data(), count);
+    }
+    concealer.receive(decodeBuffer.data(), count);
+    
+    if (stereo) {
+        // Each client demodulates in its own mode, so the timing includes that
+        deliverIq(decodeBuffer.data(), count / 2);
+        recordAudioPacket(monotonicSeconds() - decodeStart);
+    } else {
+        recordAudioPacket(monotonicSeconds() - decodeStart);
+        deliverAudio(decodeBuffer.data(), count);
+    }
+}
+
+void WebSDRSession::concealLostPackets(uint32_t sequence, bool stereo) {
+    bool first = !sequenceKnown;
+    uint32_t missing = sequence - expectedSequence;  // wraps like the counter
+    sequenceKnown = true;
+    expectedSequence = sequence + 1;
+    if (first || missing == 0) return;
+    
+    // Far out of line is a server restart or a long stall, not loss worth filling
+    if (missing > MAX_CONCEALED_PACKETS) {
+        concealer.reset();
+        return;
+    }
+    
+    for (WebSDRClient* client : subscribers) {
+        client->stats.packetsLost.fetch_add(missing, std::memory_order_relaxed);
+    }
+    size_t count = concealer.packetSize();
+    if (count == 0) return;
+    for (uint32_t i = 0; i < missing; i++) {
+        concealer.conceal(concealBuffer.data());
+        if (stereo) {
+            deliverIq(concealBuffer.data(), count / 2);
+        } else {
+            deliverAudio(concealBuffer.data(), count);
+        }
+    }
+}
+
+void WebSDRSession::recordAudioPacket(double decodeSeconds) {
+    float micros = (float)(decodeSeconds * 1e6);
+    for (WebSDRClient* client : subscribers) {
+        WebSDRClient::Stats& stats = client->stats;
+        stats.audioPackets.fetch_add(1, std::memory_order_relaxed);
+        // single writer, so a plain load/store moving average is enough
+        float average = stats.decodeMicros.load(std::memory_order_relaxed);
+        stats.decodeMicros.store(average + (micros - average) * 0.05f, std::memory_order_relaxed);
+    }
+}
+
+void WebSDRSession::deliverIq(const float* iq, size_t frames) {
+    for (WebSDRClient* client : subscribers) {
+        client->deliverIq(iq, frames);
+    }
+}
+
+void WebSDRSession::deliverAudio(const float* samples, size_t count) {
+    // Fan out to everyone sharing this stream
+    for (WebSDRClient* client : subscribers) {
+        client->deliverAudio(samples, count);
+    }
+}
+
+void WebSDRSession::processWaterfallPacket(const uint8_t* data, size_t len) {
+    // W/F packets: "W/F", one pad byte, then x_bin, flags/zoom and sequence
+    // (32 bits each) ahead of one byte per bin. Anything else (MSG setup
+    // frames) isn't needed here.
+    if (len <= WF_HEADER_SIZE || memcmp(data, "W/F", 3) != 0) return;
+    data += WF_HEADER_SIZE;
+    len -= WF_HEADER_SIZE;
+    
+    // Reduce the server's line (1024 bins) to WATERFALL_BINS, keeping the
+    // strongest bin of each group so narrow carriers aren't averaged away
+    const int bins = WebSDRClient::WATERFALL_BINS;
+    for (int b = 0; b < bins; b++) {
+        size_t first = b * len / bins;
+        size_t last = std::max(first + 1, (b + 1) * len / bins);
+        uint8_t peak = 0;
+        for (size_t i = first; i < last && i < len; i++) {
+            peak = std::max(peak, data[i]);
+        }
+        
+        // Bytes are dB offset by 255
+        float db = (float)peak - 255.0f;
+        float level = (db - WF_MIN_DB) / (WF_MAX_DB - WF_MIN_DB);
+        waterfallLine[b] = std::min(std::max(level, 0.0f), 1.0f);
+    }
+    
+    for (WebSDRClient* client : subscribers) {
+        client->deliverWaterfall(waterfallLine);
+    }
+}
+
+void WebSDRSession::processServerMessage(const std::string& msg) {
+    // MSG frames are space-separated key=value pairs, e.g.
+    // "audio_init=0 audio_rate=12000 sample_rate=12001.135"
+    double audioRate = 0.0;
+    double exactRate = 0.0;
+    bool busy = false;
+    
+    std::istringstream tokens(msg);
+    std::string token;
+    while (tokens >> token) {
+        size_t eq = token.find('=');
+        if (eq == std::string::npos) continue;
+        std::string key = token.substr(0, eq);
+        const char* value = token.c_str() + eq + 1;
+        
+        if (key == "audio_rate") {
+            audioRate = atof(value);
+        } else if (key == "sample_rate") {
+            exactRate = atof(value);
+        } else if (key == "too_busy") {
+            busy = true;
+        }
+    }
+    
+    // Every slot is taken; the server hangs up next, so move on first
+    if (busy && socketFd >= 0) {
+        WEBSDR_WARN("%s has no free slot", serverUrl.c_str());
+        resumeRace();
+        return;
+    }
+    
+    if (audioRate > 0.0) {
+        // Acknowledge the nominal rate once, so the server starts streaming at it
+        if (!rateAcknowledged) {
+            snprintf(commandText, sizeof(commandText), "SET AR OK in=%d out=44100", (int)audioRate);
+            sendWebSocketFrame(commandText);
+            rateAcknowledged = true;
+        }
+        
+        if (exactRate <= 0.0) sampleRate = audioRate;
+    }
+    
+    // sample_rate is the measured ADC-derived rate, more precise than audio_rate
+    if (exactRate > 0.0) {
+        sampleRate = exactRate;
+        WEBSDR_DEBUG("Server sample rate %.1f Hz", exactRate);
+    }
+    
+    // Build the resampler banks here, before the audio thread sees the rate
+    if (audioRate > 0.0 || exactRate > 0.0) PolyphaseResampler::prepareInputRate(sampleRate);
+    
+    for (WebSDRClient* client : subscribers) {
+        client->sampleRate = sampleRate;
+    }
+}
+
+bool WebSDRSession::sendWebSocketFrame(const char* text) {
+    return sendFrame(0x1, (const uint8_t*)text, strlen(text));
+}
+
+bool WebSDRSession::sendFrame(uint8_t opcode, const uint8_t* data, size_t len) {
+    if (socketFd < 0) return false;
+    
+    if (!writer.append(opcode, data, len)) {
+        // only if the server has stopped reading for a long while
+        WEBSDR_WARN("Send queue full, closing");
+        closeSocket();
+        setState(WebSDRClient::State::FAILED);
+        return false;
+    }
+    return true;
+}
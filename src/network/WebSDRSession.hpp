@@ -0,0 +1,135 @@
+#pragma once
+#include "WebSDRClient.hpp"
+#include "WebSocketFrameReader.hpp"
+#include "WebSocketFrameWriter.hpp"
+#include "CaptureFile.hpp"
+#include "../dsp/ImaAdpcmDecoder.hpp"
+#include "../dsp/PacketConcealer.hpp"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+struct addrinfo;
+struct pollfd;
+
+// One KiwiSDR SND WebSocket connection. Sessions are created and stepped only
+// by WebSDRClientManager's I/O thread, which polls every session's socket at
+// once; nothing here blocks or is touched from any other thread.
+class WebSDRSession {
+public:
+    // wake is called (from any thread) when background work finishes and the loop should run
+    WebSDRSession(const std::vector<std::string>& urls, const WebSDRClient::Tuning& tuning, void (*wake)());
+    // Offline session with no socket, already streaming: it only ever sees
+    // what receive() hands it. For capture replay and benchmarks.
+    explicit WebSDRSession(const WebSDRClient::Tuning& tuning);
+    ~WebSDRSession();
+    
+    // Identity used to de-duplicate subscriptions: same servers + same tuning
+    static std::string makeKey(const std::vector<std::string>& urls, const WebSDRClient::Tuning& tuning);
+    const std::string& getKey() const { return key; }
+    const std::vector<std::string>& getUrls() const { return serverUrls; }
+    
+    WebSDRClient::State getState() const { return state; }
+    bool isUsable() const { return state != WebSDRClient::State::FAILED; }
+    
+    void addSubscriber(WebSDRClient* client);
+    void removeSubscriber(WebSDRClient* client);
+    size_t getSubscriberCount() const { return subscribers.size(); }
+    
+    // Change the tuning of this stream in place
+    void retune(const WebSDRClient::Tuning& newTuning);
+    
+    // Poll integration: append the fds/events this session wants (several
+    // while servers are raced), then hand back the same entries once polled.
+    // update() runs every loop for timeouts.
+    size_t appendPollFds(std::vector<pollfd>& fds) const;
+    void handlePollEvents(const pollfd* fds, size_t count);
+    void update(double now);
+    // Seconds until update() has something to do without any socket
+    // event, or -1 if nothing is scheduled
+    double getWakeDelay(double now) const;
+    static double monotonicSeconds();
+    
+    // Bytes as recv() would have returned them after the WebSocket upgrade.
+    // Replies (pongs, SET AR OK) have nowhere to go and are dropped.
+    void receive(const uint8_t* data, size_t len);
+
+private:
+    struct Attempt;
+    
+    std::string key;
+    std::vector<WebSDRClient*> subscribers;
+    WebSDRClient::State state = WebSDRClient::State::DISCONNECTED;
+    double sampleRate = 12000.0;
+    WebSDRClient::Tuning tuning;
+    
+    // Connection race: the servers in the order given, another one joining
+    // every ATTEMPT_DELAY until a TCP connect goes through
+    std::vector<std::string> serverUrls;
+    std::vector<std::unique_ptr<Attempt>> attempts;
+    size_t attemptsStarted = 0;
+    double nextAttemptTime = 0.0;
+    
+    // the server that won, through the handshake
+    std::string serverUrl;
+    std::string host;
+    int port = 8073;
+    double attemptDeadline = 0.0;
+    
+    int socketFd = -1;
+    WebSocketFrameReader reader;     // receive arena, also holds the HTTP upgrade response
+    WebSocketFrameWriter writer;     // outgoing frames the socket hasn't accepted yet
+    char commandText[128];           // scratch for formatted SET commands
+    bool rateAcknowledged = false;   // SET AR OK went out on this connection
+    std::vector<float> decodeBuffer; // preallocated, reused for every audio packet
+    ImaAdpcmDecoder adpcm;
+    
+    // SND sequence tracking, lost packets are filled in
+    bool sequenceKnown = false;
+    uint32_t expectedSequence = 0;
+    PacketConcealer concealer;
+    std::vector<float> concealBuffer;
+    float waterfallLine[WebSDRClient::WATERFALL_BINS];
+    
+    // Playback of a capture in place of a server, looping at the end
+    MappedCapture capture;
+    CaptureReader captureReader{nullptr, 0};
+    CaptureChunk nextChunk;
+    bool chunkPending = false;
+    double playbackStart = 0.0;  // monotonic time of the capture's first chunk
+    
+    void (*wakeCallback)() = nullptr;
+    
+    // connection state machine
+    void setState(WebSDRClient::State newState);
+    bool isRacing() const;
+    void startRace();
+    void resumeRace();
+    void stepRace(double now);
+    void nextAddress(Attempt& attempt, double now);
+    void winRace(Attempt& attempt, double now);
+    void onHandshakeData();
+    void sendSoundSetup();
+    void closeSocket();
+    void flushSendQueue();
+    bool startPlayback(const std::string& path);
+    void restartPlayback(double start);
+    void playCapture(double now);
+    
+    // WebSDR protocol handling
+    const char* tuningCommand();
+    void processFrames();
+    void processAudioPacket(const uint8_t* data, size_t len);
+    void concealLostPackets(uint32_t sequence, bool stereo);
+    void deliverAudio(const float* samples, size_t count);
+    void deliverIq(const float* iq, size_t frames);
+    void recordAudioPacket(double decodeSeconds);
+    void processWaterfallPacket(const uint8_t* data, size_t len);
+    void processServerMessage(const std::string& msg);
+    
+    // Simple WebSocket frame handling
+    // These only queue; flushSendQueue() sends everything queued in one go
+    bool sendWebSocketFrame(const char* text);
+    bool sendFrame(uint8_t opcode, const uint8_t* data, size_t len);
+};
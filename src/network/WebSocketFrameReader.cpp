@@ -0,0 +1,133 @@
+#include "WebSocketFrameReader.hpp"
+#include <cstring>
+
+static const size_t INITIAL_ARENA_SIZE = 16384;
+
+WebSocketFrameReader::WebSocketFrameReader() {
+    arena.resize(INITIAL_ARENA_SIZE);
+}
+
+uint8_t* WebSocketFrameReader::prepare(size_t minFree) {
+    // Spans handed out by next() die here, so the arena can be rewound
+    if (readPos == writePos) {
+        readPos = 0;
+        writePos = 0;
+    }
+    
+    if (writable() < minFree) {
+        // Move the unparsed tail to the front before growing
+        size_t pending = size();
+        if (readPos > 0) {
+            memmove(arena.data(), arena.data() + readPos, pending);
+            readPos = 0;
+            writePos = pending;
+        }
+        if (writable() < minFree) {
+            size_t newSize = arena.size();
+            while (newSize - writePos < minFree) newSize *= 2;
+            arena.resize(newSize);
+        }
+    }
+    return arena.data() + writePos;
+}
+
+WebSocketFrameReader::Result WebSocketFrameReader::next(Message& msg) {
+    if (fragmentsDelivered) {
+        fragments.clear();
+        fragmentsDelivered = false;
+    }
+    
+    while (true) {
+        const uint8_t* p = arena.data() + readPos;
+        size_t available = size();
+        
+        if (available < 2) return NEED_MORE;
+        
+        bool fin = (p[0] & 0x80) != 0;
+        uint8_t opcode = p[0] & 0x0F;
+        bool masked = (p[1] & 0x80) != 0;
+        uint64_t payloadLen = p[1] & 0x7F;
+        
+        size_t headerLen = 2;
+        if (payloadLen == 126) {
+            headerLen = 4;
+            if (available < headerLen) return NEED_MORE;
+            payloadLen = ((uint64_t)p[2] << 8) | p[3];
+        } else if (payloadLen == 127) {
+            headerLen = 10;
+            if (available < headerLen) return NEED_MORE;
+            payloadLen = 0;
+            for (int i = 0; i < 8; i++) {
+                payloadLen = (payloadLen << 8) | p[2 + i];
+            }
+        }
+        
+        if (payloadLen > MAX_MESSAGE_SIZE) return PROTOCOL_ERROR;
+        
+        bool control = (opcode & 0x08) != 0;
+        if (control && (!fin || payloadLen > 125)) return PROTOCOL_ERROR;
+        if (opcode > 2 && opcode < 8) return PROTOCOL_ERROR;
+        if (opcode > 10) return PROTOCOL_ERROR;
+        
+        // Servers must not mask, but unmasking costs nothing so accept it
+        size_t maskOffset = headerLen;
+        if (masked) headerLen += 4;
+        
+        size_t frameLen = headerLen + (size_t)payloadLen;
+        if (available < frameLen) return NEED_MORE;
+        
+        uint8_t* payload = arena.data() + readPos + headerLen;
+        if (masked) {
+            const uint8_t* mask = arena.data() + readPos + maskOffset;
+            for (size_t i = 0; i < payloadLen; i++) {
+                payload[i] ^= mask[i & 3];
+            }
+        }
+        readPos += frameLen;
+        
+        if (control) {
+            msg.opcode = opcode;
+            msg.data = payload;
+            msg.length = (size_t)payloadLen;
+            return MESSAGE;
+        }
+        
+        if (opcode == 0) {
+            // Continuation of a fragmented message
+            if (!fragmented) return PROTOCOL_ERROR;
+            if (fragments.size() + payloadLen > MAX_MESSAGE_SIZE) return PROTOCOL_ERROR;
+            fragments.insert(fragments.end(), payload, payload + payloadLen);
+            
+            if (!fin) continue;
+            
+            fragmented = false;
+            fragmentsDelivered = true;
+            msg.opcode = fragmentOpcode;
+            msg.data = fragments.data();
+            msg.length = fragments.size();
+            return MESSAGE;
+        }
+        
+        // New text or binary message
+        if (fragmented) return PROTOCOL_ERROR;
+        
+        if (fin) {
+            msg.opcode = opcode;
+            msg.data = payload;
+            msg.length = (size_t)payloadLen;
+            return MESSAGE;
+        }
+        
+        fragmented = true;
+        fragmentOpcode = opcode;
+        fragments.assign(payload, payload + payloadLen);
+    }
+}
+
+void WebSocketFrameReader::reset() {
+    readPos = 0;
+    writePos = 0;
+    fragments.clear();
+    fragmented = false;
+    fragmentsDelivered = false;
+}
@@ -0,0 +1,60 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Incremental decoder for server->client WebSocket frames (RFC 6455).
+//
+// Bytes are received straight into a growable arena (prepare/commit), and
+// next() walks it frame by frame, so frames split across reads, several
+// frames in one read, 16/64-bit lengths and fragmented messages all work.
+// Unfragmented messages are returned as spans into the arena without being
+// copied; only continuation frames are gathered into a separate buffer.
+class WebSocketFrameReader {
+public:
+    static const size_t MAX_MESSAGE_SIZE = 16 * 1024 * 1024;
+    
+    enum Result {
+        NEED_MORE,  // no complete message buffered yet
+        MESSAGE,    // msg is filled in
+        PROTOCOL_ERROR
+    };
+    
+    struct Message {
+        uint8_t opcode = 0;
+        // Valid only until the next next(), prepare() or reset(): a
+        // reassembled message lives in a buffer the next one reuses
+        const uint8_t* data = nullptr;
+        size_t length = 0;
+    };
+    
+    WebSocketFrameReader();
+    
+    // Make room for at least minFree bytes and return where to write them,
+    // then commit() however many were actually written.
+    uint8_t* prepare(size_t minFree);
+    size_t writable() const { return arena.size() - writePos; }
+    void commit(size_t count) { writePos += count; }
+    
+    // Raw access to unparsed bytes, used for the HTTP upgrade response
+    const uint8_t* data() const { return arena.data() + readPos; }
+    size_t size() const { return writePos - readPos; }
+    void consume(size_t count) { readPos += count; }
+    
+    // Decode the next complete message. Control frames (ping/pong/close) are
+    // returned as soon as they arrive, even in the middle of a fragmented message.
+    Result next(Message& msg);
+    
+    void reset();
+
+private:
+    std::vector<uint8_t> arena;
+    size_t readPos = 0;
+    size_t writePos = 0;
+    
+    // reassembly of fragmented messages
+    std::vector<uint8_t> fragments;
+    uint8_t fragmentOpcode = 0;
+    bool fragmented = false;
+    bool fragmentsDelivered = false;
+};
@@ -0,0 +1,96 @@
+#include "WebSocketFrameWriter.hpp"
+#include <cstring>
+
+const size_t WebSocketFrameWriter::CAPACITY;
+
+WebSocketFrameWriter::WebSocketFrameWriter() : buffer(CAPACITY) {
+    std::random_device seed;
+    random.seed(seed());
+}
+
+bool WebSocketFrameWriter::append(uint8_t opcode, const uint8_t* payload, size_t length) {
+    size_t headerLength = 2 + 4;
+    if (length >= 65536) headerLength += 8;
+    else if (length >= 126) headerLength += 2;
+    
+    uint8_t* p = reserve(headerLength + length);
+    if (!p) return false;
+    
+    // FIN + opcode, then the masked length
+    *p++ = 0x80 | opcode;
+    if (length < 126) {
+        *p++ = 0x80 | (uint8_t)length;
+    } else if (length < 65536) {
+        *p++ = 0x80 | 126;
+        *p++ = (uint8_t)(length >> 8);
+        *p++ = (uint8_t)length;
+    } else {
+        *p++ = 0x80 | 127;
+        for (int shift = 56; shift >= 0; shift -= 8) {
+            *p++ = (uint8_t)((uint64_t)length >> shift);
+        }
+    }
+    
+    uint32_t keyBits = random();
+    uint8_t key[4];
+    memcpy(key, &keyBits, 4);
+    memcpy(p, key, 4);
+    p += 4;
+    
+    memcpy(p, payload, length);
+    mask(p, length, key);
+    return true;
+}
+
+bool WebSocketFrameWriter::appendRaw(const uint8_t* bytes, size_t length) {
+    uint8_t* p = reserve(length);
+    if (!p) return false;
+    memcpy(p, bytes, length);
+    return true;
+}
+
+uint8_t* WebSocketFrameWriter::reserve(size_t length) {
+    if (CAPACITY - writePos < length) {
+        // Move what's still unsent to the front before giving up
+        size_t pending = size();
+        memmove(buffer.data(), buffer.data() + sendPos, pending);
+        sendPos = 0;
+        writePos = pending;
+        if (CAPACITY - writePos < length) return nullptr;
+    }
+    uint8_t* p = buffer.data() + writePos;
+    writePos += length;
+    return p;
+}
+
+void WebSocketFrameWriter::consume(size_t count) {
+    sendPos += count;
+    if (sendPos == writePos) {
+        sendPos = 0;
+        writePos = 0;
+    }
+}
+
+void WebSocketFrameWriter::clear() {
+    sendPos = 0;
+    writePos = 0;
+}
+
+void WebSocketFrameWriter::mask(uint8_t* data, size_t length, const uint8_t key[4]) {
+    // The key repeats every 4 bytes, so two copies side by side mask 8 at once
+    // in either byte order. memcpy keeps the loads legal at any alignment.
+    uint32_t key32;
+    memcpy(&key32, key, 4);
+    uint64_t key64 = ((uint64_t)key32 << 32) | key32;
+    
+    size_t i = 0;
+    for (; i + 8 <= length; i += 8) {
+        uint64_t word;
+        memcpy(&word, data + i, 8);
+        word ^= key64;
+        memcpy(data + i, &word, 8);
+    }
+    for (; i < length; i++) {
+        data[i] ^= key[i & 3];
+    }
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+// Encoder for client->server WebSocket frames (RFC 6455).
+//
+// Frames are built in place in one buffer allocated up front, so sending a
+// command never allocates. Each frame gets a fresh random masking key, as
+// the RFC requires, and 16/64-bit lengths are used as needed. Queued frames
+// sit back to back, so a whole batch of commands leaves in a single send().
+class WebSocketFrameWriter {
+public:
+    static const size_t CAPACITY = 128 * 1024;
+    
+    WebSocketFrameWriter();
+    
+    // Queue one masked frame. Returns false if it doesn't fit in what's left,
+    // which only happens when the peer has stopped reading.
+    bool append(uint8_t opcode, const uint8_t* payload, size_t length);
+    // Unframed bytes, for the HTTP upgrade request
+    bool appendRaw(const uint8_t* bytes, size_t length);
+    
+    // Bytes waiting for the socket; consume() however many it took
+    const uint8_t* data() const { return buffer.data() + sendPos; }
+    size_t size() const { return writePos - sendPos; }
+    bool empty() const { return writePos == sendPos; }
+    void consume(size_t count);
+    
+    void clear();
+    
+    // XOR with the 4-byte key, a word at a time
+    static void mask(uint8_t* data, size_t length, const uint8_t key[4]);
+
+private:
+    std::vector<uint8_t> buffer;
+    
+    uint8_t* reserve(size_t length);
+    size_t sendPos = 0;
+    size_t writePos = 0;
+    std::mt19937 random;
+};
@@ -1,15 +1,38 @@
 #include "plugin.hpp"
+#include "modules/StationDatabase.hpp"
+#include "network/AsyncLog.hpp"
+#include "network/ServerProber.hpp"
 
 Plugin* pluginInstance;
 
 extern Model* modelWebSDRReceiver;
+extern Model* modelWebSDRExpander;
 extern Model* modelSpectrumAnalyzer;
 extern Model* modelStationScanner;
 
+// Drained lines from the async log, on its own thread
+static void logToRack(AsyncLog::Level level, const char* text) {
+    logger::Level rackLevel = logger::INFO_LEVEL;
+    switch (level) {
+        case AsyncLog::LEVEL_DEBUG: rackLevel = logger::DEBUG_LEVEL; break;
+        case AsyncLog::LEVEL_INFO: rackLevel = logger::INFO_LEVEL; break;
+        case AsyncLog::LEVEL_WARN: rackLevel = logger::WARN_LEVEL; break;
+    }
+    logger::log(rackLevel, __FILE__, __LINE__, __FUNCTION__, "[WebSDR] %s", text);
+}
+
 void init(Plugin* p) {
     pluginInstance = p;
+    asyncLog().setSink(logToRack);
+
+    // Optional server list, one host:port per line
+    serverProber().loadServers(asset::user("WebSDR/servers.txt"));
+    
+    // Optional EiBi schedule in the user folder, cached as a binary index
+    stationDatabase().loadExternal(asset::user("WebSDR/stations.csv"), asset::user("WebSDR/stations.bin"));
 
     p->addModel(modelWebSDRReceiver);
+    p->addModel(modelWebSDRExpander);
     p->addModel(modelSpectrumAnalyzer);
     p->addModel(modelStationScanner);
 }
\ No newline at end of file
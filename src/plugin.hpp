@@ -6,5 +6,6 @@ using namespace rack;
 extern Plugin* pluginInstance;
 
 extern Model* modelWebSDRReceiver;
+extern Model* modelWebSDRExpander;
 extern Model* modelSpectrumAnalyzer;
 extern Model* modelStationScanner;
\ No newline at end of file
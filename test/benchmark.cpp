@@ -0,0 +1,405 @@
+// Offline benchmark of the receive path, no network needed.
+//
+// Replays KiwiSDR captures through WebSDRSession::receive(): WebSocket frame
+// parser, SND header and loss handling, PCM/ADPCM decode, local IQ
+// demodulation, the client callback into a JitterBuffer, and the resampler
+// pulling from it at 48 kHz in 64-frame blocks like a module does. Engine
+// time follows the capture's arrival stamps, so buffering behaves as it
+// would live while the code runs as fast as it can.
+//
+//   benchmark [--repeat N] [capture.wsdrcap ...]   built-in fixtures when no files are given
+//   benchmark --write-fixtures DIR                 save the built-in fixtures as captures
+//
+// Reported per capture: audio packets per second of receive work, ns per
+// decoded sample and per output frame, heap allocations per packet on the
+// replay thread, receive() time per chunk, and end-to-end latency from a
+// packet's arrival to its first sample leaving the jitter buffer (capture clock).
+#include "../src/network/WebSDRSession.hpp"
+#include "../src/network/CaptureFile.hpp"
+#include "../src/network/SndPacket.hpp"
+#include "../src/network/AsyncLog.hpp"
+#include "../src/dsp/JitterBuffer.hpp"
+#include "../src/dsp/PolyphaseResampler.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <new>
+#include <string>
+#include <vector>
+
+// Every heap allocation made by the replay thread
+static thread_local uint64_t threadAllocations = 0;
+
+void* operator new(size_t size) {
+    threadAllocations++;
+    void* p = malloc(size ? size : 1);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void* p) noexcept {
+    free(p);
+}
+
+static const double ENGINE_RATE = 48000.0;
+static const int BLOCK_SIZE = 64;          // frames per engine block, as the modules use
+static const double DRAIN_SECONDS = 1.0;   // longest the engine runs on to play out the last packets
+static const size_t MAX_PENDING = 4096;    // packets in flight, far more than the jitter buffer holds
+
+// Progress messages would only get in the way of the table
+static void warningsOnly(AsyncLog::Level level, const char* text) {
+    if (level == AsyncLog::LEVEL_WARN) fprintf(stderr, "[WebSDR] %s\n", text);
+}
+
+static double wallSeconds() {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// ---- Fixtures ----
+
+static uint8_t imaEncode(int sample, int& predictor, int& index) {
+    static const int steps[89] = {
+        7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+        50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230, 253, 279, 307,
+        337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066,
+        2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493,
+        10442, 11487, 12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+    };
+    static const int indexTable[8] = {-1, -1, -1, -1, 2, 4, 6, 8};
+    
+    int step = steps[index];
+    int diff = sample - predictor;
+    uint8_t code = 0;
+    if (diff < 0) { code = 8; diff = -diff; }
+    int delta = step >> 3;
+    if (diff >= step) { code |= 4; diff -= step; delta += step; }
+    if (diff >= step >> 1) { code |= 2; diff -= step >> 1; delta += step >> 1; }
+    if (diff >= step >> 2) { code |= 1; delta += step >> 2; }
+    predictor += (code & 8) ? -delta : delta;
+    predictor = std::max(-32768, std::min(32767, predictor));
+    index = std::max(0, std::min(88, index + indexTable[code & 7]));
+    return code;
+}
+
+// Server->client frames are unmasked
+static void appendServerFrame(std::vector<uint8_t>& out, uint8_t opcode, const uint8_t* payload, size_t length) {
+    out.push_back(0x80 | opcode);
+    if (length < 126) {
+        out.push_back((uint8_t)length);
+    } else if (length < 65536) {
+        out.push_back(126);
+        out.push_back((uint8_t)(length >> 8));
+        out.push_back((uint8_t)length);
+    } else {
+        out.push_back(127);
+        for (int i = 7; i >= 0; i--) out.push_back((uint8_t)((uint64_t)length >> (8 * i)));
+    }
+    out.insert(out.end(), payload, payload + length);
+}
+
+struct FixtureSpec {
+    const char* name;
+    uint8_t flags;          // SndHeader::FLAG_*
+    int frames;             // per packet
+    int packetsPerChunk;    // frames coalesced into one recv()
+    size_t maxChunk;        // recv() size limit, 0 for none
+    int lossPeriod;         // one packet in this many never arrives, 0 for none
+};
+
+static const FixtureSpec FIXTURES[] = {
+    {"pcm",         0,                          512, 1, 0,    0},
+    {"adpcm",       SndHeader::FLAG_COMPRESSED, 512, 4, 0,    0},
+    {"iq",          SndHeader::FLAG_STEREO,     256, 1, 0,    0},
+    {"pcm-split-lossy", 0,                      512, 1, 1400, 20},
+};
+
+static const double FIXTURE_SECONDS = 60.0;
+static const double FIXTURE_RATE = 12000.0;
+static const double FIXTURE_JITTER = 0.008;  // seconds, arrival spread around the packet clock
+
+// A tone with a little noise, arriving on the packet clock give or take some jitter
+static std::vector<uint8_t> makeFixture(const FixtureSpec& spec) {
+    std::vector<uint8_t> capture;
+    appendCaptureHeader(capture);
+    
+    std::vector<uint8_t> stream;
+    const char* hello = "MSG audio_init=0 audio_rate=12000 sample_rate=12001.135";
+    appendServerFrame(stream, 2, (const uint8_t*)hello, strlen(hello));
+    appendCaptureChunk(capture, 0, stream.data(), (uint32_t)stream.size());
+    stream.clear();
+    
+    bool stereo = (spec.flags & SndHeader::FLAG_STEREO) != 0;
+    bool compressed = (spec.flags & SndHeader::FLAG_COMPRESSED) != 0;
+    int packets = (int)(FIXTURE_SECONDS * FIXTURE_RATE / spec.frames);
+    int predictor = 0, index = 0;
+    uint32_t noise = 1;
+    uint64_t lastMicros = 0;
+    std::vector<uint8_t> packet;
+    
+    for (int p = 0; p < packets; p++) {
+        packet.assign({'S', 'N', 'D', spec.flags});
+        for (int i = 0; i < 4; i++) packet.push_back((uint8_t)((uint32_t)p >> (8 * i)));
+        uint16_t smeter = 1000;  // -27 dBm
+        packet.push_back((uint8_t)(smeter >> 8));
+        packet.push_back((uint8_t)smeter);
+        if (stereo) packet.insert(packet.end(), SndHeader::GPS_SIZE, 0);
+        
+        for (int n = 0; n < spec.frames; n++) {
+            double t = (double)(p * spec.frames + n) / FIXTURE_RATE;
+            for (int c = 0; c < (stereo ? 2 : 1); c++) {
+                noise = noise * 1664525u + 1013904223u;
+                double phase = 2.0 * M_PI * 1000.0 * t - (c ? M_PI / 2.0 : 0.0);
+                int sample = (int)(9000.0 * std::cos(phase)) + (int)(noise >> 24) - 128;
+                if (compressed) {
+                    uint8_t code = imaEncode(sample, predictor, index);
+                    if (n % 2 == 0) {
+                        packet.push_back(code);
+                    } else {
+                        packet.back() |= code << 4;
+                    }
+                } else {
+                    packet.push_back((uint8_t)sample);
+                    packet.push_back((uint8_t)(sample >> 8));
+                }
+            }
+        }
+        
+        if (spec.lossPeriod > 0 && p % spec.lossPeriod == spec.lossPeriod / 2) continue;
+        appendServerFrame(stream, 2, packet.data(), packet.size());
+        
+        // Arrives once it has been captured, plus network jitter
+        noise = noise * 1664525u + 1013904223u;
+        double jitter = FIXTURE_JITTER * ((noise >> 8) / 16777216.0 - 0.5) * 2.0;
+        double arrival = (double)(p + 1) * spec.frames / FIXTURE_RATE + std::max(0.0, jitter);
+        uint64_t micros = std::max(lastMicros, (uint64_t)(arrival * 1e6));
+        lastMicros = micros;
+        
+        bool lastPacket = p == packets - 1;
+        if (spec.maxChunk > 0) {
+            size_t pos = 0;
+            while (stream.size() - pos >= spec.maxChunk || (lastPacket && pos < stream.size())) {
+                size_t length = std::min(spec.maxChunk, stream.size() - pos);
+                appendCaptureChunk(capture, micros, stream.data() + pos, (uint32_t)length);
+                pos += length;
+            }
+            stream.erase(stream.begin(), stream.begin() + pos);
+        } else if ((p + 1) % spec.packetsPerChunk == 0 || lastPacket) {
+            appendCaptureChunk(capture, micros, stream.data(), (uint32_t)stream.size());
+            stream.clear();
+        }
+    }
+    return capture;
+}
+
+// ---- Replay ----
+
+struct Result {
+    uint64_t chunks = 0;
+    uint64_t packets = 0;
+    uint64_t samples = 0;        // decoded audio samples handed to the callback
+    uint64_t outputFrames = 0;
+    uint64_t allocations = 0;
+    double receiveSeconds = 0.0;
+    double resampleSeconds = 0.0;
+    uint32_t lost = 0;
+    uint32_t underruns = 0;
+    uint32_t overruns = 0;
+    std::vector<float> receiveMicros;  // per chunk
+    std::vector<float> latencyMillis;  // per packet
+};
+
+// Bookkeeping for the end-to-end latency: where each packet's first
+// sample sits in the stream, and when it arrived
+struct PendingPacket {
+    uint64_t firstSample;
+    double arrival;
+};
+
+struct CountingSource {
+    JitterBuffer& buffer;
+    uint64_t popped = 0;
+    
+    explicit CountingSource(JitterBuffer& buffer) : buffer(buffer) {}
+    
+    size_t pop(float* dst, size_t count) {
+        size_t got = buffer.pop(dst, count);
+        popped += got;
+        return got;
+    }
+};
+
+static void replay(const std::vector<uint8_t>& capture, Result& result) {
+    // Local demodulation on, so IQ captures play too; PCM and ADPCM
+    // packets are told apart by their headers and go straight through
+    WebSDRClient client;
+    client.setLocalDemodulation(true);
+    WebSDRSession session(client.getTuning());
+    
+    JitterBuffer jitterBuffer(48000);
+    CountingSource source(jitterBuffer);
+    PolyphaseResampler resampler;
+    std::vector<PendingPacket> pending(MAX_PENDING);
+    size_t pendingHead = 0, pendingTail = 0;
+    uint64_t pushed = 0;
+    double arrival = 0.0;
+    
+    client.setAudioCallback([&](const float* samples, size_t count) {
+        if (pendingHead - pendingTail < MAX_PENDING) {
+            pending[pendingHead++ % MAX_PENDING] = {pushed, arrival};
+        }
+        pushed += count;
+        jitterBuffer.push(samples, count);
+    });
+    session.addSubscriber(&client);
+    
+    float block[BLOCK_SIZE];
+    uint64_t blocks = 0;
+    auto runEngineUntil = [&](double until, bool drain) {
+        while ((blocks + 1) * BLOCK_SIZE / ENGINE_RATE <= until && !(drain && pendingTail == pendingHead)) {
+            double now = (double)blocks * BLOCK_SIZE / ENGINE_RATE;
+            double start = wallSeconds();
+            double serverRate = client.getSampleRate();
+            resampler.setRates(serverRate, ENGINE_RATE);
+            resampler.setRatioTrim(jitterBuffer.update(serverRate, BLOCK_SIZE / ENGINE_RATE));
+            resampler.process(source, block, BLOCK_SIZE);
+            result.resampleSeconds += wallSeconds() - start;
+            result.outputFrames += BLOCK_SIZE;
+            blocks++;
+            
+            while (pendingTail < pendingHead && pending[pendingTail % MAX_PENDING].firstSample < source.popped) {
+                result.latencyMillis.push_back((float)((now - pending[pendingTail % MAX_PENDING].arrival) * 1e3));
+                pendingTail++;
+            }
+        }
+    };
+    
+    // The results' own storage is set aside first so it doesn't count
+    CaptureReader reader(capture.data(), capture.size());
+    CaptureChunk chunk;
+    uint64_t chunks = 0;
+    while (reader.next(chunk)) chunks++;
+    reader.rewind();
+    result.receiveMicros.reserve(result.receiveMicros.size() + chunks);
+    result.latencyMillis.reserve(result.latencyMillis.size() + chunks * 16);
+    
+    uint64_t allocationsBefore = threadAllocations;
+    while (reader.next(chunk)) {
+        arrival = chunk.micros * 1e-6;
+        runEngineUntil(arrival, false);
+        
+        double start = wallSeconds();
+        session.receive(chunk.data, chunk.length);
+        double elapsed = wallSeconds() - start;
+        result.receiveSeconds += elapsed;
+        result.receiveMicros.push_back((float)(elapsed * 1e6));
+        result.chunks++;
+    }
+    runEngineUntil(arrival + DRAIN_SECONDS, true);
+    result.allocations += threadAllocations - allocationsBefore;
+    
+    const WebSDRClient::Stats& stats = client.getStats();
+    result.packets += stats.audioPackets.load();
+    result.lost += stats.packetsLost.load();
+    result.samples += pushed;
+    result.underruns += jitterBuffer.getStats().underruns.load();
+    result.overruns += jitterBuffer.getStats().overruns.load();
+    session.removeSubscriber(&client);
+}
+
+static float percentile(std::vector<float> values, double p) {
+    if (values.empty()) return 0.0f;
+    size_t index = std::min(values.size() - 1, (size_t)(p * (values.size() - 1) + 0.5));
+    std::nth_element(values.begin(), values.begin() + index, values.end());
+    return values[index];
+}
+
+static void printHeader() {
+    printf("%-24s %8s %10s %8s %8s %9s %16s %22s %5s %5s\n",
+           "capture", "packets", "packets/s", "ns/smp", "ns/out", "alloc/pkt",
+           "recv us p50/p99", "e2e ms p50/p90/p99", "lost", "xrun");
+}
+
+static void printResult(const std::string& name, const Result& r) {
+    char recv[32], e2e[32];
+    snprintf(recv, sizeof(recv), "%.1f/%.1f", percentile(r.receiveMicros, 0.5), percentile(r.receiveMicros, 0.99));
+    snprintf(e2e, sizeof(e2e), "%.0f/%.0f/%.0f", percentile(r.latencyMillis, 0.5),
+             percentile(r.latencyMillis, 0.9), percentile(r.latencyMillis, 0.99));
+    printf("%-24s %8llu %10.0f %8.1f %8.1f %9.3f %16s %22s %5u %5u\n",
+           name.c_str(), (unsigned long long)r.packets,
+           r.receiveSeconds > 0.0 ? r.packets / r.receiveSeconds : 0.0,
+           r.samples ? r.receiveSeconds * 1e9 / r.samples : 0.0,
+           r.outputFrames ? r.resampleSeconds * 1e9 / r.outputFrames : 0.0,
+           r.packets ? (double)r.allocations / r.packets : 0.0,
+           recv, e2e, r.lost, r.underruns + r.overruns);
+}
+
+static bool readFile(const std::string& path, std::vector<uint8_t>& data) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) return false;
+    data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    return true;
+}
+
+int main(int argc, char** argv) {
+    int repeat = 10;
+    std::string fixtureDir;
+    std::vector<std::string> paths;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--repeat" && i + 1 < argc) {
+            repeat = std::max(1, atoi(argv[++i]));
+        } else if (arg == "--write-fixtures" && i + 1 < argc) {
+            fixtureDir = argv[++i];
+        } else {
+            paths.push_back(arg);
+        }
+    }
+    
+    if (!fixtureDir.empty()) {
+        for (const FixtureSpec& spec : FIXTURES) {
+            std::string path = fixtureDir + "/" + spec.name + ".wsdrcap";
+            std::vector<uint8_t> capture = makeFixture(spec);
+            std::ofstream file(path, std::ios::binary);
+            file.write((const char*)capture.data(), capture.size());
+            if (!file) {
+                fprintf(stderr, "Can't write %s\n", path.c_str());
+                return 1;
+            }
+            printf("%s\n", path.c_str());
+        }
+        return 0;
+    }
+    
+    std::vector<std::pair<std::string, std::vector<uint8_t>>> captures;
+    if (paths.empty()) {
+        for (const FixtureSpec& spec : FIXTURES) {
+            captures.push_back(std::make_pair(std::string(spec.name), makeFixture(spec)));
+        }
+    }
+    for (const std::string& path : paths) {
+        std::vector<uint8_t> data;
+        if (!readFile(path, data) || !CaptureReader(data.data(), data.size()).isValid()) {
+            fprintf(stderr, "Not a capture: %s\n", path.c_str());
+            return 1;
+        }
+        std::string name = path.substr(path.find_last_of("/\\") + 1);
+        captures.push_back(std::make_pair(name, data));
+    }
+    
+    asyncLog().setSink(warningsOnly);
+    printf("Replaying %d time(s), engine at %.0f Hz in %d-frame blocks\n\n", repeat, ENGINE_RATE, BLOCK_SIZE);
+    printHeader();
+    for (const auto& capture : captures) {
+        Result result;
+        for (int i = 0; i < repeat; i++) {
+            replay(capture.second, result);
+        }
+        printResult(capture.first, result);
+    }
+    return 0;
+}
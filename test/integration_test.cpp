@@ -40,10 +40,21 @@ int main() {
     // Set up audio callback
     client.setAudioCallback(audioCallback);
     
-    // Try to connect
+    // Connect in the background and wait for the stream to come up
+    auto waitForStream = [&client](int seconds) {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(seconds);
+        while (std::chrono::steady_clock::now() < deadline) {
+            if (client.isConnected()) return true;
+            if (client.getState() == WebSDRClient::State::FAILED) return false;
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        }
+        return false;
+    };
+    
     std::cout << "Connecting to KiwiSDR server..." << std::endl;
+    client.connect("kiwisdr.ve6slp.ca:8073");
     
-    if (client.connect("kiwisdr.ve6slp.ca:8073")) {
+    if (waitForStream(10)) {
         std::cout << "✓ Connected successfully!" << std::endl;
         
         // Let it run for 10 seconds
@@ -89,7 +100,8 @@ int main() {
         
         // Try backup server
         std::cout << "\nTrying backup server..." << std::endl;
-        if (client.connect("sdr.ve3sun.com:8073")) {
+        client.connect("sdr.ve3sun.com:8073");
+        if (waitForStream(10)) {
             std::cout << "✓ Connected to backup!" << std::endl;
             
             std::this_thread::sleep_for(std::chrono::seconds(5));